@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "alloc_counter.h"
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace vkt {
+
+#if defined(HELLOVK_COUNT_ALLOCATIONS)
+
+namespace {
+
+std::atomic<uint64_t> processAllocations{0};
+std::atomic<uint64_t> processFrees{0};
+// Trivial types, so using them never constructs anything on the heap.
+thread_local uint64_t threadAllocations = 0;
+thread_local uint64_t threadFrees = 0;
+
+}  // namespace
+
+// Used by the operators below, outside the namespace.
+void *countedAllocate(size_t size, size_t alignment) {
+  processAllocations.fetch_add(1, std::memory_order_relaxed);
+  threadAllocations++;
+  if (size == 0) {
+    size = 1;
+  }
+  void *p = nullptr;
+  if (alignment <= alignof(std::max_align_t)) {
+    p = malloc(size);
+  } else if (posix_memalign(&p, alignment, size) != 0) {
+    p = nullptr;
+  }
+  return p;
+}
+
+void countedFree(void *p) {
+  if (p == nullptr) {
+    return;
+  }
+  processFrees.fetch_add(1, std::memory_order_relaxed);
+  threadFrees++;
+  free(p);
+}
+
+bool allocationCountingEnabled() { return true; }
+
+AllocationCounts processAllocationCounts() {
+  return {processAllocations.load(std::memory_order_relaxed),
+          processFrees.load(std::memory_order_relaxed)};
+}
+
+AllocationCounts threadAllocationCounts() {
+  return {threadAllocations, threadFrees};
+}
+
+#else
+
+bool allocationCountingEnabled() { return false; }
+AllocationCounts processAllocationCounts() { return {}; }
+AllocationCounts threadAllocationCounts() { return {}; }
+
+#endif
+
+}  // namespace vkt
+
+#if defined(HELLOVK_COUNT_ALLOCATIONS)
+
+// Every form of the global operators, so none falls back to the library's
+// allocator while the others count.
+namespace {
+
+void *allocateOrThrow(size_t size, size_t alignment) {
+  if (void *p = vkt::countedAllocate(size, alignment)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+}  // namespace
+
+void *operator new(size_t size) {
+  return allocateOrThrow(size, alignof(std::max_align_t));
+}
+void *operator new[](size_t size) {
+  return allocateOrThrow(size, alignof(std::max_align_t));
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return vkt::countedAllocate(size, alignof(std::max_align_t));
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return vkt::countedAllocate(size, alignof(std::max_align_t));
+}
+void *operator new(size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *p) noexcept { vkt::countedFree(p); }
+void operator delete[](void *p) noexcept { vkt::countedFree(p); }
+void operator delete(void *p, size_t) noexcept { vkt::countedFree(p); }
+void operator delete[](void *p, size_t) noexcept { vkt::countedFree(p); }
+void operator delete(void *p, std::align_val_t) noexcept {
+  vkt::countedFree(p);
+}
+void operator delete[](void *p, std::align_val_t) noexcept {
+  vkt::countedFree(p);
+}
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  vkt::countedFree(p);
+}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  vkt::countedFree(p);
+}
+
+#endif  // HELLOVK_COUNT_ALLOCATIONS
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_ALLOC_COUNTER_H
+#define HELLOVK_ALLOC_COUNTER_H
+
+#include <cstdint>
+
+/*
+ * Heap allocation counters, for keeping allocations off the frame loop.
+ * Built with HELLOVK_COUNT_ALLOCATIONS defined, alloc_counter.cpp replaces
+ * the global operator new and delete with versions that count every call,
+ * per thread and for the whole process. Without it nothing is replaced and
+ * every count stays zero.
+ */
+
+namespace vkt {
+
+struct AllocationCounts {
+  uint64_t allocations = 0;
+  uint64_t frees = 0;
+};
+
+// Whether this build counts allocations at all.
+bool allocationCountingEnabled();
+
+// Totals since the process started, over all threads.
+AllocationCounts processAllocationCounts();
+
+// Totals for the calling thread since it started.
+AllocationCounts threadAllocationCounts();
+
+/*
+ * Counts the allocations and frees the calling thread makes between
+ * construction and counts(), e.g. over one frame. Work handed to other
+ * threads is not included.
+ */
+class AllocationScope {
+ public:
+  AllocationScope() : start(threadAllocationCounts()) {}
+
+  AllocationCounts counts() const {
+    const AllocationCounts now = threadAllocationCounts();
+    return {now.allocations - start.allocations, now.frees - start.frees};
+  }
+
+ private:
+  AllocationCounts start;
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_ALLOC_COUNTER_H
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cooked_texture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+// Declarations only, the implementation is compiled in image_codec.cpp.
+#include <stb_image.h>
+
+#include "job_system.h"
+
+namespace vkt {
+
+bool inflateCookedTexture(const void *data, const CookedTextureHeader *header,
+                          uint8_t *target, const uint64_t *mipOffsets,
+                          bool targetCached, JobSystem *jobs) {
+  const auto *file = static_cast<const uint8_t *>(data);
+  const CookedTextureMip *mips = getCookedTextureMips(header);
+  const CookedTextureChunk *chunks = getCookedTextureChunks(header);
+
+  // Mip 0 comes first, so the largest chunks are handed out first and the
+  // small tail of the chain fills in the gaps at the end.
+  struct ChunkJob {
+    uint32_t mip;
+    uint32_t chunk;
+  };
+  std::vector<ChunkJob> chunkJobs;
+  for (uint32_t i = 0; i < header->mipLevels; i++) {
+    for (uint32_t c = 0; c < mips[i].chunkCount; c++) {
+      chunkJobs.push_back({i, mips[i].firstChunk + c});
+    }
+  }
+
+  std::atomic<size_t> nextJob{0};
+  std::atomic<bool> succeeded{true};
+  auto worker = [&]() {
+    std::vector<uint8_t> scratch;
+    for (size_t j = nextJob++; j < chunkJobs.size(); j = nextJob++) {
+      const CookedTextureMip &mip = mips[chunkJobs[j].mip];
+      const CookedTextureChunk &chunk = chunks[chunkJobs[j].chunk];
+      const size_t rowBytes =
+          static_cast<size_t>(mip.width) * header->bytesPerPixel;
+      const size_t chunkBytes = rowBytes * chunk.rowCount;
+      uint8_t *destination =
+          target + mipOffsets[chunkJobs[j].mip] + rowBytes * chunk.firstRow;
+
+      uint8_t *output = destination;
+      if (!targetCached) {
+        scratch.resize(chunkBytes);
+        output = scratch.data();
+      }
+      int inflated = stbi_zlib_decode_buffer(
+          reinterpret_cast<char *>(output), static_cast<int>(chunkBytes),
+          reinterpret_cast<const char *>(file + chunk.offset),
+          static_cast<int>(chunk.size));
+      if (inflated != static_cast<int>(chunkBytes)) {
+        succeeded = false;
+        continue;
+      }
+      if (output != destination) {
+        memcpy(destination, output, chunkBytes);
+      }
+    }
+  };
+
+  // One job per thread, each with its own scratch memory, taking chunks
+  // until none are left.
+  const size_t threadCount =
+      jobs == nullptr
+          ? 1
+          : std::min<size_t>(jobs->threadCount(), chunkJobs.size());
+  JobCounter counter;
+  for (size_t i = 1; i < threadCount; i++) {
+    jobs->run([&worker] { worker(); }, &counter);
+  }
+  worker();
+  if (jobs != nullptr) {
+    jobs->wait(counter);
+  }
+  return succeeded;
+}
+
+}  // namespace vkt
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_COOKED_TEXTURE_H
+#define HELLOVK_COOKED_TEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Layout of the GPU-ready texture files written by tools/asset_cooker and
+ * read by HelloVK::decodeImage. Everything is little endian and laid out so
+ * the runtime can use the file in place (memory mapped from the APK) without
+ * parsing:
+ *
+ *   CookedTextureHeader
+ *   CookedTextureMip[mipLevels]
+ *   CookedTextureChunk[...]        compressed files only
+ *   mip 0 data, mip 1 data, ...   each starting at a COOKED_TEXTURE_ALIGNMENT
+ *                                 aligned offset from the start of the file
+ *
+ * Uncompressed mips are stored exactly as vkCmdCopyBufferToImage expects
+ * them, tightly packed rows, so the data region can be copied into a staging
+ * buffer with one memcpy. Compressed mips are split into bands of rows, each
+ * an independent zlib stream, so they can be inflated in parallel.
+ */
+
+namespace vkt {
+
+const uint32_t COOKED_TEXTURE_MAGIC = 0x54564B48;  // "HKVT"
+// Version 3 added COOKED_TEXTURE_SRGB. Version 2 files lack the flag, and
+// would sample colour as linear data, so they are rejected like any other
+// version; cook them again.
+const uint32_t COOKED_TEXTURE_VERSION = 3;
+const uint32_t COOKED_TEXTURE_ALIGNMENT = 16;
+
+// Values match vkt::PixelFormat, see pixel_format.h for the bit layouts.
+enum CookedTextureFormat : uint32_t {
+  COOKED_FORMAT_R8G8B8A8 = 0,
+  COOKED_FORMAT_R5G6B5 = 1,
+  COOKED_FORMAT_B4G4R4A4 = 2,
+  COOKED_FORMAT_A2B10G10R10 = 3,
+};
+
+enum CookedTextureFlags : uint32_t {
+  // Mip data is zlib compressed.
+  COOKED_TEXTURE_ZLIB = 1 << 0,
+  // Colour data, sRGB encoded. Sampled through an _SRGB format. Otherwise
+  // the texture holds linear data, e.g. normals or masks.
+  COOKED_TEXTURE_SRGB = 1 << 1,
+};
+
+struct CookedTextureHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t format;
+  uint32_t flags;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mipLevels;
+  uint32_t bytesPerPixel;
+};
+
+struct CookedTextureMip {
+  // Byte offset of the mip data from the start of the file.
+  uint64_t offset;
+  // Stored size, equal to uncompressedSize unless COOKED_TEXTURE_ZLIB is set.
+  uint64_t size;
+  uint64_t uncompressedSize;
+  uint32_t width;
+  uint32_t height;
+  // Range of the chunk table holding this mip's row bands, empty unless
+  // COOKED_TEXTURE_ZLIB is set.
+  uint32_t firstChunk;
+  uint32_t chunkCount;
+};
+
+// One independently compressed band of rows of a mip.
+struct CookedTextureChunk {
+  // Byte offset of the zlib stream from the start of the file.
+  uint64_t offset;
+  uint64_t size;
+  uint32_t firstRow;
+  uint32_t rowCount;
+};
+
+static_assert(sizeof(CookedTextureHeader) == 32, "header layout changed");
+static_assert(sizeof(CookedTextureMip) == 40, "mip table layout changed");
+static_assert(sizeof(CookedTextureChunk) == 24, "chunk table layout changed");
+
+// Bytes per pixel of a CookedTextureFormat, 0 for unknown formats.
+inline uint32_t cookedTextureBytesPerPixel(uint32_t format) {
+  switch (format) {
+    case COOKED_FORMAT_R8G8B8A8:
+    case COOKED_FORMAT_A2B10G10R10:
+      return 4;
+    case COOKED_FORMAT_R5G6B5:
+    case COOKED_FORMAT_B4G4R4A4:
+      return 2;
+  }
+  return 0;
+}
+
+// Whether [offset, offset + length) lies within size bytes, without
+// overflowing.
+inline bool cookedTextureRangeFits(uint64_t offset, uint64_t length,
+                                   size_t size) {
+  return offset <= size && length <= size - offset;
+}
+
+/*
+ * Returns the header if data holds a complete, consistent cooked texture of
+ * the version this build understands, nullptr otherwise. Every mip must have
+ * the extent of the base level shifted down and hold exactly its pixels,
+ * every range must lie within the file, uncompressed mips must follow each
+ * other in order at aligned offsets, and the chunks of a compressed mip must
+ * cover its rows in order. The mip table follows the header directly, and
+ * the chunk table follows the mip table.
+ */
+inline const CookedTextureHeader *getCookedTextureHeader(const void *data,
+                                                         size_t size) {
+  if (size < sizeof(CookedTextureHeader)) {
+    return nullptr;
+  }
+  const auto *header = static_cast<const CookedTextureHeader *>(data);
+  const uint64_t tablesEnd =
+      sizeof(CookedTextureHeader) +
+      static_cast<uint64_t>(header->mipLevels) * sizeof(CookedTextureMip);
+  const uint32_t bytesPerPixel = cookedTextureBytesPerPixel(header->format);
+  // At most one level past the one that is 1x1 along the longer side.
+  if (header->magic != COOKED_TEXTURE_MAGIC ||
+      header->version != COOKED_TEXTURE_VERSION || header->width == 0 ||
+      header->height == 0 || header->mipLevels == 0 ||
+      header->mipLevels > 32 ||
+      ((header->width | header->height) >> (header->mipLevels - 1)) == 0 ||
+      bytesPerPixel == 0 || header->bytesPerPixel != bytesPerPixel ||
+      size < tablesEnd) {
+    return nullptr;
+  }
+  const bool compressed = header->flags & COOKED_TEXTURE_ZLIB;
+  const auto *mips = reinterpret_cast<const CookedTextureMip *>(header + 1);
+  const auto *chunks = reinterpret_cast<const CookedTextureChunk *>(
+      mips + header->mipLevels);
+  uint64_t previousEnd = 0;
+  for (uint32_t i = 0; i < header->mipLevels; i++) {
+    const CookedTextureMip &mip = mips[i];
+    const uint32_t width = header->width >> i ? header->width >> i : 1;
+    const uint32_t height = header->height >> i ? header->height >> i : 1;
+    if (mip.width != width || mip.height != height ||
+        mip.uncompressedSize !=
+            static_cast<uint64_t>(width) * height * bytesPerPixel ||
+        !cookedTextureRangeFits(mip.offset, mip.size, size)) {
+      return nullptr;
+    }
+    if (!compressed) {
+      if (mip.size != mip.uncompressedSize || mip.chunkCount != 0 ||
+          mip.offset % COOKED_TEXTURE_ALIGNMENT != 0 ||
+          mip.offset < previousEnd) {
+        return nullptr;
+      }
+      previousEnd = mip.offset + mip.size;
+      continue;
+    }
+    const uint64_t chunksEnd =
+        tablesEnd +
+        (static_cast<uint64_t>(mip.firstChunk) + mip.chunkCount) *
+            sizeof(CookedTextureChunk);
+    if (mip.chunkCount == 0 || chunksEnd > size) {
+      return nullptr;
+    }
+    uint32_t nextRow = 0;
+    for (uint32_t c = 0; c < mip.chunkCount; c++) {
+      const CookedTextureChunk &chunk = chunks[mip.firstChunk + c];
+      if (!cookedTextureRangeFits(chunk.offset, chunk.size, size) ||
+          chunk.firstRow != nextRow || chunk.rowCount == 0 ||
+          chunk.rowCount > height - nextRow) {
+        return nullptr;
+      }
+      nextRow += chunk.rowCount;
+    }
+    if (nextRow != height) {
+      return nullptr;
+    }
+  }
+  return header;
+}
+
+inline const CookedTextureMip *getCookedTextureMips(
+    const CookedTextureHeader *header) {
+  return reinterpret_cast<const CookedTextureMip *>(header + 1);
+}
+
+inline const CookedTextureChunk *getCookedTextureChunks(
+    const CookedTextureHeader *header) {
+  return reinterpret_cast<const CookedTextureChunk *>(
+      getCookedTextureMips(header) + header->mipLevels);
+}
+
+class JobSystem;
+
+/*
+ * Inflates every chunk of a COOKED_TEXTURE_ZLIB texture, spread over the
+ * threads of jobs, or on the calling thread alone if jobs is null. Mip i
+ * is written to target + mipOffsets[i]. Chunks cover disjoint rows, so the
+ * threads never touch the same bytes. zlib reads back its own output, so
+ * when target is uncached memory pass targetCached = false: chunks are then
+ * inflated into per-thread scratch memory and copied. Returns false if any
+ * chunk is corrupt.
+ */
+bool inflateCookedTexture(const void *data, const CookedTextureHeader *header,
+                          uint8_t *target, const uint64_t *mipOffsets,
+                          bool targetCached, JobSystem *jobs);
+
+}  // namespace vkt
+
+#endif  // HELLOVK_COOKED_TEXTURE_H
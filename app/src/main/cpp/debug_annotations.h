@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_DEBUG_ANNOTATIONS_H
+#define HELLOVK_DEBUG_ANNOTATIONS_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+
+/*
+ * Names for Vulkan objects and labelled regions in command buffers, through
+ * VK_EXT_debug_utils, so that GPU captures (RenderDoc, AGI) and validation
+ * messages refer to "texture sampler" rather than to a bare handle.
+ *
+ *   VK_NAME(annotations, VK_OBJECT_TYPE_IMAGE_VIEW, view, "swapchain %u", i);
+ *   VK_LABEL_BEGIN(annotations, commandBuffer, "main pass");
+ *   ...
+ *   VK_LABEL_END(annotations, commandBuffer);
+ *
+ * Everything is behind HELLOVK_DEBUG_ANNOTATIONS, which debug builds
+ * define. Without it the macros expand to nothing, their arguments are not
+ * evaluated and the DebugAnnotations member that holds the entry points
+ * does not exist, so release builds pay nothing for the annotations.
+ *
+ * With it, annotating is a no-op until init() finds the entry points, i.e.
+ * when the instance was created without VK_EXT_debug_utils.
+ */
+
+#if defined(HELLOVK_DEBUG_ANNOTATIONS)
+
+namespace vkt {
+
+class DebugAnnotations {
+ public:
+  // VK_EXT_debug_utils must have been enabled on the instance.
+  void init(VkInstance instance, VkDevice newDevice) {
+    device = newDevice;
+    setObjectName = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(
+        vkGetInstanceProcAddr(instance, "vkSetDebugUtilsObjectNameEXT"));
+    cmdBeginLabel = reinterpret_cast<PFN_vkCmdBeginDebugUtilsLabelEXT>(
+        vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT"));
+    cmdEndLabel = reinterpret_cast<PFN_vkCmdEndDebugUtilsLabelEXT>(
+        vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT"));
+  }
+
+  /*
+   * The object type is passed explicitly rather than deduced from Handle:
+   * on 32-bit ABIs every non-dispatchable handle is a uint64_t, so the
+   * handle type does not tell a VkBuffer from a VkImage.
+   */
+  template <typename Handle, typename... Args>
+  void name(VkObjectType type, Handle handle, const char *format,
+            Args... args) const {
+    if (setObjectName == nullptr) {
+      return;
+    }
+    // The name is copied by the driver, so a stack buffer does.
+    char objectName[96];
+    if constexpr (sizeof...(Args) == 0) {
+      snprintf(objectName, sizeof(objectName), "%s", format);
+    } else {
+      snprintf(objectName, sizeof(objectName), format, args...);
+    }
+    VkDebugUtilsObjectNameInfoEXT nameInfo{};
+    nameInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+    nameInfo.objectType = type;
+    if constexpr (std::is_pointer_v<Handle>) {
+      nameInfo.objectHandle = reinterpret_cast<uintptr_t>(handle);
+    } else {
+      nameInfo.objectHandle = static_cast<uint64_t>(handle);
+    }
+    nameInfo.pObjectName = objectName;
+    setObjectName(device, &nameInfo);
+  }
+
+  // Label names must outlive the command buffer's recording, e.g. literals.
+  void beginLabel(VkCommandBuffer commandBuffer, const char *label) const {
+    if (cmdBeginLabel == nullptr) {
+      return;
+    }
+    VkDebugUtilsLabelEXT labelInfo{};
+    labelInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+    labelInfo.pLabelName = label;
+    cmdBeginLabel(commandBuffer, &labelInfo);
+  }
+
+  void endLabel(VkCommandBuffer commandBuffer) const {
+    if (cmdEndLabel != nullptr) {
+      cmdEndLabel(commandBuffer);
+    }
+  }
+
+ private:
+  VkDevice device = VK_NULL_HANDLE;
+  PFN_vkSetDebugUtilsObjectNameEXT setObjectName = nullptr;
+  PFN_vkCmdBeginDebugUtilsLabelEXT cmdBeginLabel = nullptr;
+  PFN_vkCmdEndDebugUtilsLabelEXT cmdEndLabel = nullptr;
+};
+
+// Labels a region that ends with the enclosing scope.
+class ScopedDebugLabel {
+ public:
+  ScopedDebugLabel(const DebugAnnotations &annotations,
+                   VkCommandBuffer commandBuffer, const char *label)
+      : annotations(annotations), commandBuffer(commandBuffer) {
+    annotations.beginLabel(commandBuffer, label);
+  }
+  ~ScopedDebugLabel() { annotations.endLabel(commandBuffer); }
+  ScopedDebugLabel(const ScopedDebugLabel &) = delete;
+  ScopedDebugLabel &operator=(const ScopedDebugLabel &) = delete;
+
+ private:
+  const DebugAnnotations &annotations;
+  VkCommandBuffer commandBuffer;
+};
+
+}  // namespace vkt
+
+#define VK_NAME(annotations, ...) (annotations).name(__VA_ARGS__)
+#define VK_LABEL_BEGIN(annotations, commandBuffer, label) \
+  (annotations).beginLabel(commandBuffer, label)
+#define VK_LABEL_END(annotations, commandBuffer) \
+  (annotations).endLabel(commandBuffer)
+#define HELLOVK_LABEL_CONCAT_(a, b) a##b
+#define HELLOVK_LABEL_CONCAT(a, b) HELLOVK_LABEL_CONCAT_(a, b)
+#define VK_LABEL_SCOPE(annotations, commandBuffer, label)                   \
+  const ::vkt::ScopedDebugLabel HELLOVK_LABEL_CONCAT(debugLabel, __LINE__)( \
+      annotations, commandBuffer, label)
+
+#else
+
+#define VK_NAME(annotations, ...) ((void)0)
+#define VK_LABEL_BEGIN(annotations, commandBuffer, label) ((void)0)
+#define VK_LABEL_END(annotations, commandBuffer) ((void)0)
+#define VK_LABEL_SCOPE(annotations, commandBuffer, label) ((void)0)
+
+#endif  // HELLOVK_DEBUG_ANNOTATIONS
+
+#endif  // HELLOVK_DEBUG_ANNOTATIONS_H
@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "debug_messages.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace vkt {
+
+namespace {
+
+// Powers of two. Validation messages are rarely longer than the text slot;
+// at about 2 KiB a slot the queue takes a quarter of a megabyte. A session
+// that triggers more distinct IDs than the table holds drops the rest.
+const uint32_t MESSAGE_QUEUE_SIZE = 128;
+const uint32_t MESSAGE_ID_TABLE_SIZE = 1024;
+const size_t MESSAGE_ID_NAME_SIZE = 96;
+const size_t MESSAGE_TEXT_SIZE = 2048;
+const auto LOGGER_INTERVAL = std::chrono::milliseconds(5);
+
+// Copies at most size - 1 characters and terminates, marking truncation.
+void copyTruncated(char *destination, size_t size, const char *source) {
+  if (source == nullptr) {
+    destination[0] = 0;
+    return;
+  }
+  const size_t length = strnlen(source, size);
+  if (length < size) {
+    memcpy(destination, source, length + 1);
+    return;
+  }
+  memcpy(destination, source, size - 4);
+  memcpy(destination + size - 4, "...", 4);
+}
+
+/*
+ * Drivers often leave the ID number 0 and tell messages apart by name, so
+ * both go into the key. Never 0, which marks a free counter.
+ */
+uint64_t messageKey(int32_t messageId, const char *messageIdName) {
+  uint64_t hash = 0xcbf29ce484222325ull;  // FNV-1a
+  for (const char *c = messageIdName; c != nullptr && *c != 0; c++) {
+    hash = (hash ^ uint8_t(*c)) * 0x100000001b3ull;
+  }
+  hash ^= uint32_t(messageId) * 0x9e3779b97f4a7c15ull;
+  return hash | 1;
+}
+
+}  // namespace
+
+struct DebugMessageSink::Counter {
+  std::atomic<uint64_t> key{0};
+  std::atomic<uint64_t> count{0};
+};
+
+struct DebugMessageSink::Slot {
+  std::atomic<uint64_t> sequence;
+  MessageSeverity severity;
+  uint32_t types;
+  int32_t messageId;
+  uint32_t counter;
+  char messageIdName[MESSAGE_ID_NAME_SIZE];
+  char text[MESSAGE_TEXT_SIZE];
+};
+
+// What the logger thread knows about each message ID, by counter index.
+struct DebugMessageSink::Log {
+  struct Entry {
+    bool seen = false;
+    MessageSeverity severity;
+    uint32_t types;
+    int32_t messageId;
+    std::string name;
+    std::string firstText;
+    // The count at which the next "seen N times" line is due.
+    uint64_t nextReport = 10;
+  };
+  std::vector<Entry> entries{MESSAGE_ID_TABLE_SIZE};
+  std::vector<uint32_t> seen;
+};
+
+const char *messageSeverityName(MessageSeverity severity) {
+  switch (severity) {
+    case MessageSeverity::kVerbose:
+      return "VERBOSE";
+    case MessageSeverity::kInfo:
+      return "INFO";
+    case MessageSeverity::kWarning:
+      return "WARNING";
+    case MessageSeverity::kError:
+      return "ERROR";
+  }
+  return "UNKNOWN";
+}
+
+const char *messageTypeName(uint32_t types) {
+  static const char *const NAMES[] = {"Unknown",
+                                      "General",
+                                      "Validation",
+                                      "General | Validation",
+                                      "Performance",
+                                      "General | Performance",
+                                      "Validation | Performance",
+                                      "General | Validation | Performance"};
+  return NAMES[types & 0x7];
+}
+
+DebugMessageSink::DebugMessageSink(Writer writer) : writer(writer) {}
+
+DebugMessageSink::~DebugMessageSink() {
+  if (logger.joinable()) {
+    stop();
+  }
+}
+
+void DebugMessageSink::start(const DebugMessageFilter &newFilter) {
+  if (logger.joinable()) {
+    return;
+  }
+  filter = newFilter;
+  // Kept until the sink goes, since a late post() may still be using them.
+  if (slots == nullptr) {
+    counters = std::make_unique<Counter[]>(MESSAGE_ID_TABLE_SIZE);
+    slots = std::make_unique<Slot[]>(MESSAGE_QUEUE_SIZE);
+  }
+  for (uint32_t i = 0; i < MESSAGE_ID_TABLE_SIZE; i++) {
+    counters[i].key.store(0, std::memory_order_relaxed);
+    counters[i].count.store(0, std::memory_order_relaxed);
+  }
+  for (uint32_t i = 0; i < MESSAGE_QUEUE_SIZE; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  enqueuePos.store(0, std::memory_order_relaxed);
+  dequeuePos = 0;
+  received.store(0, std::memory_order_relaxed);
+  dropped.store(0, std::memory_order_relaxed);
+  log = std::make_unique<Log>();
+  stopping = false;
+  logger = std::thread(&DebugMessageSink::loggerMain, this);
+  running.store(true, std::memory_order_release);
+}
+
+bool DebugMessageSink::post(MessageSeverity severity, uint32_t types,
+                            int32_t messageId, const char *messageIdName,
+                            const char *message) {
+  if (!running.load(std::memory_order_acquire)) {
+    return false;
+  }
+  if (severity < filter.minSeverity && !(types & MESSAGE_TYPE_PERFORMANCE)) {
+    return true;
+  }
+  for (int32_t muted : filter.mutedIds) {
+    if (muted == messageId) {
+      return true;
+    }
+  }
+  received.fetch_add(1, std::memory_order_relaxed);
+
+  // Linear probing. Whoever claims a free counter for the key pushes the
+  // message; everyone else only counts.
+  const uint64_t key = messageKey(messageId, messageIdName);
+  for (uint32_t probe = 0; probe < MESSAGE_ID_TABLE_SIZE; probe++) {
+    const uint32_t index = (key + probe) & (MESSAGE_ID_TABLE_SIZE - 1);
+    Counter &counter = counters[index];
+    uint64_t existing = counter.key.load(std::memory_order_acquire);
+    if (existing == 0 && counter.key.compare_exchange_strong(
+                             existing, key, std::memory_order_acq_rel)) {
+      counter.count.fetch_add(1, std::memory_order_relaxed);
+      return push(severity, types, messageId, messageIdName, message, index);
+    }
+    if (existing == key) {
+      counter.count.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  dropped.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+bool DebugMessageSink::push(MessageSeverity severity, uint32_t types,
+                            int32_t messageId, const char *messageIdName,
+                            const char *message, uint32_t counter) {
+  uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+  Slot *slot;
+  for (;;) {
+    slot = &slots[pos & (MESSAGE_QUEUE_SIZE - 1)];
+    const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const int64_t difference = int64_t(sequence - pos);
+    if (difference == 0) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // The slot still holds a message from a lap ago: the queue is full.
+      // The ID keeps being counted, and is reported without its text.
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+  slot->severity = severity;
+  slot->types = types;
+  slot->messageId = messageId;
+  slot->counter = counter;
+  copyTruncated(slot->messageIdName, sizeof(slot->messageIdName),
+                messageIdName);
+  copyTruncated(slot->text, sizeof(slot->text), message);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  if (severity == MessageSeverity::kError) {
+    wake.notify_one();
+  }
+  return true;
+}
+
+// Logger thread only, or with it stopped.
+bool DebugMessageSink::pop() {
+  Slot &slot = slots[dequeuePos & (MESSAGE_QUEUE_SIZE - 1)];
+  if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+    return false;
+  }
+  Log::Entry &entry = log->entries[slot.counter];
+  entry.seen = true;
+  entry.severity = slot.severity;
+  entry.types = slot.types;
+  entry.messageId = slot.messageId;
+  entry.name = slot.messageIdName;
+  entry.firstText = slot.text;
+  log->seen.push_back(slot.counter);
+  if (slot.severity >= filter.minSeverity) {
+    std::string text = std::string("[") + messageSeverityName(slot.severity) +
+                       ": " + messageTypeName(slot.types) + "]\n" +
+                       slot.text;
+    writer(slot.severity, text.c_str());
+  }
+  slot.sequence.store(dequeuePos + MESSAGE_QUEUE_SIZE,
+                      std::memory_order_release);
+  dequeuePos++;
+  return true;
+}
+
+// Logger thread only, or with it stopped.
+void DebugMessageSink::reportRepeats() {
+  for (uint32_t index : log->seen) {
+    Log::Entry &entry = log->entries[index];
+    const uint64_t count =
+        counters[index].count.load(std::memory_order_relaxed);
+    if (count < entry.nextReport) {
+      continue;
+    }
+    while (entry.nextReport <= count) {
+      entry.nextReport *= 10;
+    }
+    if (entry.severity < filter.minSeverity) {
+      continue;
+    }
+    char line[MESSAGE_ID_NAME_SIZE + 128];
+    snprintf(line, sizeof(line), "[%s: %s] %s (%d) seen %llu times",
+             messageSeverityName(entry.severity), messageTypeName(entry.types),
+             entry.name.c_str(), entry.messageId,
+             static_cast<unsigned long long>(count));
+    writer(entry.severity, line);
+  }
+}
+
+void DebugMessageSink::loggerMain() {
+  std::unique_lock<std::mutex> lock(wakeMutex);
+  while (!stopping) {
+    wake.wait_for(lock, LOGGER_INTERVAL);
+    lock.unlock();
+    while (pop()) {
+    }
+    reportRepeats();
+    lock.lock();
+  }
+}
+
+DebugMessageStats DebugMessageSink::stop() {
+  DebugMessageStats stats;
+  if (!logger.joinable()) {
+    return stats;
+  }
+  running.store(false, std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  logger.join();
+  while (pop()) {
+  }
+
+  // Most frequent first. IDs whose first message was dropped have a count
+  // but no name or text.
+  struct Row {
+    uint64_t count;
+    const Log::Entry *entry;
+  };
+  std::vector<Row> rows;
+  for (uint32_t i = 0; i < MESSAGE_ID_TABLE_SIZE; i++) {
+    if (counters[i].key.load(std::memory_order_relaxed) != 0) {
+      rows.push_back({counters[i].count.load(std::memory_order_relaxed),
+                      log->entries[i].seen ? &log->entries[i] : nullptr});
+    }
+  }
+  std::stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+    return a.count > b.count;
+  });
+  stats.received = received.load(std::memory_order_relaxed);
+  stats.dropped = dropped.load(std::memory_order_relaxed);
+  stats.distinct = static_cast<uint32_t>(rows.size());
+  if (stats.received == 0) {
+    log.reset();
+    return stats;
+  }
+
+  char line[MESSAGE_ID_NAME_SIZE + 128];
+  snprintf(line, sizeof(line),
+           "Debug messages: %llu received, %u distinct IDs, %llu dropped",
+           static_cast<unsigned long long>(stats.received), stats.distinct,
+           static_cast<unsigned long long>(stats.dropped));
+  writer(MessageSeverity::kInfo, line);
+  for (const Row &row : rows) {
+    snprintf(line, sizeof(line), "  %8llu  %-7s %s",
+             static_cast<unsigned long long>(row.count),
+             row.entry ? messageSeverityName(row.entry->severity) : "",
+             row.entry ? row.entry->name.c_str() : "(first message dropped)");
+    writer(MessageSeverity::kInfo, line);
+  }
+  bool performanceHeader = false;
+  for (const Row &row : rows) {
+    if (row.entry == nullptr ||
+        !(row.entry->types & MESSAGE_TYPE_PERFORMANCE)) {
+      continue;
+    }
+    if (!performanceHeader) {
+      writer(MessageSeverity::kInfo, "Performance warnings:");
+      performanceHeader = true;
+    }
+    std::string text = "  " + std::to_string(row.count) + "x " +
+                       row.entry->name + "\n    " + row.entry->firstText;
+    writer(MessageSeverity::kInfo, text.c_str());
+  }
+  log.reset();
+  return stats;
+}
+
+}  // namespace vkt
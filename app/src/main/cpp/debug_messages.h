@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_DEBUG_MESSAGES_H
+#define HELLOVK_DEBUG_MESSAGES_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "fixed_vector.h"
+
+namespace vkt {
+
+enum class MessageSeverity : uint32_t { kVerbose, kInfo, kWarning, kError };
+
+// Message type bits, the same as VkDebugUtilsMessageTypeFlagBitsEXT.
+const uint32_t MESSAGE_TYPE_GENERAL = 0x1;
+const uint32_t MESSAGE_TYPE_VALIDATION = 0x2;
+const uint32_t MESSAGE_TYPE_PERFORMANCE = 0x4;
+
+const char *messageSeverityName(MessageSeverity severity);
+// E.g. "Validation | Performance".
+const char *messageTypeName(uint32_t types);
+
+struct DebugMessageFilter {
+  // Messages below this are neither printed nor counted, except performance
+  // warnings, which always make it into the report.
+  MessageSeverity minSeverity = MessageSeverity::kWarning;
+  // Message ID numbers to ignore entirely, e.g. known driver noise.
+  FixedVector<int32_t, 16> mutedIds;
+};
+
+struct DebugMessageStats {
+  uint64_t received = 0;  // posted and not filtered out
+  uint64_t dropped = 0;   // of those, see post()
+  uint32_t distinct = 0;  // message IDs seen
+};
+
+/*
+ * Takes validation layer and driver messages off the threads that trigger
+ * them, deduplicated by message ID.
+ *
+ * post() looks the ID up in a lock-free table of counters. A repeat only
+ * increments its counter. The first message with an ID is copied into a
+ * bounded lock-free queue, which any number of threads may push to at
+ * once, and a logger thread writes it out within a few milliseconds, or
+ * straight away if it is an error. The logger also writes a line for an ID
+ * each time its count reaches a power of ten, and stop() a report of every
+ * ID with its count, with performance warnings in a section of their own
+ * since they are what a profiling run under validation is after.
+ *
+ *   DebugMessageSink sink(writeToLog);
+ *   sink.start(filter);
+ *   ... sink.post(...) from the debug messenger callback ...
+ *   sink.stop();
+ */
+class DebugMessageSink {
+ public:
+  // Called on the logger thread, one call per line or message.
+  using Writer = void (*)(MessageSeverity severity, const char *text);
+
+  explicit DebugMessageSink(Writer writer);
+  ~DebugMessageSink();
+  DebugMessageSink(const DebugMessageSink &) = delete;
+  DebugMessageSink &operator=(const DebugMessageSink &) = delete;
+
+  void start(const DebugMessageFilter &newFilter);
+  // Writes what is queued and the report, then joins the logger thread.
+  DebugMessageStats stop();
+
+  // Any thread, lock free and without allocating. The strings are copied,
+  // truncated past a couple of kilobytes. Returns false if the message was
+  // dropped: the sink is stopped, the queue was full or there are too many
+  // distinct IDs.
+  bool post(MessageSeverity severity, uint32_t types, int32_t messageId,
+            const char *messageIdName, const char *message);
+
+  const DebugMessageFilter &messageFilter() const { return filter; }
+
+ private:
+  struct Counter;
+  struct Slot;
+  struct Log;
+
+  bool push(MessageSeverity severity, uint32_t types, int32_t messageId,
+            const char *messageIdName, const char *message,
+            uint32_t counter);
+  bool pop();
+  void reportRepeats();
+  void loggerMain();
+
+  Writer writer;
+  DebugMessageFilter filter;
+  std::unique_ptr<Counter[]> counters;
+  std::unique_ptr<Slot[]> slots;
+  std::unique_ptr<Log> log;
+  // Bounded multi-producer queue: a slot whose sequence equals the enqueue
+  // position is free, one past it holds a message.
+  alignas(64) std::atomic<uint64_t> enqueuePos{0};
+  alignas(64) uint64_t dequeuePos = 0;
+  std::atomic<bool> running{false};
+  std::atomic<uint64_t> received{0};
+  std::atomic<uint64_t> dropped{0};
+
+  std::mutex wakeMutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::thread logger;
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_DEBUG_MESSAGES_H
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_FIXED_VECTOR_H
+#define HELLOVK_FIXED_VECTOR_H
+
+#include <assert.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vkt {
+
+/*
+ * A vector with its storage inline and a capacity fixed at compile time,
+ * for the small lists Vulkan queries return (surface formats, queue
+ * families, ...) on paths that must not touch the heap. All N elements are
+ * constructed up front, so T must be default constructible; growing past
+ * the capacity is a bug and asserts.
+ *
+ * For the usual two-call enumeration, pass capacity() as the count and the
+ * call fills in at most that many and returns VK_INCOMPLETE if there were
+ * more:
+ *
+ *   FixedVector<VkPresentModeKHR, 8> modes;
+ *   uint32_t count = modes.capacity();
+ *   vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &count,
+ *                                             modes.data());
+ *   modes.resize(count);
+ */
+template <typename T, uint32_t N>
+class FixedVector {
+ public:
+  static constexpr uint32_t capacity() { return N; }
+  uint32_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  T *data() { return items; }
+  const T *data() const { return items; }
+  T *begin() { return items; }
+  T *end() { return items + count; }
+  const T *begin() const { return items; }
+  const T *end() const { return items + count; }
+
+  T &operator[](uint32_t index) {
+    assert(index < count);
+    return items[index];
+  }
+  const T &operator[](uint32_t index) const {
+    assert(index < count);
+    return items[index];
+  }
+
+  void push_back(const T &item) {
+    assert(count < N);
+    items[count++] = item;
+  }
+  // Elements past the old size keep whatever they last held.
+  void resize(uint32_t newSize) {
+    assert(newSize <= N);
+    count = newSize;
+  }
+  void clear() { count = 0; }
+
+ private:
+  T items[N]{};
+  uint32_t count = 0;
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_FIXED_VECTOR_H
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frame_arena.h"
+
+#include <algorithm>
+
+namespace vkt {
+
+LinearArena::LinearArena(size_t blockSize) : blockSize(blockSize) {}
+
+void *LinearArena::allocateInNextBlock(size_t size, size_t alignment) {
+  // Blocks come from new[], aligned for any fundamental type; anything
+  // stricter needs room to align within the block.
+  const size_t needed =
+      size + (alignment > alignof(std::max_align_t) ? alignment : 0);
+  uint32_t next = blocks.empty() ? 0 : current + 1;
+  while (next < blocks.size() && blocks[next].size < needed) {
+    next++;
+  }
+  if (next == blocks.size()) {
+    const size_t newSize = std::max(blockSize, needed);
+    blocks.push_back({std::make_unique<uint8_t[]>(newSize), newSize});
+  }
+  enterBlock(next);
+  return allocate(size, alignment);
+}
+
+void LinearArena::enterBlock(uint32_t block) {
+  current = block;
+  cursor = reinterpret_cast<uintptr_t>(blocks[block].data.get());
+  blockEnd = cursor + blocks[block].size;
+}
+
+void LinearArena::rewind(const Marker &marker) {
+  if (blocks.empty()) {
+    return;
+  }
+  enterBlock(marker.block);
+  // A marker taken before the first allocation has no cursor yet.
+  if (marker.cursor != 0) {
+    cursor = marker.cursor;
+  }
+}
+
+void LinearArena::reset() { rewind({0, 0}); }
+
+size_t LinearArena::bytesUsed() const {
+  if (blocks.empty()) {
+    return 0;
+  }
+  size_t used =
+      cursor - reinterpret_cast<uintptr_t>(blocks[current].data.get());
+  for (uint32_t i = 0; i < current; i++) {
+    used += blocks[i].size;
+  }
+  return used;
+}
+
+size_t LinearArena::capacity() const {
+  size_t total = 0;
+  for (const Block &block : blocks) {
+    total += block.size;
+  }
+  return total;
+}
+
+}  // namespace vkt
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_FRAME_ARENA_H
+#define HELLOVK_FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vkt {
+
+/*
+ * A bump allocator for data that lives for a frame or less: draw lists,
+ * barrier batches, submit arrays. Allocating moves a cursor; nothing is
+ * freed on its own, instead the arena is reset (typically at the start of
+ * the frame that owns it) or rewound to a marker taken earlier.
+ *
+ * Memory comes in blocks that are kept across resets, so once the arena
+ * has grown to a frame's needs it stops touching the heap. Nothing is
+ * destroyed on reset: objects placed in the arena must be trivially
+ * destructible or destroyed by their owner first, which is what containers
+ * using ArenaAllocator do.
+ *
+ * Not thread safe; give each thread its own arena.
+ */
+class LinearArena {
+ public:
+  // A position in the arena to rewind to.
+  struct Marker {
+    uint32_t block;
+    uintptr_t cursor;
+  };
+
+  explicit LinearArena(size_t blockSize = 64 * 1024);
+  LinearArena(const LinearArena &) = delete;
+  LinearArena &operator=(const LinearArena &) = delete;
+
+  // Returns size bytes aligned to alignment, a power of two. Never fails;
+  // a request that does not fit moves on to the next block, adding one
+  // when there is none big enough.
+  void *allocate(size_t size, size_t alignment) {
+    const uintptr_t p = (cursor + alignment - 1) & ~uintptr_t(alignment - 1);
+    if (p + size <= blockEnd) {
+      cursor = p + size;
+      return reinterpret_cast<void *>(p);
+    }
+    return allocateInNextBlock(size, alignment);
+  }
+
+  // Uninitialized storage for count objects of type T.
+  template <typename T>
+  T *allocateArray(size_t count) {
+    return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+  }
+
+  Marker mark() const { return {current, cursor}; }
+  // Frees everything allocated since marker was taken.
+  void rewind(const Marker &marker);
+  void reset();
+
+  // Bytes handed out since the last reset, counting alignment padding and
+  // space skipped at the end of blocks.
+  size_t bytesUsed() const;
+  // Total size of the blocks, i.e. what the arena holds on to.
+  size_t capacity() const;
+
+ private:
+  struct Block {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+
+  void *allocateInNextBlock(size_t size, size_t alignment);
+  void enterBlock(uint32_t block);
+
+  size_t blockSize;
+  std::vector<Block> blocks;
+  uint32_t current = 0;
+  uintptr_t cursor = 0;
+  uintptr_t blockEnd = 0;
+};
+
+/*
+ * Lets standard containers allocate from a LinearArena. Deallocation is a
+ * no-op, so containers should reserve what they need up front rather than
+ * grow, which leaves each outgrown buffer behind until the reset.
+ *
+ *   ArenaVector<VkImageMemoryBarrier> barriers{
+ *       ArenaAllocator<VkImageMemoryBarrier>(arena)};
+ */
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(LinearArena &arena) : arena(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t count) { return arena->allocateArray<T>(count); }
+  void deallocate(T *, size_t) {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U> &other) const {
+    return arena == other.arena;
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U> &other) const {
+    return arena != other.arena;
+  }
+
+ private:
+  template <typename U>
+  friend class ArenaAllocator;
+  LinearArena *arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // namespace vkt
+
+#endif  // HELLOVK_FRAME_ARENA_H
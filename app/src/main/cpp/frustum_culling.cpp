@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frustum_culling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "job_system.h"
+
+// HELLOVK_CULLING_NO_SIMD forces the scalar path, for benchmarking.
+#if defined(HELLOVK_CULLING_NO_SIMD)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HELLOVK_CULLING_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HELLOVK_CULLING_SSE2 1
+#endif
+
+namespace vkt {
+
+namespace {
+
+// Objects per parallel batch. Each batch is a few hundred microseconds of
+// work at most, and small enough that the batches balance across threads.
+const uint32_t CULL_BATCH_SIZE = 16384;
+
+/*
+ * Four lanes, each holding the same quantity for a different object, and a
+ * mask with one bit per lane for the result of the tests.
+ */
+#if HELLOVK_CULLING_NEON
+typedef float32x4_t Lanes;
+typedef uint32x4_t LaneMask;
+inline Lanes load(const float *p) { return vld1q_f32(p); }
+inline Lanes splat(float value) { return vdupq_n_f32(value); }
+inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+inline Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+inline LaneMask allLanes() { return vdupq_n_u32(~0u); }
+// mask & (value >= 0)
+inline LaneMask andNotNegative(LaneMask mask, Lanes value) {
+  return vandq_u32(mask, vcgeq_f32(value, vdupq_n_f32(0.0f)));
+}
+inline uint32_t maskBits(LaneMask mask) {
+  const uint32_t laneBits[4] = {1, 2, 4, 8};
+  uint32x4_t bits = vandq_u32(mask, vld1q_u32(laneBits));
+  uint32x2_t pairs = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+  return vget_lane_u32(vpadd_u32(pairs, pairs), 0);
+}
+#elif HELLOVK_CULLING_SSE2
+typedef __m128 Lanes;
+typedef __m128 LaneMask;
+inline Lanes load(const float *p) { return _mm_loadu_ps(p); }
+inline Lanes splat(float value) { return _mm_set1_ps(value); }
+inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline LaneMask allLanes() {
+  return _mm_castsi128_ps(_mm_set1_epi32(-1));
+}
+inline LaneMask andNotNegative(LaneMask mask, Lanes value) {
+  return _mm_and_ps(mask, _mm_cmpge_ps(value, _mm_setzero_ps()));
+}
+inline uint32_t maskBits(LaneMask mask) { return _mm_movemask_ps(mask); }
+#endif
+
+// Writes the lanes set in mask without branching on them, which would be
+// mispredicted whenever the visible objects are scattered.
+inline uint32_t appendLanes(uint32_t mask, uint32_t index, uint32_t *visible) {
+  uint32_t written = 0;
+  for (uint32_t lane = 0; lane < 4; lane++) {
+    visible[written] = index + lane;
+    written += (mask >> lane) & 1;
+  }
+  return written;
+}
+
+// The same tests as the SIMD paths, in the same order of operations.
+inline float planeDistance(const glm::vec4 &plane, float x, float y,
+                           float z) {
+  return plane.x * x + plane.y * y + plane.z * z + plane.w;
+}
+
+bool sphereVisible(const Frustum &frustum, const BoundingSpheres &spheres,
+                   uint32_t i) {
+  for (const glm::vec4 &plane : frustum.planes) {
+    float distance = planeDistance(plane, spheres.centerX[i],
+                                   spheres.centerY[i], spheres.centerZ[i]);
+    if (!(distance + spheres.radius[i] >= 0.0f)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool boxVisible(const Frustum &frustum, const BoundingBoxes &boxes,
+                uint32_t i) {
+  for (const glm::vec4 &plane : frustum.planes) {
+    float distance = planeDistance(plane, boxes.centerX[i], boxes.centerY[i],
+                                   boxes.centerZ[i]);
+    // Projected half extent of the box onto the plane normal.
+    float reach = std::abs(plane.x) * boxes.extentX[i] +
+                  std::abs(plane.y) * boxes.extentY[i] +
+                  std::abs(plane.z) * boxes.extentZ[i];
+    if (!(distance + reach >= 0.0f)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Runs cullRange over fixed size batches, each writing its survivors at the
+ * batch's own offset in visible, then closes the gaps between batches. The
+ * survivor count of each batch goes after the batches in visible itself, so
+ * culling into the same vector every frame does not allocate.
+ */
+template <typename CullRange>
+void cullAll(uint32_t count, std::vector<uint32_t> &visible, JobSystem *jobs,
+             const CullRange &cullRange) {
+  const uint32_t batchCount = (count + CULL_BATCH_SIZE - 1) / CULL_BATCH_SIZE;
+  visible.resize(count + batchCount);
+  uint32_t *batchVisible = visible.data() + count;
+  auto cullBatches = [&](uint32_t firstBatch, uint32_t endBatch) {
+    for (uint32_t b = firstBatch; b < endBatch; b++) {
+      const uint32_t first = b * CULL_BATCH_SIZE;
+      batchVisible[b] =
+          cullRange(first, std::min(CULL_BATCH_SIZE, count - first),
+                    visible.data() + first);
+    }
+  };
+  if (jobs != nullptr) {
+    jobs->parallelFor(batchCount, 1, cullBatches);
+  } else {
+    cullBatches(0, batchCount);
+  }
+
+  uint32_t total = 0;
+  for (uint32_t b = 0; b < batchCount; b++) {
+    memmove(visible.data() + total, visible.data() + b * CULL_BATCH_SIZE,
+            batchVisible[b] * sizeof(uint32_t));
+    total += batchVisible[b];
+  }
+  visible.resize(total);
+}
+
+}  // namespace
+
+Frustum extractFrustum(const glm::mat4 &viewProjection) {
+  // glm matrices are column major; row i is m[0][i], m[1][i], ...
+  const glm::mat4 rows = glm::transpose(viewProjection);
+  Frustum frustum;
+  frustum.planes[0] = rows[3] + rows[0];  // left:   -w <= x
+  frustum.planes[1] = rows[3] - rows[0];  // right:   x <= w
+  frustum.planes[2] = rows[3] + rows[1];  // top:    -w <= y
+  frustum.planes[3] = rows[3] - rows[1];  // bottom:  y <= w
+  frustum.planes[4] = rows[2];            // near:    0 <= z
+  frustum.planes[5] = rows[3] - rows[2];  // far:     z <= w
+  for (glm::vec4 &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+void BoundingSpheres::resize(uint32_t count) {
+  centerX.resize(count);
+  centerY.resize(count);
+  centerZ.resize(count);
+  radius.resize(count);
+}
+
+void BoundingSpheres::set(uint32_t index, const glm::vec3 &center,
+                          float sphereRadius) {
+  centerX[index] = center.x;
+  centerY[index] = center.y;
+  centerZ[index] = center.z;
+  radius[index] = sphereRadius;
+}
+
+void BoundingBoxes::resize(uint32_t count) {
+  for (std::vector<float> *component :
+       {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ}) {
+    component->resize(count);
+  }
+}
+
+void BoundingBoxes::set(uint32_t index, const glm::vec3 &min,
+                        const glm::vec3 &max) {
+  const glm::vec3 center = (min + max) * 0.5f;
+  const glm::vec3 extent = (max - min) * 0.5f;
+  centerX[index] = center.x;
+  centerY[index] = center.y;
+  centerZ[index] = center.z;
+  extentX[index] = extent.x;
+  extentY[index] = extent.y;
+  extentZ[index] = extent.z;
+}
+
+uint32_t cullSpheres(const Frustum &frustum, const BoundingSpheres &spheres,
+                     uint32_t first, uint32_t count, uint32_t *visible) {
+  const uint32_t end = first + count;
+  uint32_t i = first;
+  uint32_t written = 0;
+#if HELLOVK_CULLING_NEON || HELLOVK_CULLING_SSE2
+  Lanes planes[6][4];
+  for (int p = 0; p < 6; p++) {
+    for (int c = 0; c < 4; c++) {
+      planes[p][c] = splat(frustum.planes[p][c]);
+    }
+  }
+  for (; i + 4 <= end; i += 4) {
+    const Lanes x = load(&spheres.centerX[i]);
+    const Lanes y = load(&spheres.centerY[i]);
+    const Lanes z = load(&spheres.centerZ[i]);
+    const Lanes r = load(&spheres.radius[i]);
+    LaneMask inside = allLanes();
+    for (int p = 0; p < 6; p++) {
+      Lanes distance = add(add(add(mul(planes[p][0], x), mul(planes[p][1], y)),
+                               mul(planes[p][2], z)),
+                           planes[p][3]);
+      inside = andNotNegative(inside, add(distance, r));
+    }
+    written += appendLanes(maskBits(inside), i, visible + written);
+  }
+#endif
+  for (; i < end; i++) {
+    visible[written] = i;
+    written += sphereVisible(frustum, spheres, i);
+  }
+  return written;
+}
+
+uint32_t cullBoxes(const Frustum &frustum, const BoundingBoxes &boxes,
+                   uint32_t first, uint32_t count, uint32_t *visible) {
+  const uint32_t end = first + count;
+  uint32_t i = first;
+  uint32_t written = 0;
+#if HELLOVK_CULLING_NEON || HELLOVK_CULLING_SSE2
+  Lanes planes[6][4];
+  Lanes absNormals[6][3];
+  for (int p = 0; p < 6; p++) {
+    for (int c = 0; c < 4; c++) {
+      planes[p][c] = splat(frustum.planes[p][c]);
+    }
+    for (int c = 0; c < 3; c++) {
+      absNormals[p][c] = splat(std::abs(frustum.planes[p][c]));
+    }
+  }
+  for (; i + 4 <= end; i += 4) {
+    const Lanes x = load(&boxes.centerX[i]);
+    const Lanes y = load(&boxes.centerY[i]);
+    const Lanes z = load(&boxes.centerZ[i]);
+    const Lanes ex = load(&boxes.extentX[i]);
+    const Lanes ey = load(&boxes.extentY[i]);
+    const Lanes ez = load(&boxes.extentZ[i]);
+    LaneMask inside = allLanes();
+    for (int p = 0; p < 6; p++) {
+      Lanes distance = add(add(add(mul(planes[p][0], x), mul(planes[p][1], y)),
+                               mul(planes[p][2], z)),
+                           planes[p][3]);
+      Lanes reach = add(add(mul(absNormals[p][0], ex),
+                            mul(absNormals[p][1], ey)),
+                        mul(absNormals[p][2], ez));
+      inside = andNotNegative(inside, add(distance, reach));
+    }
+    written += appendLanes(maskBits(inside), i, visible + written);
+  }
+#endif
+  for (; i < end; i++) {
+    visible[written] = i;
+    written += boxVisible(frustum, boxes, i);
+  }
+  return written;
+}
+
+void cullSpheres(const Frustum &frustum, const BoundingSpheres &spheres,
+                 std::vector<uint32_t> &visible, JobSystem *jobs) {
+  cullAll(spheres.size(), visible, jobs,
+          [&](uint32_t first, uint32_t count, uint32_t *output) {
+            return cullSpheres(frustum, spheres, first, count, output);
+          });
+}
+
+void cullBoxes(const Frustum &frustum, const BoundingBoxes &boxes,
+               std::vector<uint32_t> &visible, JobSystem *jobs) {
+  cullAll(boxes.size(), visible, jobs,
+          [&](uint32_t first, uint32_t count, uint32_t *output) {
+            return cullBoxes(frustum, boxes, first, count, output);
+          });
+}
+
+}  // namespace vkt
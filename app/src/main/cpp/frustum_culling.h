@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_FRUSTUM_CULLING_H
+#define HELLOVK_FRUSTUM_CULLING_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace vkt {
+
+class JobSystem;
+
+/*
+ * The six planes of a view frustum as (normal, distance), normals pointing
+ * inwards and normalized, so dot(normal, p) + distance is the signed
+ * distance of p from the plane.
+ */
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+/*
+ * Extracts the frustum planes from the rows of a view-projection matrix
+ * (Gribb and Hartmann). The matrix must map visible depth to [0, w] as
+ * Vulkan does, e.g. one built with glm::perspectiveRH_ZO. With an identity
+ * view-projection the frustum is the clip volume itself.
+ */
+Frustum extractFrustum(const glm::mat4 &viewProjection);
+
+/*
+ * Bounding volumes of many objects as structure-of-arrays, so the tests can
+ * load the same component of four objects at once. Boxes are axis aligned,
+ * stored as centre and half extent.
+ */
+struct BoundingSpheres {
+  std::vector<float> centerX, centerY, centerZ, radius;
+
+  uint32_t size() const { return static_cast<uint32_t>(radius.size()); }
+  void resize(uint32_t count);
+  void set(uint32_t index, const glm::vec3 &center, float sphereRadius);
+};
+
+struct BoundingBoxes {
+  std::vector<float> centerX, centerY, centerZ;
+  std::vector<float> extentX, extentY, extentZ;
+
+  uint32_t size() const { return static_cast<uint32_t>(extentX.size()); }
+  void resize(uint32_t count);
+  void set(uint32_t index, const glm::vec3 &min, const glm::vec3 &max);
+};
+
+/*
+ * Writes the indices of the objects in [first, first + count) that are at
+ * least partly inside the frustum to visible, in increasing order, and
+ * returns how many were written. visible must have room for count indices.
+ * Objects straddling a plane are kept, so the tests are conservative.
+ */
+uint32_t cullSpheres(const Frustum &frustum, const BoundingSpheres &spheres,
+                     uint32_t first, uint32_t count, uint32_t *visible);
+uint32_t cullBoxes(const Frustum &frustum, const BoundingBoxes &boxes,
+                   uint32_t first, uint32_t count, uint32_t *visible);
+
+/*
+ * Culls every object and replaces the contents of visible with the indices
+ * that survive, in increasing order. Given a job system, fixed size batches
+ * are spread over its threads and compacted afterwards.
+ */
+void cullSpheres(const Frustum &frustum, const BoundingSpheres &spheres,
+                 std::vector<uint32_t> &visible, JobSystem *jobs = nullptr);
+void cullBoxes(const Frustum &frustum, const BoundingBoxes &boxes,
+               std::vector<uint32_t> &visible, JobSystem *jobs = nullptr);
+
+}  // namespace vkt
+
+#endif  // HELLOVK_FRUSTUM_CULLING_H
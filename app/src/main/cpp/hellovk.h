@@ -14,14 +14,14 @@
  * limitations under the License.
  */
 
-#include <android/asset_manager.h>
-#include <android/log.h>
-#include <android/native_window.h>
-#include <android/native_window_jni.h>
 #include <assert.h>
 #include <vulkan/vulkan.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <map>
 #include <optional>
@@ -34,8 +34,23 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+#include "alloc_counter.h"
+#include "cooked_texture.h"
+#include "debug_annotations.h"
+#include "debug_messages.h"
+#include "fixed_vector.h"
+#include "frame_arena.h"
+#include "frustum_culling.h"
+#include "image_codec.h"
+#include "job_system.h"
+#include "platform.h"
+#include "scene_graph.h"
+#include "sprite_batch.h"
+#include "startup_profiler.h"
+#include "texture_atlas.h"
+#include "texture_residency.h"
+#include "trace.h"
+#include "vk_memory.h"
 
 /**
  * HelloVK contains the core of Vulkan pipeline setup. It includes recording
@@ -46,9 +61,6 @@
  */
 
 namespace vkt {
-#define LOG_TAG "hellovkjni"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 #define VK_CHECK(x)                           \
   do {                                        \
     VkResult err = x;                         \
@@ -60,6 +72,18 @@ namespace vkt {
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+/*
+ * Resources at least this large are bound as dedicated allocations when the
+ * driver prefers that for them, e.g. textures and full-screen render targets.
+ * Smaller resources ignore the hint. There is no sub-allocator yet, so they
+ * still get a VkDeviceMemory each; the app has a handful of them.
+ */
+const VkDeviceSize DEDICATED_ALLOCATION_MIN_SIZE = 1024 * 1024;
+
+// Device memory the residency policy lets the streamed mips of textures take
+// up. Nothing enforces it: the texture is allocated with every mip.
+const uint64_t TEXTURE_BUDGET_BYTES = 64 * 1024 * 1024;
+
 struct UniformBufferObject {
   glm::mat4 mvp;
 };
@@ -72,89 +96,103 @@ struct QueueFamilyIndices {
   }
 };
 
+/*
+ * Queried again on every swapchain recreation, so the lists live inline.
+ * Drivers report a handful of each; anything past the capacity is dropped.
+ */
 struct SwapChainSupportDetails {
   VkSurfaceCapabilitiesKHR capabilities;
-  std::vector<VkSurfaceFormatKHR> formats;
-  std::vector<VkPresentModeKHR> presentModes;
+  FixedVector<VkSurfaceFormatKHR, 64> formats;
+  FixedVector<VkPresentModeKHR, 8> presentModes;
 };
 
-struct ANativeWindowDeleter {
-  void operator()(ANativeWindow *window) { ANativeWindow_release(window); }
-};
+/*
+ * Queries into a FixedVector return VK_INCOMPLETE when more entries exist
+ * than fit. The ones that did fit are valid, so carry on with those.
+ */
+void checkFixedQuery(VkResult result, const char *what, uint32_t capacity) {
+  if (result == VK_INCOMPLETE) {
+    LOGE("More than %u %s, only the first are considered", capacity, what);
+  } else {
+    VK_CHECK(result);
+  }
+}
 
 std::vector<uint8_t> LoadBinaryFileToVector(const char *file_path,
-                                            AAssetManager *assetManager) {
+                                            AssetSource *assets) {
   std::vector<uint8_t> file_content;
-  assert(assetManager);
-  AAsset *file =
-      AAssetManager_open(assetManager, file_path, AASSET_MODE_BUFFER);
-  size_t file_length = AAsset_getLength(file);
-
-  file_content.resize(file_length);
-
-  AAsset_read(file, file_content.data(), file_length);
-  AAsset_close(file);
+  assert(assets);
+  std::unique_ptr<Asset> file = assets->open(file_path);
+  if (file == nullptr) {
+    LOGE("Fail to load %s", file_path);
+    return file_content;
+  }
+  file_content.assign(file->data(), file->data() + file->size());
   return file_content;
 }
 
-const char *toStringMessageSeverity(VkDebugUtilsMessageSeverityFlagBitsEXT s) {
-  switch (s) {
-    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
-      return "VERBOSE";
-    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
-      return "ERROR";
-    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
-      return "WARNING";
-    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
-      return "INFO";
-    default:
-      return "UNKNOWN";
-  }
-}
-const char *toStringMessageType(VkDebugUtilsMessageTypeFlagsEXT s) {
-  if (s == (VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-            VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-            VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT))
-    return "General | Validation | Performance";
-  if (s == (VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-            VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT))
-    return "Validation | Performance";
-  if (s == (VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-            VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT))
-    return "General | Performance";
-  if (s == (VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT))
-    return "Performance";
-  if (s == (VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-            VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT))
-    return "General | Validation";
-  if (s == VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT) return "Validation";
-  if (s == VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT) return "General";
-  return "Unknown";
+static MessageSeverity toMessageSeverity(
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+  if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+    return MessageSeverity::kError;
+  }
+  if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+    return MessageSeverity::kWarning;
+  }
+  if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+    return MessageSeverity::kInfo;
+  }
+  return MessageSeverity::kVerbose;
+}
+
+static void writeDebugMessage(MessageSeverity severity, const char *text) {
+  if (severity == MessageSeverity::kError) {
+    LOGE("%s", text);
+  } else {
+    LOGI("%s", text);
+  }
 }
 
+/*
+ * Runs on whichever thread made the call being reported, often the render
+ * thread, so it only hands the message to the sink's logger thread.
+ */
 static VKAPI_ATTR VkBool32 VKAPI_CALL
 debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
               VkDebugUtilsMessageTypeFlagsEXT messageType,
               const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-              void * /* pUserData */) {
-  auto ms = toStringMessageSeverity(messageSeverity);
-  auto mt = toStringMessageType(messageType);
-  printf("[%s: %s]\n%s\n", ms, mt, pCallbackData->pMessage);
-
+              void *pUserData) {
+  static_cast<DebugMessageSink *>(pUserData)->post(
+      toMessageSeverity(messageSeverity), messageType,
+      pCallbackData->messageIdNumber, pCallbackData->pMessageIdName,
+      pCallbackData->pMessage);
   return VK_FALSE;
 }
 
+/*
+ * Only asks for the severities the filter lets through, so the layer does
+ * not even format the others. Warnings are always included, as that is the
+ * severity of performance warnings.
+ */
 static void populateDebugMessengerCreateInfo(
-    VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
+    VkDebugUtilsMessengerCreateInfoEXT &createInfo, DebugMessageSink *sink) {
+  const MessageSeverity minSeverity = sink->messageFilter().minSeverity;
   createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-  createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                               VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+  createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
                                VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+  if (minSeverity <= MessageSeverity::kInfo) {
+    createInfo.messageSeverity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+  }
+  if (minSeverity <= MessageSeverity::kVerbose) {
+    createInfo.messageSeverity |=
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+  }
   createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
                            VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
                            VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
   createInfo.pfnUserCallback = debugCallback;
+  createInfo.pUserData = sink;
 }
 
 static VkResult CreateDebugUtilsMessengerEXT(
@@ -180,15 +218,150 @@ static void DestroyDebugUtilsMessengerEXT(
   }
 }
 
+/*
+ * Returns VK_FORMAT_UNDEFINED for formats this build does not know. Colour
+ * textures (COOKED_TEXTURE_SRGB) map to the _SRGB variant so the sampler
+ * decodes to linear before filtering.
+ */
+static VkFormat getCookedTextureVkFormat(uint32_t format, uint32_t flags) {
+  const bool srgb = flags & COOKED_TEXTURE_SRGB;
+  switch (format) {
+    case COOKED_FORMAT_R8G8B8A8:
+      return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    case COOKED_FORMAT_R5G6B5:
+      return srgb ? VK_FORMAT_UNDEFINED : VK_FORMAT_R5G6B5_UNORM_PACK16;
+    case COOKED_FORMAT_B4G4R4A4:
+      return srgb ? VK_FORMAT_UNDEFINED : VK_FORMAT_B4G4R4A4_UNORM_PACK16;
+    case COOKED_FORMAT_A2B10G10R10:
+      return srgb ? VK_FORMAT_UNDEFINED : VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+  }
+  return VK_FORMAT_UNDEFINED;
+}
+
+// One vkCmdDraw, collected before recording.
+struct DrawCommand {
+  uint32_t vertexCount;
+  uint32_t instanceCount;
+  uint32_t firstVertex;
+  uint32_t firstInstance;
+};
+
+/*
+ * CPU time spent in each stage of the last render() call, in milliseconds.
+ */
+struct FrameTimings {
+  double waitMs = 0.0;     // for the frame's fence, i.e. the GPU
+  double acquireMs = 0.0;  // for the next swapchain image
+  double updateMs = 0.0;   // scene graph, culling and uniforms
+  double recordMs = 0.0;
+  double submitMs = 0.0;
+  double presentMs = 0.0;
+};
+
+static bool isSrgbFormat(VkFormat format) {
+  return format == VK_FORMAT_B8G8R8A8_SRGB ||
+         format == VK_FORMAT_R8G8B8A8_SRGB ||
+         format == VK_FORMAT_A8B8G8R8_SRGB_PACK32;
+}
+
+/*
+ * What the validation layer checks, set through the "validation" setting
+ * (see readSetting): off, standard, best-practices, sync or gpu-assisted.
+ * The last three add a VkValidationFeaturesEXT feature to the standard
+ * checks and are much slower; best practices and synchronization
+ * validation report through performance warnings and errors respectively.
+ */
+enum class ValidationMode {
+  kOff,
+  kStandard,
+  kBestPractices,
+  kSynchronization,
+  kGpuAssisted
+};
+
+static const char *validationModeName(ValidationMode mode) {
+  switch (mode) {
+    case ValidationMode::kOff:
+      return "off";
+    case ValidationMode::kStandard:
+      return "standard";
+    case ValidationMode::kBestPractices:
+      return "best-practices";
+    case ValidationMode::kSynchronization:
+      return "sync";
+    case ValidationMode::kGpuAssisted:
+      return "gpu-assisted";
+  }
+  return "unknown";
+}
+
+static ValidationMode parseValidationMode(const std::string &value) {
+  if (value == "standard" || value == "on" || value == "1") {
+    return ValidationMode::kStandard;
+  }
+  if (value == "best-practices") {
+    return ValidationMode::kBestPractices;
+  }
+  if (value == "sync") {
+    return ValidationMode::kSynchronization;
+  }
+  if (value == "gpu-assisted") {
+    return ValidationMode::kGpuAssisted;
+  }
+  if (!value.empty() && value != "off" && value != "0") {
+    LOGE("Unknown validation mode %s, validation is off", value.c_str());
+  }
+  return ValidationMode::kOff;
+}
+
+// The "messages" setting: the lowest severity of validation message kept.
+static MessageSeverity parseMessageSeverity(const std::string &value) {
+  if (value == "verbose") {
+    return MessageSeverity::kVerbose;
+  }
+  if (value == "info") {
+    return MessageSeverity::kInfo;
+  }
+  if (value == "error") {
+    return MessageSeverity::kError;
+  }
+  return MessageSeverity::kWarning;
+}
+
 class HelloVK {
  public:
   void initVulkan();
   void render();
   void cleanup();
   void cleanupSwapChain();
-  void reset(ANativeWindow *newWindow, AAssetManager *newManager);
+  void reset(std::unique_ptr<SurfaceProvider> newSurfaceProvider,
+             AssetSource *newAssets);
+  void recreateSwapChain();
   bool initialized = false;
 
+  // Benchmark hooks, see tools/bench/frame_bench.cpp. The quad is drawn
+  // draws times with instances instances each; zero draws is an empty frame.
+  void setDrawWorkload(uint32_t draws, uint32_t instances);
+  // Also draws sprites sprites from the sprite atlas over the quad, all in
+  // one batch; zero, the default, draws none.
+  void setSpriteWorkload(uint32_t sprites);
+  // Uploads a width x height RGBA texture through a staging buffer the way
+  // the app's texture is, waits for it and frees it again.
+  void uploadTexture(uint32_t width, uint32_t height);
+  // Waits for the texture initVulkan started loading, decoded or not; it is
+  // uploaded by the next frame.
+  void waitForTextureLoad() { jobs.wait(textureLoad); }
+  const FrameTimings &frameTimings() const { return timings; }
+  // Renders a frame and copies it back as tightly packed 8-bit RGBA, as
+  // encoded in the swapchain. Returns false if the swapchain cannot be read
+  // back or the frame was not rendered.
+  bool captureFrame(std::vector<uint8_t> &rgba, uint32_t &width,
+                    uint32_t &height);
+  // Times the launch. initVulkan starts it unless the platform already has,
+  // to include the time before, and the first frame with the texture
+  // finishes it.
+  StartupProfiler &startup() { return startupProfiler; }
+
  private:
   void createDevice();
   void createInstance();
@@ -200,32 +373,67 @@ class HelloVK {
   void createImageViews();
   void createTextureImage();
   void decodeImage();
+  bool decodeImageDirect(const uint8_t *fileData, int fileSize);
+  stbi_uc *checkDecodedSize(stbi_uc *decodedData, uint8_t *target, int width,
+                            int height);
+  bool loadCookedTexture(const Asset &file, const char *path);
   void createTextureImageViews();
   void createTextureSampler();
-  void copyBufferToImage();
+  void recordTextureUpload(VkCommandBuffer cmd);
+  void recordMipUpload(VkCommandBuffer cmd, uint32_t mip);
+  void updateTextureResidency(VkCommandBuffer cmd);
+  void buildSpriteAtlas();
+  void recordSpriteAtlasUpload(VkCommandBuffer cmd);
+  void createSpriteBuffers();
+  void destroySpriteBuffers();
+  void recordSprites(VkCommandBuffer cmd);
   void createRenderPass();
   void createDescriptorSetLayout();
   void createGraphicsPipeline();
+  VkPipeline createPipeline(
+      const char *name, const std::vector<uint8_t> &vertCode,
+      const std::vector<uint8_t> &fragCode,
+      const VkPipelineVertexInputStateCreateInfo &vertexInput,
+      bool alphaBlend);
   void createFramebuffers();
   void createCommandPool();
   void createCommandBuffer();
   void createSyncObjects();
+  void runStartupStage(const char *name, void (HelloVK::*stage)());
   QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
   bool isDeviceSuitable(VkPhysicalDevice device);
   bool checkValidationLayerSupport();
-  std::vector<const char *> getRequiredExtensions(bool enableValidation);
+  bool checkInstanceExtensionSupport(const char *extensionName,
+                                     const char *layerName = nullptr);
+  void logInstanceExtensions();
+  FixedVector<const char *, 4> getRequiredExtensions(
+      bool enableDebugUtils, bool enableValidationFeatures);
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
   VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
   VkShaderModule createShaderModule(const std::vector<uint8_t> &code);
   void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
-  void recreateSwapChain();
+  void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  ArenaVector<DrawCommand> buildDrawList();
+  void createTimestampQueries();
+  void traceGpuZones(uint32_t frame);
   void onOrientationChange();
-  uint32_t findMemoryType(uint32_t typeFilter,
-                          VkMemoryPropertyFlags properties);
+  uint32_t findMemoryType(uint32_t typeFilter, MemoryUsage usage,
+                          VkDeviceSize size);
   void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                    VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                    VkDeviceMemory &bufferMemory);
+                    MemoryUsage memoryUsage, VkBuffer &buffer,
+                    VkDeviceMemory &bufferMemory,
+                    uint32_t *memoryType = nullptr);
+  void allocateBufferMemory(VkBuffer buffer, MemoryUsage memoryUsage,
+                            VkDeviceMemory &bufferMemory,
+                            uint32_t *memoryType = nullptr);
+  void allocateImageMemory(VkImage image, MemoryUsage memoryUsage,
+                           VkDeviceMemory &imageMemory,
+                           uint32_t *memoryType = nullptr);
+  void allocateMemory(const VkMemoryRequirements2 &memRequirements,
+                      const VkMemoryDedicatedRequirements &dedicated,
+                      VkImage image, VkBuffer buffer, MemoryUsage memoryUsage,
+                      VkDeviceMemory &memory, uint32_t *memoryType);
   void createUniformBuffers();
   void updateUniformBuffer(uint32_t currentImage);
   void createDescriptorPool();
@@ -233,29 +441,37 @@ class HelloVK {
   void establishDisplaySizeIdentity();
 
   /*
-   * In order to enable validation layer toggle this to true and
-   * follow the README.md instructions concerning the validation
-   * layers. You will be required to add separate vulkan validation
-   * '*.so' files in order to enable this.
-   *
-   * The validation layers are not shipped with the APK as they are sizeable.
+   * Read from the "validation" setting when the instance is created. Needs
+   * the validation layer '*.so' files, which are not shipped with the APK
+   * as they are sizeable; see README.md.
    */
+  ValidationMode validationMode = ValidationMode::kOff;
   bool enableValidationLayers = false;
+  // Which validation messages are kept. They are written out on a thread
+  // of their own and summarized when the instance is destroyed.
+  DebugMessageFilter debugMessageFilter;
+  DebugMessageSink debugMessages{writeDebugMessage};
 
   const std::vector<const char *> validationLayers = {
       "VK_LAYER_KHRONOS_validation"};
   const std::vector<const char *> deviceExtensions = {
       VK_KHR_SWAPCHAIN_EXTENSION_NAME};
-  std::unique_ptr<ANativeWindow, ANativeWindowDeleter> window;
-  AAssetManager *assetManager;
+  std::unique_ptr<SurfaceProvider> surfaceProvider;
+  AssetSource *assets;
 
   VkInstance instance;
   VkDebugUtilsMessengerEXT debugMessenger;
+  // VK_EXT_debug_utils is on for validation and for debug annotations.
+  bool debugUtilsEnabled = false;
+#if defined(HELLOVK_DEBUG_ANNOTATIONS)
+  DebugAnnotations debugAnnotations;
+#endif
 
   VkSurfaceKHR surface;
 
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
   VkDevice device;
+  MemoryTypeSelector memoryTypes;
 
   VkSwapchainKHR swapChain;
   std::vector<VkImage> swapChainImages;
@@ -277,6 +493,33 @@ class HelloVK {
 
   std::vector<VkBuffer> uniformBuffers;
   std::vector<VkDeviceMemory> uniformBuffersMemory;
+  std::vector<void *> uniformBuffersMapped;
+
+  // Shared by everything that spreads work over threads. Frame work sits on
+  // the critical path, so keep it on the fast cores.
+  JobSystem jobs{UINT32_MAX, CoreAffinity::kBigCores};
+
+  // initVulkan reads the assets, and loads the texture, on jobs. Frames are
+  // only cleared until the texture is resident, see recordCommandBuffer.
+  StartupProfiler startupProfiler;
+  JobCounter assetReads;
+  JobCounter textureLoad;
+  bool textureResident = false;
+  std::vector<uint8_t> vertShaderCode;
+  std::vector<uint8_t> fragShaderCode;
+  std::unique_ptr<Asset> textureAsset;
+  bool textureAssetCooked = false;
+
+  // The textured quad is the only node in the scene for now.
+  SceneGraph scene;
+  uint32_t quadNode =
+      scene.addNode(SceneGraph::kNoParent, glm::vec3(0.0f),
+                    glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+  float quadAngleDegrees = 0.0f;
+  // World space bounds of every scene node, and the nodes that survived
+  // frustum culling for the frame being recorded.
+  BoundingSpheres sceneBounds;
+  std::vector<uint32_t> visibleNodes;
 
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
@@ -284,55 +527,206 @@ class HelloVK {
   VkDescriptorPool descriptorPool;
   std::vector<VkDescriptorSet> descriptorSets;
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingMemory;
+  VkBuffer stagingBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
   int textureWidth, textureHeight, textureChannels;
-  VkImage textureImage;
-  VkDeviceMemory textureImageMemory;
-  VkImageView textureImageView;
-  VkSampler textureSampler;
+  uint32_t textureMipLevels = 1;
+  VkFormat textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+  std::vector<VkBufferImageCopy> textureCopyRegions;
+  // Written by the CPU in place, without staging; see decodeImageDirect.
+  bool textureLinear = false;
+  // Cleared when no texture could be loaded, the quad is not drawn then.
+  bool textureDecoded = false;
+  VkImage textureImage = VK_NULL_HANDLE;
+  VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+  // One view per mip, each from that mip down to the smallest, so that
+  // sampling can be limited to the resident ones.
+  std::vector<VkImageView> textureMipViews;
+  VkSampler textureSampler = VK_NULL_HANDLE;
+  // Which mips of the texture are resident, see updateTextureResidency, and
+  // the first one each frame's descriptor set samples.
+  TextureResidencyManager textureResidency{TEXTURE_BUDGET_BYTES};
+  TextureId textureId = 0;
+  uint64_t residencyFrame = 0;
+  std::vector<MipLoad> mipLoads;
+  std::vector<MipEviction> mipEvictions;
+  std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> descriptorBaseMip{};
+
+  // Sprites are drawn over the quad from one atlas, with one descriptor set
+  // and one draw per frame, see setSpriteWorkload. The atlas is built on
+  // the texture's job and uploaded along with it.
+  std::vector<uint8_t> spriteVertShaderCode;
+  std::vector<uint8_t> spriteFragShaderCode;
+  VkPipeline spritePipeline;
+  TextureAtlas spriteAtlas;
+  VkBuffer spriteAtlasStaging = VK_NULL_HANDLE;
+  VkDeviceMemory spriteAtlasStagingMemory = VK_NULL_HANDLE;
+  VkImage spriteAtlasImage = VK_NULL_HANDLE;
+  VkDeviceMemory spriteAtlasMemory = VK_NULL_HANDLE;
+  VkImageView spriteAtlasView = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> spriteDescriptorSets;
+  // SPRITE_QUAD_INDICES, and a persistently mapped instance buffer per
+  // frame in flight with room for spriteCapacity sprites.
+  VkBuffer spriteIndexBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory spriteIndexMemory = VK_NULL_HANDLE;
+  std::array<VkBuffer, MAX_FRAMES_IN_FLIGHT> spriteInstanceBuffers{};
+  std::array<VkDeviceMemory, MAX_FRAMES_IN_FLIGHT> spriteInstanceMemory{};
+  std::array<SpriteInstance *, MAX_FRAMES_IN_FLIGHT> spriteInstances{};
+  uint32_t spriteCapacity = 0;
+  uint32_t spriteCount = 0;
+  SpriteBatch spriteBatch;
+
+  // Transient CPU data of each frame in flight, reset once its fence has
+  // signalled.
+  std::array<LinearArena, MAX_FRAMES_IN_FLIGHT> frameArenas;
+  // Two timestamps per frame in flight, around the render pass, written
+  // only while a trace capture runs. The offset moves GPU ticks, once
+  // scaled to nanoseconds, onto the trace clock.
+  VkQueryPool timestampQueries = VK_NULL_HANDLE;
+  double timestampPeriodNs = 0.0;
+  uint64_t timestampMask = 0;
+  int64_t gpuClockOffsetNs = 0;
+  std::array<bool, MAX_FRAMES_IN_FLIGHT> gpuZonePending{};
+
+  uint32_t drawCount = 1;
+  uint32_t instanceCount = 1;
+  FrameTimings timings;
+
+  // Host visible copy of a swapchain image, created on the first capture.
+  bool swapChainReadable = false;
+  bool captureRequested = false;
+  bool captureRecorded = false;
+  VkBuffer readbackBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+  uint32_t readbackType = 0;
 
   uint32_t currentFrame = 0;
+  // Counts up to the first steady-state frame, see render().
+  uint32_t framesSinceRecreate = 0;
   bool orientationChanged = false;
   VkSurfaceTransformFlagBitsKHR pretransformFlag;
 };
 
+/*
+ * Startup runs as a small graph of jobs around the calling thread:
+ *   - the shaders and the texture file are read while the instance and
+ *     device are created, which needs nothing but the asset source;
+ *   - once there is a device, the texture is decoded into its staging
+ *     buffer and its image created on a job of its own, which the first
+ *     frames do not wait for;
+ *   - the graphics pipeline is compiled on a job as soon as the render pass
+ *     exists and the shaders are read, while this thread creates the
+ *     remaining per-frame objects.
+ * Only queue submissions and the command pool stay on this thread, as
+ * Vulkan needs those externally synchronized. Every stage is timed by
+ * startupProfiler, whose report render() writes once the texture is drawn.
+ * The "startup_report" setting names a file to append it to.
+ */
 void HelloVK::initVulkan() {
-  createInstance();
-  createSurface();
-  pickPhysicalDevice();
-  createLogicalDeviceAndQueue();
-  setupDebugMessenger();
-  establishDisplaySizeIdentity();
-  createSwapChain();
-  createImageViews();
-  createRenderPass();
-  createDescriptorSetLayout();
-  createGraphicsPipeline();
-  createFramebuffers();
-  createCommandPool();
-  createCommandBuffer();
-  decodeImage();
-  createTextureImage();
-  copyBufferToImage();
-  createTextureImageViews();
-  createTextureSampler();
-  createUniformBuffers();
-  createDescriptorPool();
-  createDescriptorSets();
-  createSyncObjects();
+  TRACE_SCOPE("initVulkan");
+  if (!startupProfiler.active()) {
+    startupProfiler.start();
+  }
+  const std::string reportPath = readSetting("startup_report");
+  if (!reportPath.empty()) {
+    startupProfiler.setReportPath(reportPath);
+  }
+  textureResident = false;
+  jobs.run(
+      [this] {
+        STARTUP_STAGE(startupProfiler, "readShaders");
+        vertShaderCode =
+            LoadBinaryFileToVector("shaders/shader.vert.spv", assets);
+        fragShaderCode =
+            LoadBinaryFileToVector("shaders/shader.frag.spv", assets);
+        spriteVertShaderCode =
+            LoadBinaryFileToVector("shaders/sprite.vert.spv", assets);
+        spriteFragShaderCode =
+            LoadBinaryFileToVector("shaders/sprite.frag.spv", assets);
+      },
+      &assetReads);
+  jobs.run(
+      [this] {
+        // texture.vkt, cooked by tools/asset_cooker, is preferred.
+        STARTUP_STAGE(startupProfiler, "openTexture");
+        textureAsset = assets->open("texture.vkt");
+        textureAssetCooked = textureAsset != nullptr;
+        if (!textureAssetCooked) {
+          textureAsset = assets->open("texture.png");
+        }
+      },
+      &assetReads);
+
+  runStartupStage("createInstance", &HelloVK::createInstance);
+  runStartupStage("createSurface", &HelloVK::createSurface);
+  runStartupStage("pickPhysicalDevice", &HelloVK::pickPhysicalDevice);
+  runStartupStage("createLogicalDevice",
+                  &HelloVK::createLogicalDeviceAndQueue);
+  runStartupStage("setupDebugMessenger", &HelloVK::setupDebugMessenger);
+
+  jobs.run(
+      [this] {
+        runStartupStage("decodeImage", &HelloVK::decodeImage);
+        if (!textureDecoded) {
+          return;
+        }
+        if (!textureLinear) {
+          runStartupStage("createTextureImage",
+                          &HelloVK::createTextureImage);
+        }
+        runStartupStage("createTextureImageViews",
+                        &HelloVK::createTextureImageViews);
+        runStartupStage("createTextureSampler",
+                        &HelloVK::createTextureSampler);
+        runStartupStage("buildSpriteAtlas", &HelloVK::buildSpriteAtlas);
+      },
+      &textureLoad, &assetReads);
+
+  runStartupStage("establishDisplaySize",
+                  &HelloVK::establishDisplaySizeIdentity);
+  runStartupStage("createSwapChain", &HelloVK::createSwapChain);
+  runStartupStage("createImageViews", &HelloVK::createImageViews);
+  runStartupStage("createRenderPass", &HelloVK::createRenderPass);
+  runStartupStage("createDescriptorSetLayout",
+                  &HelloVK::createDescriptorSetLayout);
+  JobCounter pipelineReady;
+  jobs.run(
+      [this] {
+        runStartupStage("createGraphicsPipeline",
+                        &HelloVK::createGraphicsPipeline);
+      },
+      &pipelineReady, &assetReads);
+
+  runStartupStage("createFramebuffers", &HelloVK::createFramebuffers);
+  runStartupStage("createCommandPool", &HelloVK::createCommandPool);
+  runStartupStage("createCommandBuffer", &HelloVK::createCommandBuffer);
+  runStartupStage("createTimestampQueries",
+                  &HelloVK::createTimestampQueries);
+  runStartupStage("createUniformBuffers", &HelloVK::createUniformBuffers);
+  runStartupStage("createDescriptorPool", &HelloVK::createDescriptorPool);
+  runStartupStage("createSyncObjects", &HelloVK::createSyncObjects);
+  jobs.wait(pipelineReady);
+  // Without workers, jobs only run on threads that wait for them.
+  if (jobs.threadCount() == 1) {
+    jobs.wait(textureLoad);
+  }
   initialized = true;
 }
 
+void HelloVK::runStartupStage(const char *name, void (HelloVK::*stage)()) {
+  STARTUP_STAGE(startupProfiler, name);
+  (this->*stage)();
+}
+
 /*
- *	Create a buffer with specified usage and memory properties
- *	i.e a uniform buffer which uses HOST_COHERENT memory
+ *	Create a buffer with specified usage and memory usage intent
+ *	i.e a uniform buffer which is rewritten by the CPU every frame
  *  Upon creation, these buffers will list memory requirements which need to be
  *  satisfied by the device in use in order to be created.
  */
 void HelloVK::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                           VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                           VkDeviceMemory &bufferMemory) {
+                           MemoryUsage memoryUsage, VkBuffer &buffer,
+                           VkDeviceMemory &bufferMemory, uint32_t *memoryType) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
@@ -341,39 +735,104 @@ void HelloVK::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 
   VK_CHECK(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer));
 
-  VkMemoryRequirements memRequirements;
-  vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+  allocateBufferMemory(buffer, memoryUsage, bufferMemory, memoryType);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex =
-      findMemoryType(memRequirements.memoryTypeBits, properties);
+  VK_CHECK(vkBindBufferMemory(device, buffer, bufferMemory, 0));
+}
 
-  VK_CHECK(vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory));
+/*
+ * Memory requirements are queried through the Vulkan 1.1
+ * vkGet*MemoryRequirements2 entry points so the driver can tell us whether it
+ * prefers (or requires) a dedicated allocation for the resource, as described
+ * by VK_KHR_dedicated_allocation.
+ */
+void HelloVK::allocateBufferMemory(VkBuffer buffer, MemoryUsage memoryUsage,
+                                   VkDeviceMemory &bufferMemory,
+                                   uint32_t *memoryType) {
+  VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+  requirementsInfo.sType =
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+  requirementsInfo.buffer = buffer;
+
+  VkMemoryDedicatedRequirements dedicatedRequirements{};
+  dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+  VkMemoryRequirements2 memRequirements{};
+  memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+  memRequirements.pNext = &dedicatedRequirements;
+  vkGetBufferMemoryRequirements2(device, &requirementsInfo, &memRequirements);
+
+  allocateMemory(memRequirements, dedicatedRequirements, VK_NULL_HANDLE, buffer,
+                 memoryUsage, bufferMemory, memoryType);
+}
 
-  vkBindBufferMemory(device, buffer, bufferMemory, 0);
+void HelloVK::allocateImageMemory(VkImage image, MemoryUsage memoryUsage,
+                                  VkDeviceMemory &imageMemory,
+                                  uint32_t *memoryType) {
+  VkImageMemoryRequirementsInfo2 requirementsInfo{};
+  requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+  requirementsInfo.image = image;
+
+  VkMemoryDedicatedRequirements dedicatedRequirements{};
+  dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+  VkMemoryRequirements2 memRequirements{};
+  memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+  memRequirements.pNext = &dedicatedRequirements;
+  vkGetImageMemoryRequirements2(device, &requirementsInfo, &memRequirements);
+
+  allocateMemory(memRequirements, dedicatedRequirements, image, VK_NULL_HANDLE,
+                 memoryUsage, imageMemory, memoryType);
 }
 
 /*
- * Finds the index of the memory heap which matches a particular buffer's memory
- * requirements. Vulkan manages these requirements as a bitset, in this case
- * expressed through a uint32_t.
+ * Allocates memory for exactly one image or buffer. A dedicated allocation is
+ * used when the driver requires one, or when it prefers one and the resource
+ * is large enough for the hint to matter: some drivers can only compress or
+ * tile large images optimally when they own the whole allocation. Nothing is
+ * sub-allocated: every caller frees the VkDeviceMemory it gets back.
  */
-uint32_t HelloVK::findMemoryType(uint32_t typeFilter,
-                                 VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties memProperties;
-  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-    if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags &
-                                    properties) == properties) {
-      return i;
-    }
+void HelloVK::allocateMemory(
+    const VkMemoryRequirements2 &memRequirements,
+    const VkMemoryDedicatedRequirements &dedicated, VkImage image,
+    VkBuffer buffer, MemoryUsage memoryUsage, VkDeviceMemory &memory,
+    uint32_t *memoryType) {
+  const VkDeviceSize size = memRequirements.memoryRequirements.size;
+
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = findMemoryType(
+      memRequirements.memoryRequirements.memoryTypeBits, memoryUsage, size);
+
+  VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+  dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+  dedicatedInfo.image = image;
+  dedicatedInfo.buffer = buffer;
+  if (dedicated.requiresDedicatedAllocation ||
+      (dedicated.prefersDedicatedAllocation &&
+       size >= DEDICATED_ALLOCATION_MIN_SIZE)) {
+    allocInfo.pNext = &dedicatedInfo;
   }
 
-  assert(false);  // failed to find suitable memory type!
-  return -1;
+  VK_CHECK(vkAllocateMemory(device, &allocInfo, nullptr, &memory));
+  if (memoryType != nullptr) {
+    *memoryType = allocInfo.memoryTypeIndex;
+  }
+}
+
+/*
+ * Finds the index of the memory type which best matches a particular
+ * resource's memory requirements and intended usage. Vulkan manages these
+ * requirements as a bitset, in this case expressed through a uint32_t. The
+ * memory properties are queried once in pickPhysicalDevice and cached.
+ */
+uint32_t HelloVK::findMemoryType(uint32_t typeFilter, MemoryUsage usage,
+                                 VkDeviceSize size) {
+  uint32_t memoryType = memoryTypes.findMemoryType(typeFilter, usage, size);
+
+  assert(memoryType !=
+         MemoryTypeSelector::kInvalidMemoryType);  // failed to find suitable
+                                                   // memory type!
+  return memoryType;
 }
 
 void HelloVK::createUniformBuffers() {
@@ -381,12 +840,20 @@ void HelloVK::createUniformBuffers() {
 
   uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
   uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+  uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
+  // Uniform buffers are rewritten every frame, so keep them persistently
+  // mapped instead of mapping and unmapping them in updateUniformBuffer.
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
     createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 uniformBuffers[i], uniformBuffersMemory[i]);
+                 MemoryUsage::kDynamic, uniformBuffers[i],
+                 uniformBuffersMemory[i]);
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_BUFFER, uniformBuffers[i],
+            "uniform buffer %zu", i);
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DEVICE_MEMORY,
+            uniformBuffersMemory[i], "uniform buffer %zu", i);
+    VK_CHECK(vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0,
+                         &uniformBuffersMapped[i]));
   }
 }
 
@@ -416,11 +883,14 @@ void HelloVK::createDescriptorSetLayout() {
 
   VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
                                        &descriptorSetLayout));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT,
+          descriptorSetLayout, "quad descriptor set layout");
 }
 
-void HelloVK::reset(ANativeWindow *newWindow, AAssetManager *newManager) {
-  window.reset(newWindow);
-  assetManager = newManager;
+void HelloVK::reset(std::unique_ptr<SurfaceProvider> newSurfaceProvider,
+                    AssetSource *newAssets) {
+  surfaceProvider = std::move(newSurfaceProvider);
+  assets = newAssets;
   if (initialized) {
     createSurface();
     recreateSwapChain();
@@ -428,7 +898,9 @@ void HelloVK::reset(ANativeWindow *newWindow, AAssetManager *newManager) {
 }
 
 void HelloVK::recreateSwapChain() {
+  TRACE_SCOPE("recreateSwapChain");
   vkDeviceWaitIdle(device);
+  framesSinceRecreate = 0;
   cleanupSwapChain();
   createSwapChain();
   createImageViews();
@@ -439,12 +911,33 @@ void HelloVK::render() {
   if (!initialized) {
     return;
   }
+  TRACE_SCOPE("render");
   if (orientationChanged) {
     onOrientationChange();
   }
+  const AllocationScope frameAllocations;
+
+  // Each call returns the milliseconds since the previous one, and traces
+  // them as a zone named after the stage.
+  uint64_t stageStartNs = traceNowNs();
+  auto stageMs = [&stageStartNs](const char *stage) {
+    const uint64_t nowNs = traceNowNs();
+    if (tracingActive()) {
+      traceZone(stage, stageStartNs, nowNs - stageStartNs);
+    }
+    const double ms = (nowNs - stageStartNs) / 1e6;
+    stageStartNs = nowNs;
+    return ms;
+  };
 
   vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE,
                   UINT64_MAX);
+  // Whatever the frame's previous use left in its arena is done with now.
+  frameArenas[currentFrame].reset();
+  if (gpuZonePending[currentFrame]) {
+    traceGpuZones(currentFrame);
+  }
+  timings.waitMs = stageMs("wait");
   uint32_t imageIndex;
   VkResult result = vkAcquireNextImageKHR(
       device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame],
@@ -455,12 +948,16 @@ void HelloVK::render() {
   }
   assert(result == VK_SUCCESS ||
          result == VK_SUBOPTIMAL_KHR);  // failed to acquire swap chain image
+  timings.acquireMs = stageMs("acquire");
   updateUniformBuffer(currentFrame);
+  timings.updateMs = stageMs("update");
 
   vkResetFences(device, 1, &inFlightFences[currentFrame]);
   vkResetCommandBuffer(commandBuffers[currentFrame], 0);
 
+  const bool textureWasResident = textureResident;
   recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+  timings.recordMs = stageMs("record");
 
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -479,6 +976,7 @@ void HelloVK::render() {
 
   VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo,
                          inFlightFences[currentFrame]));
+  timings.submitMs = stageMs("submit");
 
   VkPresentInfoKHR presentInfo{};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -493,6 +991,10 @@ void HelloVK::render() {
   presentInfo.pResults = nullptr;
 
   result = vkQueuePresentKHR(presentQueue, &presentInfo);
+  timings.presentMs = stageMs("present");
+  if (startupProfiler.active()) {
+    startupProfiler.markFirstPresent();
+  }
   if (result == VK_SUBOPTIMAL_KHR) {
     orientationChanged = true;
   } else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -501,6 +1003,27 @@ void HelloVK::render() {
     assert(result == VK_SUCCESS);  // failed to present swap chain image!
   }
   currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+  if (textureResident != textureWasResident) {
+    // Startup is complete with the first frame that draws the texture.
+    startupProfiler.finish();
+    framesSinceRecreate = 0;
+  } else if (startupProfiler.active() && textureLoad.done() &&
+             !textureDecoded) {
+    // No frame will ever draw it; report the launch rather than drop it.
+    startupProfiler.finish(true);
+  }
+
+  // Containers the frame reuses reach their size in the first frames after
+  // a (re)creation. From then on a frame must not touch the heap.
+  if (framesSinceRecreate <= MAX_FRAMES_IN_FLIGHT) {
+    framesSinceRecreate++;
+  } else if (frameAllocations.counts().allocations != 0) {
+    LOGE("render() made %llu heap allocations in a steady-state frame",
+         static_cast<unsigned long long>(
+             frameAllocations.counts().allocations));
+    assert(false);  // see alloc_counter.h for finding them
+  }
 }
 
 /*
@@ -515,19 +1038,17 @@ void getPrerotationMatrix(const VkSurfaceCapabilitiesKHR &capabilities,
 
   // scale by screen ratio
   mat = glm::scale(mat, glm::vec3(1.0f, ratio, 1.0f));
-
-  // rotate 1 degree every function call.
-  static float currentAngleDegrees = 0.0f;
-  currentAngleDegrees += 1.0f;
-  mat = glm::rotate(mat, glm::radians(currentAngleDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
 }
 
 void HelloVK::createDescriptorPool() {
   VkDescriptorPoolSize poolSizes[2];
   poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+  // A quad and a sprite set per frame in flight.
+  poolSizes[0].descriptorCount =
+      static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2;
   poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+  poolSizes[1].descriptorCount =
+      static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2;
 
   VkDescriptorPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -536,28 +1057,50 @@ void HelloVK::createDescriptorPool() {
   poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2;
 
   VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DESCRIPTOR_POOL, descriptorPool,
+          "descriptor pool");
 }
 
+/*
+ * Allocates a quad set per frame in flight, then a sprite set per frame in
+ * flight. They share the layout and the uniform buffer and only differ in
+ * the image they sample.
+ */
 void HelloVK::createDescriptorSets() {
-  std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT,
+  std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT * 2,
                                              descriptorSetLayout);
   VkDescriptorSetAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   allocInfo.descriptorPool = descriptorPool;
-  allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+  allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
   allocInfo.pSetLayouts = layouts.data();
 
-  descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-  VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()));
-
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  std::vector<VkDescriptorSet> sets(layouts.size());
+  VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, sets.data()));
+  descriptorSets.assign(sets.begin(), sets.begin() + MAX_FRAMES_IN_FLIGHT);
+  spriteDescriptorSets.assign(sets.begin() + MAX_FRAMES_IN_FLIGHT,
+                              sets.end());
+
+  for (size_t i = 0; i < sets.size(); i++) {
+    const size_t frame = i % MAX_FRAMES_IN_FLIGHT;
+    const bool sprites = i >= MAX_FRAMES_IN_FLIGHT;
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DESCRIPTOR_SET, sets[i],
+            "%s descriptor set %zu", sprites ? "sprite" : "quad", frame);
+    if (sprites && spriteAtlasView == VK_NULL_HANDLE) {
+      continue;  // no atlas, and so no sprites to draw
+    }
     VkDescriptorBufferInfo bufferInfo{};
-    bufferInfo.buffer = uniformBuffers[i];
+    bufferInfo.buffer = uniformBuffers[frame];
     bufferInfo.offset = 0;
     bufferInfo.range = sizeof(UniformBufferObject);
 
     VkDescriptorImageInfo imageInfo{};
-    imageInfo.imageView = textureImageView;
+    if (sprites) {
+      imageInfo.imageView = spriteAtlasView;
+    } else {
+      descriptorBaseMip[frame] = textureResidency.residentMip(textureId);
+      imageInfo.imageView = textureMipViews[descriptorBaseMip[frame]];
+    }
     imageInfo.sampler = textureSampler;
     imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
@@ -565,7 +1108,7 @@ void HelloVK::createDescriptorSets() {
 
     // Uniform buffer
     descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = descriptorSets[i];
+    descriptorWrites[0].dstSet = sets[i];
     descriptorWrites[0].dstBinding = 0;
     descriptorWrites[0].dstArrayElement = 0;
     descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -574,7 +1117,7 @@ void HelloVK::createDescriptorSets() {
 
     // Combined image sampler
     descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = descriptorSets[i];
+    descriptorWrites[1].dstSet = sets[i];
     descriptorWrites[1].dstBinding = 1;
     descriptorWrites[1].dstArrayElement = 0;
     descriptorWrites[1].descriptorType =
@@ -595,13 +1138,31 @@ void HelloVK::updateUniformBuffer(uint32_t currentImage) {
 
   UniformBufferObject ubo{};
   float ratio = (float)swapChainExtent.width / (float)swapChainExtent.height; 
+  glm::mat4 viewProjection;
   getPrerotationMatrix(capabilities, pretransformFlag,
-                       ubo.mvp, ratio);
-  void *data;
-  vkMapMemory(device, uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0,
-              &data);
-  memcpy(data, glm::value_ptr(ubo.mvp), sizeof(glm::mat4));
-  vkUnmapMemory(device, uniformBuffersMemory[currentImage]);
+                       viewProjection, ratio);
+
+  // rotate the quad 1 degree every frame.
+  quadAngleDegrees += 1.0f;
+  scene.setRotation(quadNode,
+                    glm::angleAxis(glm::radians(quadAngleDegrees),
+                                   glm::vec3(0.0f, 0.0f, 1.0f)));
+  scene.update(&jobs);
+  const glm::mat4 &world = scene.world(quadNode);
+  ubo.mvp = viewProjection * world;
+
+  // The triangle's corners lie on a circle of radius 0.577 around its origin.
+  const float worldScale =
+      std::max({glm::length(glm::vec3(world[0])),
+                glm::length(glm::vec3(world[1])),
+                glm::length(glm::vec3(world[2]))});
+  sceneBounds.resize(scene.size());
+  sceneBounds.set(quadNode, glm::vec3(world[3]), 0.577f * worldScale);
+  cullSpheres(extractFrustum(viewProjection), sceneBounds, visibleNodes,
+              &jobs);
+  TRACE_COUNTER("visible nodes", visibleNodes.size());
+  memcpy(uniformBuffersMapped[currentImage], glm::value_ptr(ubo.mvp),
+         sizeof(glm::mat4));
 }
 
 void HelloVK::onOrientationChange() {
@@ -618,6 +1179,28 @@ void HelloVK::recordCommandBuffer(VkCommandBuffer commandBuffer,
 
   VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
+  // Times the render pass for the GPU track of a running trace capture.
+  const bool gpuZone = timestampQueries != VK_NULL_HANDLE && tracingActive();
+  const uint32_t firstQuery = currentFrame * 2;
+  if (gpuZone) {
+    vkCmdResetQueryPool(commandBuffer, timestampQueries, firstQuery, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        timestampQueries, firstQuery);
+  }
+  gpuZonePending[currentFrame] = gpuZone;
+
+  // The texture is loaded on a job started by initVulkan. The first frame
+  // after it is done copies it into place ahead of the render pass; the
+  // frames before only clear. Later frames stream in finer mips.
+  if (textureResident) {
+    updateTextureResidency(commandBuffer);
+  } else if (textureLoad.done() && textureDecoded) {
+    recordTextureUpload(commandBuffer);
+    recordSpriteAtlasUpload(commandBuffer);
+    createDescriptorSets();
+    textureResident = true;
+  }
+
   VkRenderPassBeginInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassInfo.renderPass = renderPass;
@@ -640,19 +1223,160 @@ void HelloVK::recordCommandBuffer(VkCommandBuffer commandBuffer,
 
   renderPassInfo.clearValueCount = 1;
   renderPassInfo.pClearValues = &clearColor;
+  VK_LABEL_BEGIN(debugAnnotations, commandBuffer, "main pass");
   vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
                        VK_SUBPASS_CONTENTS_INLINE);
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    graphicsPipeline);
-  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          pipelineLayout, 0, 1, &descriptorSets[currentFrame],
-                          0, nullptr);
-
-  vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+  if (textureResident) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      graphicsPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelineLayout, 0, 1,
+                            &descriptorSets[currentFrame], 0, nullptr);
+
+    VK_LABEL_BEGIN(debugAnnotations, commandBuffer, "quad draws");
+    for (const DrawCommand &draw : buildDrawList()) {
+      vkCmdDraw(commandBuffer, draw.vertexCount, draw.instanceCount,
+                draw.firstVertex, draw.firstInstance);
+    }
+    VK_LABEL_END(debugAnnotations, commandBuffer);
+    if (spriteCount > 0 && spriteAtlasView != VK_NULL_HANDLE) {
+      recordSprites(commandBuffer);
+    }
+  }
   vkCmdEndRenderPass(commandBuffer);
+  VK_LABEL_END(debugAnnotations, commandBuffer);
+  if (gpuZone) {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        timestampQueries, firstQuery + 1);
+  }
+  if (captureRequested) {
+    recordReadback(commandBuffer, imageIndex);
+  }
   VK_CHECK(vkEndCommandBuffer(commandBuffer));
 }
 
+/*
+ * The draws for the visible nodes of the frame being recorded, in the
+ * frame's arena.
+ */
+ArenaVector<DrawCommand> HelloVK::buildDrawList() {
+  ArenaVector<DrawCommand> draws{
+      ArenaAllocator<DrawCommand>(frameArenas[currentFrame])};
+  if (std::binary_search(visibleNodes.begin(), visibleNodes.end(),
+                         quadNode)) {
+    draws.reserve(drawCount);
+    for (uint32_t i = 0; i < drawCount; i++) {
+      draws.push_back({3, instanceCount, 0, 0});
+    }
+  }
+  return draws;
+}
+
+/*
+ * Copies the swapchain image out after the render pass, which leaves it in
+ * the present layout, and puts it back for presenting.
+ */
+void HelloVK::recordReadback(VkCommandBuffer commandBuffer,
+                             uint32_t imageIndex) {
+  VK_LABEL_SCOPE(debugAnnotations, commandBuffer, "readback");
+  VkImageMemoryBarrier imageBarrier{};
+  imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  imageBarrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarrier.image = swapChainImages[imageIndex];
+  imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &imageBarrier);
+
+  VkBufferImageCopy region{};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {swapChainExtent.width, swapChainExtent.height, 1};
+  vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex],
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer,
+                         1, &region);
+
+  imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  imageBarrier.dstAccessMask = 0;
+  imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  imageBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  VkBufferMemoryBarrier bufferBarrier{};
+  bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.buffer = readbackBuffer;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT |
+                           VK_PIPELINE_STAGE_HOST_BIT,
+                       0, 0, nullptr, 1, &bufferBarrier, 1, &imageBarrier);
+  captureRecorded = true;
+}
+
+bool HelloVK::captureFrame(std::vector<uint8_t> &rgba, uint32_t &width,
+                           uint32_t &height) {
+  const bool bgra = swapChainImageFormat == VK_FORMAT_B8G8R8A8_UNORM ||
+                    swapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB;
+  const bool rgba8 = swapChainImageFormat == VK_FORMAT_R8G8B8A8_UNORM ||
+                     swapChainImageFormat == VK_FORMAT_R8G8B8A8_SRGB ||
+                     swapChainImageFormat == VK_FORMAT_A8B8G8R8_SRGB_PACK32;
+  if (!initialized || !swapChainReadable || !(bgra || rgba8)) {
+    LOGE("Cannot read back swapchain format %d", swapChainImageFormat);
+    return false;
+  }
+  const VkDeviceSize size =
+      VkDeviceSize(swapChainExtent.width) * swapChainExtent.height * 4;
+  if (readbackBuffer == VK_NULL_HANDLE) {
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 MemoryUsage::kReadback, readbackBuffer, readbackMemory,
+                 &readbackType);
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_BUFFER, readbackBuffer,
+            "readback buffer");
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DEVICE_MEMORY, readbackMemory,
+            "readback buffer");
+  }
+
+  // Captures show the whole scene, so do not race the texture load.
+  waitForTextureLoad();
+  captureRequested = true;
+  captureRecorded = false;
+  render();
+  captureRequested = false;
+  // Recreating the swapchain, e.g. when presenting finds it out of date,
+  // also frees the readback buffer.
+  if (!captureRecorded || readbackBuffer == VK_NULL_HANDLE) {
+    return false;
+  }
+  VK_CHECK(vkQueueWaitIdle(graphicsQueue));
+
+  uint8_t *data;
+  VK_CHECK(vkMapMemory(device, readbackMemory, 0, size, 0, (void **)&data));
+  if (!memoryTypes.isHostCoherent(readbackType)) {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = readbackMemory;
+    range.size = VK_WHOLE_SIZE;
+    VK_CHECK(vkInvalidateMappedMemoryRanges(device, 1, &range));
+  }
+  width = swapChainExtent.width;
+  height = swapChainExtent.height;
+  rgba.assign(data, data + size);
+  vkUnmapMemory(device, readbackMemory);
+  if (bgra) {
+    for (size_t i = 0; i < rgba.size(); i += 4) {
+      std::swap(rgba[i], rgba[i + 2]);
+    }
+  }
+  return true;
+}
+
 void HelloVK::cleanupSwapChain() {
   for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
     vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
@@ -663,9 +1387,17 @@ void HelloVK::cleanupSwapChain() {
   }
 
   vkDestroySwapchainKHR(device, swapChain, nullptr);
+
+  // Sized for the swapchain, so it goes with it.
+  if (readbackBuffer != VK_NULL_HANDLE) {
+    vkDestroyBuffer(device, readbackBuffer, nullptr);
+    vkFreeMemory(device, readbackMemory, nullptr);
+    readbackBuffer = VK_NULL_HANDLE;
+  }
 }
 
 void HelloVK::cleanup() {
+  jobs.wait(textureLoad);
   vkDeviceWaitIdle(device);
   cleanupSwapChain();
   vkDestroyDescriptorPool(device, descriptorPool, nullptr);
@@ -673,7 +1405,10 @@ void HelloVK::cleanup() {
   vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
   vkDestroySampler(device, textureSampler, nullptr);
-  vkDestroyImageView(device, textureImageView, nullptr);
+  for (VkImageView view : textureMipViews) {
+    vkDestroyImageView(device, view, nullptr);
+  }
+  textureMipViews.clear();
   vkDestroyImage(device, textureImage, nullptr);
 
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -684,13 +1419,32 @@ void HelloVK::cleanup() {
   vkFreeMemory(device, stagingMemory, nullptr);
   vkFreeMemory(device, textureImageMemory, nullptr);
 
+  vkDestroyImageView(device, spriteAtlasView, nullptr);
+  vkDestroyImage(device, spriteAtlasImage, nullptr);
+  vkFreeMemory(device, spriteAtlasMemory, nullptr);
+  vkDestroyBuffer(device, spriteAtlasStaging, nullptr);
+  vkFreeMemory(device, spriteAtlasStagingMemory, nullptr);
+  spriteAtlasView = VK_NULL_HANDLE;
+  spriteAtlasImage = VK_NULL_HANDLE;
+  spriteAtlasMemory = VK_NULL_HANDLE;
+  spriteAtlasStaging = VK_NULL_HANDLE;
+  spriteAtlasStagingMemory = VK_NULL_HANDLE;
+  destroySpriteBuffers();
+  spriteCapacity = 0;
+  spriteCount = 0;
+
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
     vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
     vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
     vkDestroyFence(device, inFlightFences[i], nullptr);
   }
+  if (timestampQueries != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(device, timestampQueries, nullptr);
+    timestampQueries = VK_NULL_HANDLE;
+  }
   vkDestroyCommandPool(device, commandPool, nullptr);
   vkDestroyPipeline(device, graphicsPipeline, nullptr);
+  vkDestroyPipeline(device, spritePipeline, nullptr);
   vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
   vkDestroyRenderPass(device, renderPass, nullptr);
   vkDestroyDevice(device, nullptr);
@@ -699,6 +1453,9 @@ void HelloVK::cleanup() {
   }
   vkDestroySurfaceKHR(instance, surface, nullptr);
   vkDestroyInstance(instance, nullptr);
+  // After the instance, which reports through the messenger until it goes.
+  debugMessages.stop();
+  textureResident = false;
   initialized = false;
 }
 
@@ -708,7 +1465,7 @@ void HelloVK::setupDebugMessenger() {
   }
 
   VkDebugUtilsMessengerCreateInfoEXT createInfo{};
-  populateDebugMessengerCreateInfo(createInfo);
+  populateDebugMessengerCreateInfo(createInfo, &debugMessages);
 
   VK_CHECK(CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr,
                                         &debugMessenger));
@@ -737,22 +1494,91 @@ bool HelloVK::checkValidationLayerSupport() {
   return true;
 }
 
-std::vector<const char *> HelloVK::getRequiredExtensions(
-    bool enableValidationLayers) {
-  std::vector<const char *> extensions;
-  extensions.push_back("VK_KHR_surface");
-  extensions.push_back("VK_KHR_android_surface");
-  if (enableValidationLayers) {
+bool HelloVK::checkInstanceExtensionSupport(const char *extensionName,
+                                            const char *layerName) {
+  uint32_t extensionCount = 0;
+  vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> extensions(extensionCount);
+  vkEnumerateInstanceExtensionProperties(layerName, &extensionCount,
+                                         extensions.data());
+  for (const auto &extension : extensions) {
+    if (strcmp(extension.extensionName, extensionName) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+FixedVector<const char *, 4> HelloVK::getRequiredExtensions(
+    bool enableDebugUtils, bool enableValidationFeatures) {
+  FixedVector<const char *, 4> extensions;
+  extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+  extensions.push_back(surfaceProvider->instanceExtension());
+  if (enableDebugUtils) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
   }
+  if (enableValidationFeatures) {
+    extensions.push_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+  }
   return extensions;
 }
 
 void HelloVK::createInstance() {
-  assert(!enableValidationLayers ||
-         checkValidationLayerSupport());  // validation layers requested, but
-                                          // not available!
-  auto requiredExtensions = getRequiredExtensions(enableValidationLayers);
+  validationMode = parseValidationMode(readSetting("validation"));
+  debugMessageFilter.minSeverity =
+      parseMessageSeverity(readSetting("messages"));
+  enableValidationLayers = validationMode != ValidationMode::kOff;
+  if (enableValidationLayers && !checkValidationLayerSupport()) {
+    LOGE("Validation requested, but %s is not packaged, see README.md",
+         validationLayers[0]);
+    validationMode = ValidationMode::kOff;
+    enableValidationLayers = false;
+  }
+  // The modes past standard are features of the layer itself.
+  VkValidationFeatureEnableEXT validationFeatures[2];
+  uint32_t validationFeatureCount = 0;
+  switch (validationMode) {
+    case ValidationMode::kOff:
+    case ValidationMode::kStandard:
+      break;
+    case ValidationMode::kBestPractices:
+      validationFeatures[validationFeatureCount++] =
+          VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT;
+      break;
+    case ValidationMode::kSynchronization:
+      validationFeatures[validationFeatureCount++] =
+          VK_VALIDATION_FEATURE_ENABLE_SYNCHRONIZATION_VALIDATION_EXT;
+      break;
+    case ValidationMode::kGpuAssisted:
+      validationFeatures[validationFeatureCount++] =
+          VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_EXT;
+      validationFeatures[validationFeatureCount++] =
+          VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_RESERVE_BINDING_SLOT_EXT;
+      break;
+  }
+  if (validationFeatureCount > 0 &&
+      !checkInstanceExtensionSupport(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME,
+                                     validationLayers[0])) {
+    LOGE("The validation layer is too old for VK_EXT_validation_features, "
+         "using standard validation");
+    validationMode = ValidationMode::kStandard;
+    validationFeatureCount = 0;
+  }
+  LOGI("Validation: %s, messages from %s up",
+       validationModeName(validationMode),
+       messageSeverityName(debugMessageFilter.minSeverity));
+
+  // The validation layer provides VK_EXT_debug_utils. Debug annotations
+  // only need the extension, which recent loaders implement themselves.
+  debugUtilsEnabled = enableValidationLayers;
+#if defined(HELLOVK_DEBUG_ANNOTATIONS)
+  if (!debugUtilsEnabled) {
+    debugUtilsEnabled =
+        checkInstanceExtensionSupport(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+  }
+#endif
+  auto requiredExtensions =
+      getRequiredExtensions(debugUtilsEnabled, validationFeatureCount > 0);
 
   VkApplicationInfo appInfo{};
   appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -770,19 +1596,37 @@ void HelloVK::createInstance() {
   createInfo.ppEnabledExtensionNames = requiredExtensions.data();
   createInfo.pApplicationInfo = &appInfo;
 
+  // Must outlive vkCreateInstance, which reports through it.
+  VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+  VkValidationFeaturesEXT validationFeaturesInfo{};
   if (enableValidationLayers) {
-    VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+    debugMessages.start(debugMessageFilter);
     createInfo.enabledLayerCount =
         static_cast<uint32_t>(validationLayers.size());
     createInfo.ppEnabledLayerNames = validationLayers.data();
-    populateDebugMessengerCreateInfo(debugCreateInfo);
+    populateDebugMessengerCreateInfo(debugCreateInfo, &debugMessages);
     createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
+    if (validationFeatureCount > 0) {
+      validationFeaturesInfo.sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT;
+      validationFeaturesInfo.pNext = &debugCreateInfo;
+      validationFeaturesInfo.enabledValidationFeatureCount =
+          validationFeatureCount;
+      validationFeaturesInfo.pEnabledValidationFeatures = validationFeatures;
+      createInfo.pNext = &validationFeaturesInfo;
+    }
   } else {
     createInfo.enabledLayerCount = 0;
     createInfo.pNext = nullptr;
   }
   VK_CHECK(vkCreateInstance(&createInfo, nullptr, &instance));
+  // Asks the loader and every ICD again, so it is only worth it when
+  // debugging.
+  if (enableValidationLayers) {
+    logInstanceExtensions();
+  }
+}
 
+void HelloVK::logInstanceExtensions() {
   uint32_t extensionCount = 0;
   vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
   std::vector<VkExtensionProperties> extensions(extensionCount);
@@ -795,23 +1639,15 @@ void HelloVK::createInstance() {
 }
 
 /*
- * createSurface can only be called after the android ecosystem has had the
- * chance to provide a native window. This happens after the APP_CMD_START event
- * has had a chance to be called.
- *
- * Notice the window.get() call which is only valid after window has been set to
- * a non null value
+ * createSurface can only be called after the platform has provided a surface
+ * provider through reset(). On Android this happens after the APP_CMD_START
+ * event has had a chance to be called, since the native window only exists
+ * from then on.
  */
 void HelloVK::createSurface() {
-  assert(window != nullptr);  // window not initialized
-  const VkAndroidSurfaceCreateInfoKHR create_info{
-      .sType = VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR,
-      .pNext = nullptr,
-      .flags = 0,
-      .window = window.get()};
-
-  VK_CHECK(vkCreateAndroidSurfaceKHR(instance, &create_info,
-                                     nullptr /* pAllocator */, &surface));
+  assert(surfaceProvider != nullptr);  // window not initialized
+  VK_CHECK(surfaceProvider->createSurface(instance, &surface));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_SURFACE_KHR, surface, "surface");
 }
 
 // BEGIN DEVICE SUITABILITY
@@ -820,12 +1656,20 @@ void HelloVK::createSurface() {
 QueueFamilyIndices HelloVK::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
+  // Called on every swapchain recreation. Devices expose a few families.
+  // This query has no VK_INCOMPLETE, so the count is checked first.
+  FixedVector<VkQueueFamilyProperties, 16> queueFamilies;
   uint32_t queueFamilyCount = 0;
-  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+                                           nullptr);
+  if (queueFamilyCount > queueFamilies.capacity()) {
+    LOGE("More than %u queue families, only the first are considered",
+         queueFamilies.capacity());
+    queueFamilyCount = queueFamilies.capacity();
+  }
   vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
                                            queueFamilies.data());
+  queueFamilies.resize(queueFamilyCount);
 
   int i = 0;
   for (const auto &queueFamily : queueFamilies) {
@@ -871,31 +1715,34 @@ SwapChainSupportDetails HelloVK::querySwapChainSupport(
     VkPhysicalDevice device) {
   SwapChainSupportDetails details;
 
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface,
-                                            &details.capabilities);
-
-  uint32_t formatCount;
-  vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
-
-  if (formatCount != 0) {
-    details.formats.resize(formatCount);
-    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount,
-                                         details.formats.data());
-  }
-
-  uint32_t presentModeCount;
-  vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount,
-                                            nullptr);
-
-  if (presentModeCount != 0) {
-    details.presentModes.resize(presentModeCount);
-    vkGetPhysicalDeviceSurfacePresentModesKHR(
-        device, surface, &presentModeCount, details.presentModes.data());
-  }
+  VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface,
+                                                     &details.capabilities));
+
+  // Fills in at most capacity() entries, VK_INCOMPLETE if there are more.
+  uint32_t formatCount = details.formats.capacity();
+  checkFixedQuery(vkGetPhysicalDeviceSurfaceFormatsKHR(
+                      device, surface, &formatCount, details.formats.data()),
+                  "surface formats", details.formats.capacity());
+  details.formats.resize(formatCount);
+
+  uint32_t presentModeCount = details.presentModes.capacity();
+  checkFixedQuery(
+      vkGetPhysicalDeviceSurfacePresentModesKHR(
+          device, surface, &presentModeCount, details.presentModes.data()),
+      "present modes", details.presentModes.capacity());
+  details.presentModes.resize(presentModeCount);
   return details;
 }
 
 bool HelloVK::isDeviceSuitable(VkPhysicalDevice device) {
+  // vkGet*MemoryRequirements2 and VkMemoryDedicatedRequirements are core in
+  // Vulkan 1.1, which the instance asks for.
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_1) {
+    return false;
+  }
+
   QueueFamilyIndices indices = findQueueFamilies(device);
   bool extensionsSupported = checkDeviceExtensionSupport(device);
   bool swapChainAdequate = false;
@@ -924,6 +1771,26 @@ void HelloVK::pickPhysicalDevice() {
   }
 
   assert(physicalDevice != VK_NULL_HANDLE);  // failed to find a suitable GPU!
+
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount,
+                                       nullptr);
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount,
+                                       availableExtensions.data());
+  bool memoryBudgetSupported = false;
+  for (const auto &extension : availableExtensions) {
+    if (strcmp(extension.extensionName,
+               VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+      memoryBudgetSupported = true;
+      break;
+    }
+  }
+
+  memoryTypes.init(physicalDevice, memoryBudgetSupported);
+  LOGI("Unified memory: %s, memory budget: %s",
+       memoryTypes.isUnifiedMemory() ? "yes" : "no",
+       memoryBudgetSupported ? "yes" : "no");
 }
 // END DEVICE SUITABILITY
 
@@ -965,6 +1832,22 @@ void HelloVK::createLogicalDeviceAndQueue() {
 
   vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
   vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+
+#if defined(HELLOVK_DEBUG_ANNOTATIONS)
+  if (debugUtilsEnabled) {
+    debugAnnotations.init(instance, device);
+  }
+#endif
+  // Names need a device, so what was created before it is named here.
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_INSTANCE, instance, "instance");
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_SURFACE_KHR, surface, "surface");
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DEVICE, device, "device");
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_QUEUE, graphicsQueue,
+          "graphics queue");
+  if (presentQueue != graphicsQueue) {
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_QUEUE, presentQueue,
+            "present queue");
+  }
 }
 
 VkExtent2D HelloVK::chooseSwapExtent(
@@ -973,10 +1856,7 @@ VkExtent2D HelloVK::chooseSwapExtent(
       std::numeric_limits<uint32_t>::max()) {
     return capabilities.currentExtent;
   } else {
-    int32_t width = ANativeWindow_getWidth(window.get());
-    int32_t height = ANativeWindow_getHeight(window.get());
-    VkExtent2D actualExtent = {static_cast<uint32_t>(width),
-                               static_cast<uint32_t>(height)};
+    VkExtent2D actualExtent = surfaceProvider->windowExtent();
 
     actualExtent.width =
         std::clamp(actualExtent.width, capabilities.minImageExtent.width,
@@ -993,6 +1873,8 @@ void HelloVK::establishDisplaySizeIdentity() {
   vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface,
                                             &capabilities);
 
+  // Surfaces without a fixed size, such as headless ones, take the window's.
+  capabilities.currentExtent = chooseSwapExtent(capabilities);
   uint32_t width = capabilities.currentExtent.width;
   uint32_t height = capabilities.currentExtent.height;
   if (capabilities.currentTransform & VK_SURFACE_TRANSFORM_ROTATE_90_BIT_KHR ||
@@ -1009,10 +1891,21 @@ void HelloVK::createSwapChain() {
   SwapChainSupportDetails swapChainSupport =
       querySwapChainSupport(physicalDevice);
 
+  // Shaders output linear colour. An _SRGB swapchain encodes it (and blends
+  // in linear space) in fixed-function hardware, so prefer one. Otherwise
+  // fall back to an 8-bit UNORM format and encode in the fragment shader,
+  // see createGraphicsPipeline.
   auto chooseSwapSurfaceFormat =
-      [](const std::vector<VkSurfaceFormatKHR> &availableFormats) {
+      [](const decltype(swapChainSupport.formats) &availableFormats) {
         for (const auto &availableFormat : availableFormats) {
-          if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB &&
+          if (isSrgbFormat(availableFormat.format) &&
+              availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            return availableFormat;
+          }
+        }
+        for (const auto &availableFormat : availableFormats) {
+          if ((availableFormat.format == VK_FORMAT_R8G8B8A8_UNORM ||
+               availableFormat.format == VK_FORMAT_B8G8R8A8_UNORM) &&
               availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
             return availableFormat;
           }
@@ -1047,6 +1940,12 @@ void HelloVK::createSwapChain() {
   createInfo.imageExtent = displaySizeIdentity;
   createInfo.imageArrayLayers = 1;
   createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  // Lets captureFrame copy the image out, where the surface allows it.
+  swapChainReadable = swapChainSupport.capabilities.supportedUsageFlags &
+                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  if (swapChainReadable) {
+    createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
   createInfo.preTransform = pretransformFlag;
 
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
@@ -1073,6 +1972,12 @@ void HelloVK::createSwapChain() {
   swapChainImages.resize(imageCount);
   vkGetSwapchainImagesKHR(device, swapChain, &imageCount,
                           swapChainImages.data());
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_SWAPCHAIN_KHR, swapChain,
+          "swapchain");
+  for (uint32_t i = 0; i < imageCount; i++) {
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_IMAGE, swapChainImages[i],
+            "swapchain image %u", i);
+  }
 
   swapChainImageFormat = surfaceFormat.format;
   swapChainExtent = displaySizeIdentity;
@@ -1097,6 +2002,8 @@ void HelloVK::createImageViews() {
     createInfo.subresourceRange.layerCount = 1;
     VK_CHECK(vkCreateImageView(device, &createInfo, nullptr,
                                &swapChainImageViews[i]));
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_IMAGE_VIEW,
+            swapChainImageViews[i], "swapchain image view %zu", i);
   }
 }
 
@@ -1107,9 +2014,9 @@ void HelloVK::createTextureImage() {
   imageInfo.extent.width = textureWidth;
   imageInfo.extent.height = textureHeight;
   imageInfo.extent.depth = 1;
-  imageInfo.mipLevels = 1;
+  imageInfo.mipLevels = textureMipLevels;
   imageInfo.arrayLayers = 1;
-  imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+  imageInfo.format = textureFormat;
   imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
   imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   imageInfo.usage =
@@ -1119,157 +2026,804 @@ void HelloVK::createTextureImage() {
 
   VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &textureImage));
 
-  VkMemoryRequirements memRequirements;
-  vkGetImageMemoryRequirements(device, textureImage, &memRequirements);
+  allocateImageMemory(textureImage, MemoryUsage::kGpuOnly, textureImageMemory);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_IMAGE, textureImage, "texture");
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DEVICE_MEMORY, textureImageMemory,
+          "texture");
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
-                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-  VK_CHECK(vkAllocateMemory(device, &allocInfo, nullptr, &textureImageMemory));
-
-  vkBindImageMemory(device, textureImage, textureImageMemory, 0);
+  VK_CHECK(vkBindImageMemory(device, textureImage, textureImageMemory, 0));
 }
 
+/*
+ * Loads the texture into the staging buffer. A texture cooked offline by
+ * tools/asset_cooker (texture.vkt) is preferred as it needs no decoding and
+ * carries a full mip chain; texture.png is the fallback. Either was opened
+ * ahead of time by initVulkan.
+ */
 void HelloVK::decodeImage() {
-  std::vector<uint8_t> imageData = LoadBinaryFileToVector("texture.png",
-                                                          assetManager);
-  if (imageData.size() == 0) {
+  stagingBuffer = VK_NULL_HANDLE;
+  stagingMemory = VK_NULL_HANDLE;
+  textureImage = VK_NULL_HANDLE;
+  textureImageMemory = VK_NULL_HANDLE;
+  textureSampler = VK_NULL_HANDLE;
+  textureLinear = false;
+  textureDecoded = false;
+  std::unique_ptr<Asset> file = std::move(textureAsset);
+  if (textureAssetCooked) {
+    if (loadCookedTexture(*file, "texture.vkt")) {
+      textureDecoded = true;
+      return;
+    }
+    file = assets->open("texture.png");
+  }
+
+  // The PNG is decoded straight from the asset's memory mapping instead of
+  // being read into a vector first.
+  if (file == nullptr) {
       LOGE("Fail to load image.");
       return;
   }
+  const stbi_uc *fileData = file->data();
+  const int fileSize = static_cast<int>(file->size());
+
+  // Only the header is parsed here, to size the staging buffer up front.
+  if (!stbi_info_from_memory(fileData, fileSize, &textureWidth, &textureHeight,
+                             &textureChannels)) {
+      LOGE("Fail to load image to memory, %s", stbi_failure_reason());
+      return;
+  }
 
   // Make sure we have an alpha channel, not all hardware can do linear filtering of RGB888.
   const int requiredChannels = 4;
-  unsigned char* decodedData = stbi_load_from_memory(imageData.data(),
-      imageData.size(), &textureWidth, &textureHeight, &textureChannels, requiredChannels);
+  textureChannels = requiredChannels;
+  size_t imageSize = textureWidth * textureHeight * textureChannels;
+  textureMipLevels = 1;
+  // texture.png holds colour, i.e. sRGB encoded, data.
+  textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+  if (memoryTypes.isUnifiedMemory() &&
+      decodeImageDirect(fileData, fileSize)) {
+    textureDecoded = true;
+    return;
+  }
+
+  uint32_t stagingType;
+  createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               MemoryUsage::kHostDecode, stagingBuffer, stagingMemory,
+               &stagingType);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_BUFFER, stagingBuffer,
+          "texture staging buffer");
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DEVICE_MEMORY, stagingMemory,
+          "texture staging buffer");
+
+  uint8_t *data;
+  VK_CHECK(vkMapMemory(device, stagingMemory, 0, imageSize, 0,
+                       (void **)&data));
+
+  // PNG unfiltering reads back the previous output row, which is only cheap
+  // when the staging memory is cached. Otherwise decode to the heap and do a
+  // single sequential copy, which suits write-combined memory.
+  const bool inPlace = memoryTypes.isHostCached(stagingType);
+  int width, height, channels;
+  stbi_uc *decodedData = loadImageFromMemory(
+      fileData, fileSize, requiredChannels, inPlace ? data : nullptr,
+      imageSize, &width, &height, &channels);
+  file.reset();
+  decodedData = checkDecodedSize(decodedData, data, width, height);
+
   if (decodedData == nullptr) {
-      LOGE("Fail to load image to memory, %s", stbi_failure_reason());
-      return;
+    vkUnmapMemory(device, stagingMemory);
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingMemory, nullptr);
+    stagingBuffer = VK_NULL_HANDLE;
+    stagingMemory = VK_NULL_HANDLE;
+    return;
+  }
+  if (!inPlace) {
+    memcpy(data, decodedData, imageSize);
+    stbi_image_free(decodedData);
   }
 
-  if (textureChannels != requiredChannels) {
-    textureChannels = requiredChannels;
+  if (!memoryTypes.isHostCoherent(stagingType)) {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = stagingMemory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    VK_CHECK(vkFlushMappedMemoryRanges(device, 1, &range));
   }
+  vkUnmapMemory(device, stagingMemory);
 
-  size_t imageSize = textureWidth * textureHeight * textureChannels;
+  VkBufferImageCopy region{};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent.width = textureWidth;
+  region.imageExtent.height = textureHeight;
+  region.imageExtent.depth = 1;
+  region.bufferOffset = 0;
+  textureCopyRegions.assign(1, region);
+  textureDecoded = true;
+}
+
+/*
+ * Logs why a decode of the texture failed, and fails one whose size is not
+ * what the file's header promised: loadImageFromMemory then returns the
+ * pixels in a heap buffer of their own, which would not fill the target.
+ */
+stbi_uc *HelloVK::checkDecodedSize(stbi_uc *decodedData, uint8_t *target,
+                                   int width, int height) {
+  if (decodedData == nullptr) {
+    LOGE("Fail to load image to memory, %s", stbi_failure_reason());
+    return nullptr;
+  }
+  if (width != textureWidth || height != textureHeight) {
+    LOGE("Decoded a %dx%d image, expected %dx%d", width, height, textureWidth,
+         textureHeight);
+    if (decodedData != target) {
+      stbi_image_free(decodedData);
+    }
+    return nullptr;
+  }
+  return decodedData;
+}
 
-  VkBufferCreateInfo createInfo{};
-  createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  createInfo.size = imageSize;
-  createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-  createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  VK_CHECK(vkCreateBuffer(device, &createInfo, nullptr, &stagingBuffer));
+/*
+ * On unified memory the GPU can sample an image the CPU wrote in place, so
+ * the PNG is decoded straight into a linear image in host visible device
+ * memory, with no staging buffer and no copy. Linear images sample more
+ * slowly than optimally tiled ones and cannot have mips, which is fine for
+ * the one quad this draws. Returns false, having allocated nothing, where
+ * linear images of the texture's format and size cannot be sampled, the
+ * memory is not host visible or the image cannot be decoded.
+ */
+bool HelloVK::decodeImageDirect(const uint8_t *fileData, int fileSize) {
+  const VkFormatFeatureFlags features =
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, textureFormat,
+                                      &formatProperties);
+  VkImageFormatProperties imageProperties;
+  if ((formatProperties.linearTilingFeatures & features) != features ||
+      vkGetPhysicalDeviceImageFormatProperties(
+          physicalDevice, textureFormat, VK_IMAGE_TYPE_2D,
+          VK_IMAGE_TILING_LINEAR, VK_IMAGE_USAGE_SAMPLED_BIT, 0,
+          &imageProperties) != VK_SUCCESS ||
+      imageProperties.maxExtent.width < uint32_t(textureWidth) ||
+      imageProperties.maxExtent.height < uint32_t(textureHeight)) {
+    return false;
+  }
 
-  VkMemoryRequirements memRequirements;
-  vkGetBufferMemoryRequirements(device, stagingBuffer, &memRequirements);
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = textureWidth;
+  imageInfo.extent.height = textureHeight;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = textureFormat;
+  imageInfo.tiling = VK_IMAGE_TILING_LINEAR;
+  // Keeps what the CPU writes through the first layout transition.
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+  imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &textureImage));
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  uint32_t memoryType;
+  allocateImageMemory(textureImage, MemoryUsage::kGpuOnly, textureImageMemory,
+                      &memoryType);
+  if (!memoryTypes.isHostVisible(memoryType)) {
+    vkDestroyImage(device, textureImage, nullptr);
+    vkFreeMemory(device, textureImageMemory, nullptr);
+    textureImage = VK_NULL_HANDLE;
+    textureImageMemory = VK_NULL_HANDLE;
+    return false;
+  }
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_IMAGE, textureImage,
+          "texture (linear)");
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DEVICE_MEMORY, textureImageMemory,
+          "texture (linear)");
+  VK_CHECK(vkBindImageMemory(device, textureImage, textureImageMemory, 0));
+
+  VkImageSubresource subresource{};
+  subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  VkSubresourceLayout layout;
+  vkGetImageSubresourceLayout(device, textureImage, &subresource, &layout);
+  uint8_t *data;
+  VK_CHECK(vkMapMemory(device, textureImageMemory, layout.offset, layout.size,
+                       0, (void **)&data));
+
+  // Rows may be padded. Decoding in place needs them packed and the memory
+  // cached, as for the staging buffer.
+  const size_t rowSize = size_t(textureWidth) * textureChannels;
+  const size_t imageSize = rowSize * textureHeight;
+  const bool inPlace =
+      layout.rowPitch == rowSize && memoryTypes.isHostCached(memoryType);
+  int width, height, channels;
+  stbi_uc *decodedData = loadImageFromMemory(
+      fileData, fileSize, textureChannels, inPlace ? data : nullptr,
+      imageSize, &width, &height, &channels);
+  decodedData = checkDecodedSize(decodedData, data, width, height);
+  if (decodedData == nullptr) {
+    vkUnmapMemory(device, textureImageMemory);
+    vkDestroyImage(device, textureImage, nullptr);
+    vkFreeMemory(device, textureImageMemory, nullptr);
+    textureImage = VK_NULL_HANDLE;
+    textureImageMemory = VK_NULL_HANDLE;
+    return false;
+  }
+  if (!inPlace) {
+    for (int y = 0; y < textureHeight; y++) {
+      memcpy(data + y * layout.rowPitch, decodedData + y * rowSize, rowSize);
+    }
+    stbi_image_free(decodedData);
+  }
 
-  VK_CHECK(vkAllocateMemory(device, &allocInfo, nullptr, &stagingMemory));
-  VK_CHECK(vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0));
+  if (!memoryTypes.isHostCoherent(memoryType)) {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = textureImageMemory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    VK_CHECK(vkFlushMappedMemoryRanges(device, 1, &range));
+  }
+  vkUnmapMemory(device, textureImageMemory);
+  textureCopyRegions.clear();
+  textureLinear = true;
+  return true;
+}
 
+/*
+ * Loads a texture in the layout described in cooked_texture.h from file,
+ * named path in messages. Returns false if it cannot be used, in which case
+ * nothing has been allocated.
+ */
+bool HelloVK::loadCookedTexture(const Asset &file, const char *path) {
+  // .vkt files are stored uncompressed in the APK (see noCompress in
+  // build.gradle), so this maps the asset rather than reading it.
+  const uint8_t *fileData = file.data();
+  const size_t fileSize = file.size();
+  const CookedTextureHeader *header =
+      fileData ? getCookedTextureHeader(fileData, fileSize) : nullptr;
+  // The packed formats all have mandatory sampling support, so no format
+  // query is needed.
+  const VkFormat format =
+      header ? getCookedTextureVkFormat(header->format, header->flags)
+             : VK_FORMAT_UNDEFINED;
+  if (format == VK_FORMAT_UNDEFINED) {
+    LOGE("Ignoring unsupported cooked texture %s", path);
+    return false;
+  }
+  const CookedTextureMip *mips = getCookedTextureMips(header);
+  const bool compressed = header->flags & COOKED_TEXTURE_ZLIB;
+
+  // Uncompressed mips keep their file layout in the staging buffer, so the
+  // whole data region is a single copy. Compressed mips are inflated into
+  // slots sized for their uncompressed data.
+  textureCopyRegions.resize(header->mipLevels);
+  VkDeviceSize stagingSize = 0;
+  for (uint32_t i = 0; i < header->mipLevels; i++) {
+    VkBufferImageCopy &region = textureCopyRegions[i];
+    region = {};
+    region.bufferOffset =
+        compressed ? stagingSize : mips[i].offset - mips[0].offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = i;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = mips[i].width;
+    region.imageExtent.height = mips[i].height;
+    region.imageExtent.depth = 1;
+    stagingSize = region.bufferOffset + mips[i].uncompressedSize;
+    stagingSize = (stagingSize + COOKED_TEXTURE_ALIGNMENT - 1) /
+                  COOKED_TEXTURE_ALIGNMENT * COOKED_TEXTURE_ALIGNMENT;
+  }
+
+  // Inflating reads back earlier output, so compressed textures prefer
+  // cached staging memory, like the PNG path.
+  uint32_t stagingType;
+  createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               compressed ? MemoryUsage::kHostDecode : MemoryUsage::kUpload,
+               stagingBuffer, stagingMemory, &stagingType);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_BUFFER, stagingBuffer,
+          "texture staging buffer");
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DEVICE_MEMORY, stagingMemory,
+          "texture staging buffer");
   uint8_t *data;
-  VK_CHECK(vkMapMemory(device, stagingMemory, 0, memRequirements.size, 0,
+  VK_CHECK(vkMapMemory(device, stagingMemory, 0, stagingSize, 0,
                        (void **)&data));
-  memcpy(data, decodedData, imageSize);
+  if (!compressed) {
+    const CookedTextureMip &lastMip = mips[header->mipLevels - 1];
+    memcpy(data, fileData + mips[0].offset,
+           lastMip.offset + lastMip.size - mips[0].offset);
+  } else {
+    std::vector<uint64_t> mipOffsets(header->mipLevels);
+    for (uint32_t i = 0; i < header->mipLevels; i++) {
+      mipOffsets[i] = textureCopyRegions[i].bufferOffset;
+    }
+    if (!inflateCookedTexture(fileData, header, data, mipOffsets.data(),
+                              memoryTypes.isHostCached(stagingType), &jobs)) {
+      LOGE("Corrupt data in %s", path);
+      vkUnmapMemory(device, stagingMemory);
+      vkDestroyBuffer(device, stagingBuffer, nullptr);
+      vkFreeMemory(device, stagingMemory, nullptr);
+      stagingBuffer = VK_NULL_HANDLE;
+      stagingMemory = VK_NULL_HANDLE;
+      textureCopyRegions.clear();
+      return false;
+    }
+  }
+  if (!memoryTypes.isHostCoherent(stagingType)) {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = stagingMemory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    VK_CHECK(vkFlushMappedMemoryRanges(device, 1, &range));
+  }
   vkUnmapMemory(device, stagingMemory);
 
-  stbi_image_free(decodedData);
+  textureWidth = header->width;
+  textureHeight = header->height;
+  textureChannels = header->bytesPerPixel;
+  textureMipLevels = header->mipLevels;
+  textureFormat = format;
+  return true;
 }
 
-void HelloVK::copyBufferToImage() {
-  VkImageSubresourceRange subresourceRange{};
-  subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  subresourceRange.baseMipLevel = 0;
-  subresourceRange.levelCount = 1;
-  subresourceRange.layerCount = 1;
+/*
+ * Copies the smallest mip of the staging buffer into the texture, ahead of
+ * the render pass in the frame's own command buffer, so the upload costs no
+ * extra submission. updateTextureResidency streams in the others.
+ */
+void HelloVK::recordTextureUpload(VkCommandBuffer cmd) {
+  textureResidency = TextureResidencyManager(TEXTURE_BUDGET_BYTES);
+  textureId = textureResidency.registerTexture(
+      {uint32_t(textureWidth), uint32_t(textureHeight), textureMipLevels,
+       uint32_t(textureChannels)});
+  // update() reports at most a load per texture, and an eviction per mip.
+  mipLoads.reserve(1);
+  mipEvictions.reserve(textureMipLevels);
+
+  // A linear texture already holds its texels; it only changes layout.
+  if (textureLinear) {
+    VkImageMemoryBarrier imageMemoryBarrier{};
+    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.image = textureImage;
+    imageMemoryBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0,
+                                           1};
+    imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_HOST_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &imageMemoryBarrier);
+    return;
+  }
+  VK_LABEL_BEGIN(debugAnnotations, cmd, "texture upload");
+  recordMipUpload(cmd, textureResidency.residentMip(textureId));
+  VK_LABEL_END(debugAnnotations, cmd);
+}
 
+/*
+ * Copies one mip from the staging buffer, which keeps the whole chain, into
+ * the texture. Whatever the mip held before, if it was resident and evicted,
+ * is discarded; earlier frames may still be sampling it.
+ */
+void HelloVK::recordMipUpload(VkCommandBuffer cmd, uint32_t mip) {
   VkImageMemoryBarrier imageMemoryBarrier{};
   imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
   imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
   imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
   imageMemoryBarrier.image = textureImage;
-  imageMemoryBarrier.subresourceRange = subresourceRange;
+  imageMemoryBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0,
+                                         1};
   imageMemoryBarrier.srcAccessMask = 0;
   imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
   imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 
-  VkCommandBuffer cmd;
-  VkCommandBufferAllocateInfo cmdAllocInfo{};
-  cmdAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  cmdAllocInfo.commandPool = commandPool;
-  cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  cmdAllocInfo.commandBufferCount = 1;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &imageMemoryBarrier);
 
-  VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &cmd));
+  vkCmdCopyBufferToImage(cmd, stagingBuffer, textureImage,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                         &textureCopyRegions[mip]);
 
-  VkCommandBufferBeginInfo beginInfo{};
-  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  vkBeginCommandBuffer(cmd, &beginInfo);
+  imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                       0, nullptr, 1, &imageMemoryBarrier);
+}
+
+/*
+ * Streams in the mips the quad needs at its size on screen, a level per
+ * frame from coarse to fine, and points this frame's descriptor set at the
+ * view of the resident ones. Uploads are recorded ahead of the render pass,
+ * so a mip is sampled from the frame that loads it. The image has memory
+ * for every mip, so an eviction only narrows the view; the budget stands for
+ * what sparse or per-mip allocations would hold.
+ */
+void HelloVK::updateTextureResidency(VkCommandBuffer cmd) {
+  if (std::binary_search(visibleNodes.begin(), visibleNodes.end(),
+                         quadNode)) {
+    // The quad lies within its bounding circle, whose radius is in units of
+    // half the screen width.
+    const float quadPixels =
+        sceneBounds.radius[quadNode] * swapChainExtent.width;
+    textureResidency.requestFromScreenSize(textureId, quadPixels, quadPixels);
+  }
+  textureResidency.update(residencyFrame++, mipLoads, mipEvictions);
+  if (!mipLoads.empty()) {
+    VK_LABEL_SCOPE(debugAnnotations, cmd, "texture streaming");
+    for (const MipLoad &load : mipLoads) {
+      recordMipUpload(cmd, load.mip);
+      textureResidency.onMipLoaded(load.texture, load.mip);
+    }
+  }
 
+  // This frame's fence has signalled, so its set is no longer in use.
+  const uint32_t baseMip = textureResidency.residentMip(textureId);
+  if (descriptorBaseMip[currentFrame] == baseMip) {
+    return;
+  }
+  VkDescriptorImageInfo imageInfo{};
+  imageInfo.imageView = textureMipViews[baseMip];
+  imageInfo.sampler = textureSampler;
+  imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  VkWriteDescriptorSet descriptorWrite{};
+  descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptorWrite.dstSet = descriptorSets[currentFrame];
+  descriptorWrite.dstBinding = 1;
+  descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  descriptorWrite.descriptorCount = 1;
+  descriptorWrite.pImageInfo = &imageInfo;
+  vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+  descriptorBaseMip[currentFrame] = baseMip;
+}
+
+void HelloVK::setDrawWorkload(uint32_t draws, uint32_t instances) {
+  drawCount = draws;
+  instanceCount = instances;
+}
+
+void HelloVK::setSpriteWorkload(uint32_t sprites) {
+  if (sprites > spriteCapacity) {
+    // Frames in flight may still read the instance buffers.
+    vkDeviceWaitIdle(device);
+    destroySpriteBuffers();
+    spriteCapacity = sprites;
+    createSpriteBuffers();
+  }
+  spriteCount = sprites;
+}
+
+void HelloVK::createSpriteBuffers() {
+  // Tiny and written once, so it can live in the same memory as the
+  // instances.
+  createBuffer(sizeof(SPRITE_QUAD_INDICES), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+               MemoryUsage::kDynamic, spriteIndexBuffer, spriteIndexMemory);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_BUFFER, spriteIndexBuffer,
+          "sprite index buffer");
+  void *indices;
+  VK_CHECK(vkMapMemory(device, spriteIndexMemory, 0,
+                       sizeof(SPRITE_QUAD_INDICES), 0, &indices));
+  memcpy(indices, SPRITE_QUAD_INDICES, sizeof(SPRITE_QUAD_INDICES));
+  vkUnmapMemory(device, spriteIndexMemory);
+
+  const VkDeviceSize size = VkDeviceSize(spriteCapacity) *
+                            sizeof(SpriteInstance);
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    createBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                 MemoryUsage::kDynamic, spriteInstanceBuffers[i],
+                 spriteInstanceMemory[i]);
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_BUFFER, spriteInstanceBuffers[i],
+            "sprite instance buffer %zu", i);
+    VK_CHECK(vkMapMemory(device, spriteInstanceMemory[i], 0, size, 0,
+                         (void **)&spriteInstances[i]));
+  }
+}
+
+void HelloVK::destroySpriteBuffers() {
+  vkDestroyBuffer(device, spriteIndexBuffer, nullptr);
+  vkFreeMemory(device, spriteIndexMemory, nullptr);
+  spriteIndexBuffer = VK_NULL_HANDLE;
+  spriteIndexMemory = VK_NULL_HANDLE;
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    vkDestroyBuffer(device, spriteInstanceBuffers[i], nullptr);
+    vkFreeMemory(device, spriteInstanceMemory[i], nullptr);
+    spriteInstanceBuffers[i] = VK_NULL_HANDLE;
+    spriteInstanceMemory[i] = VK_NULL_HANDLE;
+    spriteInstances[i] = nullptr;
+  }
+}
+
+/*
+ * Builds the sprite atlas from generated images, soft edged discs of a few
+ * sizes and colours standing in for the icons and glyphs a game would load,
+ * and stages it for recordSpriteAtlasUpload. Runs on the texture's job.
+ */
+void HelloVK::buildSpriteAtlas() {
+  const uint32_t imageCount = 32;
+  std::vector<std::vector<uint8_t>> pixels(imageCount);
+  std::vector<AtlasImage> images(imageCount);
+  for (uint32_t i = 0; i < imageCount; i++) {
+    const uint32_t size = 16u << (i % 3);
+    const float radius = size * 0.5f;
+    pixels[i].resize(size * size * 4);
+    for (uint32_t y = 0; y < size; y++) {
+      for (uint32_t x = 0; x < size; x++) {
+        const float distance =
+            std::hypot(x + 0.5f - radius, y + 0.5f - radius);
+        uint8_t *texel = &pixels[i][(y * size + x) * 4];
+        texel[0] = static_cast<uint8_t>(64 + i * 37 % 192);
+        texel[1] = static_cast<uint8_t>(64 + i * 71 % 192);
+        texel[2] = static_cast<uint8_t>(64 + i * 113 % 192);
+        texel[3] = static_cast<uint8_t>(
+            255.0f * std::min(std::max(radius - distance, 0.0f), 1.0f));
+      }
+    }
+    images[i] = {pixels[i].data(), size, size};
+  }
+  if (!spriteAtlas.build(images, AtlasBuildOptions())) {
+    LOGE("The sprite images do not fit in an atlas");
+    return;
+  }
+
+  const VkDeviceSize size = spriteAtlas.pixels().size();
+  uint32_t stagingType;
+  createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::kUpload,
+               spriteAtlasStaging, spriteAtlasStagingMemory, &stagingType);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_BUFFER, spriteAtlasStaging,
+          "sprite atlas staging buffer");
+  uint8_t *data;
+  VK_CHECK(vkMapMemory(device, spriteAtlasStagingMemory, 0, size, 0,
+                       (void **)&data));
+  memcpy(data, spriteAtlas.pixels().data(), size);
+  if (!memoryTypes.isHostCoherent(stagingType)) {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = spriteAtlasStagingMemory;
+    range.size = VK_WHOLE_SIZE;
+    VK_CHECK(vkFlushMappedMemoryRanges(device, 1, &range));
+  }
+  vkUnmapMemory(device, spriteAtlasStagingMemory);
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent = {spriteAtlas.width(), spriteAtlas.height(), 1};
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage =
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &spriteAtlasImage));
+  allocateImageMemory(spriteAtlasImage, MemoryUsage::kGpuOnly,
+                      spriteAtlasMemory);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_IMAGE, spriteAtlasImage,
+          "sprite atlas");
+  VK_CHECK(vkBindImageMemory(device, spriteAtlasImage, spriteAtlasMemory, 0));
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = spriteAtlasImage;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = imageInfo.format;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &spriteAtlasView));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_IMAGE_VIEW, spriteAtlasView,
+          "sprite atlas view");
+}
+
+void HelloVK::recordSpriteAtlasUpload(VkCommandBuffer cmd) {
+  if (spriteAtlasImage == VK_NULL_HANDLE) {
+    return;
+  }
+  VK_LABEL_SCOPE(debugAnnotations, cmd, "sprite atlas upload");
+  VkImageMemoryBarrier imageMemoryBarrier{};
+  imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageMemoryBarrier.image = spriteAtlasImage;
+  imageMemoryBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0,
+                                         1};
+  imageMemoryBarrier.srcAccessMask = 0;
+  imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
   vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_HOST_BIT,
                        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
                        nullptr, 1, &imageMemoryBarrier);
 
-  VkBufferImageCopy bufferImageCopy{};
-  bufferImageCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  bufferImageCopy.imageSubresource.mipLevel = 0;
-  bufferImageCopy.imageSubresource.baseArrayLayer = 0;
-  bufferImageCopy.imageSubresource.layerCount = 1;
-  bufferImageCopy.imageExtent.width = textureWidth;
-  bufferImageCopy.imageExtent.height = textureHeight;
-  bufferImageCopy.imageExtent.depth = 1;
-  bufferImageCopy.bufferOffset = 0;
-
-  vkCmdCopyBufferToImage(cmd, stagingBuffer, textureImage,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                         1, &bufferImageCopy);
+  VkBufferImageCopy region{};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {spriteAtlas.width(), spriteAtlas.height(), 1};
+  vkCmdCopyBufferToImage(cmd, spriteAtlasStaging, spriteAtlasImage,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
   imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
   imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
   imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
   imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
   vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
                        0, nullptr, 1, &imageMemoryBarrier);
+}
+
+/*
+ * Lays the sprites out on a grid over the quad, cycling through the atlas,
+ * writes them straight into this frame's instance buffer and draws them all
+ * with one indexed, instanced draw.
+ */
+void HelloVK::recordSprites(VkCommandBuffer cmd) {
+  VK_LABEL_SCOPE(debugAnnotations, cmd, "sprites");
+  const std::vector<AtlasEntry> &entries = spriteAtlas.entries();
+  const uint32_t columns =
+      static_cast<uint32_t>(std::ceil(std::sqrt(float(spriteCount))));
+  const float cellSize = 2.0f / columns;
+  spriteBatch.begin(spriteInstances[currentFrame], spriteCapacity);
+  for (uint32_t i = 0; i < spriteCount; i++) {
+    const float x = (i % columns + 0.5f) * cellSize - 1.0f;
+    const float y = (i / columns + 0.5f) * cellSize - 1.0f;
+    spriteBatch.draw(entries[i % entries.size()], x, y, cellSize, cellSize);
+  }
+  spriteBatch.end();
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, spritePipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          pipelineLayout, 0, 1,
+                          &spriteDescriptorSets[currentFrame], 0, nullptr);
+  spriteBatch.record(cmd, spriteInstanceBuffers[currentFrame], 0,
+                     spriteIndexBuffer);
+}
 
-  vkEndCommandBuffer(cmd);
+void HelloVK::uploadTexture(uint32_t width, uint32_t height) {
+  TRACE_SCOPE("uploadTexture");
+  const VkDeviceSize size = VkDeviceSize(width) * height * 4;
+  VkBuffer buffer;
+  VkDeviceMemory bufferMemory;
+  uint32_t bufferType;
+  createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::kUpload,
+               buffer, bufferMemory, &bufferType);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_BUFFER, buffer,
+          "%ux%u upload staging buffer", width, height);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DEVICE_MEMORY, bufferMemory,
+          "%ux%u upload staging buffer", width, height);
+  uint8_t *data;
+  VK_CHECK(vkMapMemory(device, bufferMemory, 0, size, 0, (void **)&data));
+  memset(data, 0x80, size);
+  if (!memoryTypes.isHostCoherent(bufferType)) {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = bufferMemory;
+    range.size = VK_WHOLE_SIZE;
+    VK_CHECK(vkFlushMappedMemoryRanges(device, 1, &range));
+  }
+  vkUnmapMemory(device, bufferMemory);
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent = {width, height, 1};
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage =
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VkImage image;
+  VkDeviceMemory imageMemory;
+  VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &image));
+  allocateImageMemory(image, MemoryUsage::kGpuOnly, imageMemory);
+  VK_CHECK(vkBindImageMemory(device, image, imageMemory, 0));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_IMAGE, image, "%ux%u upload",
+          width, height);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_DEVICE_MEMORY, imageMemory,
+          "%ux%u upload", width, height);
+
+  VkCommandBufferAllocateInfo cmdAllocInfo{};
+  cmdAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmdAllocInfo.commandPool = commandPool;
+  cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmdAllocInfo.commandBufferCount = 1;
+  VkCommandBuffer cmd;
+  VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &cmd));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_COMMAND_BUFFER, cmd,
+          "%ux%u upload commands", width, height);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+  VK_LABEL_BEGIN(debugAnnotations, cmd, "texture upload");
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_HOST_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+
+  VkBufferImageCopy region{};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {width, height, 1};
+  vkCmdCopyBufferToImage(cmd, buffer, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                       0, nullptr, 1, &barrier);
+  VK_LABEL_END(debugAnnotations, cmd);
+  VK_CHECK(vkEndCommandBuffer(cmd));
 
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &cmd;
-
   VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
   vkQueueWaitIdle(graphicsQueue);
+
+  vkFreeCommandBuffers(device, commandPool, 1, &cmd);
+  vkDestroyImage(device, image, nullptr);
+  vkFreeMemory(device, imageMemory, nullptr);
+  vkDestroyBuffer(device, buffer, nullptr);
+  vkFreeMemory(device, bufferMemory, nullptr);
 }
 
 void HelloVK::createTextureImageViews() {
-  VkImageViewCreateInfo createInfo{};
-  createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-  createInfo.image = textureImage;
-  createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-  createInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-  createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-  createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-  createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-  createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-  createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  createInfo.subresourceRange.baseMipLevel = 0;
-  createInfo.subresourceRange.levelCount = 1;
-  createInfo.subresourceRange.baseArrayLayer = 0;
-  createInfo.subresourceRange.layerCount = 1;
-
-  VK_CHECK(vkCreateImageView(device, &createInfo, nullptr, &textureImageView));
+  textureMipViews.resize(textureMipLevels);
+  for (uint32_t mip = 0; mip < textureMipLevels; mip++) {
+    VkImageViewCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    createInfo.image = textureImage;
+    createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    createInfo.format = textureFormat;
+    createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    createInfo.subresourceRange.baseMipLevel = mip;
+    createInfo.subresourceRange.levelCount = textureMipLevels - mip;
+    createInfo.subresourceRange.baseArrayLayer = 0;
+    createInfo.subresourceRange.layerCount = 1;
+
+    VK_CHECK(vkCreateImageView(device, &createInfo, nullptr,
+                               &textureMipViews[mip]));
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_IMAGE_VIEW, textureMipViews[mip],
+            "texture view from mip %u", mip);
+  }
 }
 
 void HelloVK::createTextureSampler() {
@@ -1292,6 +2846,8 @@ void HelloVK::createTextureSampler() {
   createInfo.maxLod = VK_LOD_CLAMP_NONE;
 
   VK_CHECK(vkCreateSampler(device, &createInfo, nullptr, &textureSampler));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_SAMPLER, textureSampler,
+          "texture sampler");
 }
 
 void HelloVK::createRenderPass() {
@@ -1335,6 +2891,8 @@ void HelloVK::createRenderPass() {
   renderPassInfo.pDependencies = &dependency;
 
   VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_RENDER_PASS, renderPass,
+          "main pass");
 }
 
 /*
@@ -1361,14 +2919,56 @@ void HelloVK::createRenderPass() {
  * a 4x4 rotation matrix specified by the descriptorSetLayout. This is required
  * in order to render a rotated scene when the device has been rotated.
  */
+/*
+ * Creates the quad and sprite pipelines, which share a layout. The SPIR-V
+ * was read ahead of time by initVulkan.
+ */
 void HelloVK::createGraphicsPipeline() {
-  auto vertShaderCode =
-      LoadBinaryFileToVector("shaders/shader.vert.spv", assetManager);
-  auto fragShaderCode =
-      LoadBinaryFileToVector("shaders/shader.frag.spv", assetManager);
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 0;
+  pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+  VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+                                  &pipelineLayout));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_PIPELINE_LAYOUT, pipelineLayout,
+          "quad pipeline layout");
+
+  // The quad's vertices come from the vertex shader alone.
+  VkPipelineVertexInputStateCreateInfo quadInput{};
+  quadInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  graphicsPipeline =
+      createPipeline("quad", vertShaderCode, fragShaderCode, quadInput, false);
+
+  // Sprites read a SpriteInstance per instance and blend over the quad.
+  const VkVertexInputBindingDescription spriteBinding =
+      SpriteBatch::bindingDescription();
+  const auto spriteAttributes = SpriteBatch::attributeDescriptions();
+  VkPipelineVertexInputStateCreateInfo spriteInput{};
+  spriteInput.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  spriteInput.vertexBindingDescriptionCount = 1;
+  spriteInput.pVertexBindingDescriptions = &spriteBinding;
+  spriteInput.vertexAttributeDescriptionCount =
+      static_cast<uint32_t>(spriteAttributes.size());
+  spriteInput.pVertexAttributeDescriptions = spriteAttributes.data();
+  spritePipeline = createPipeline("sprite", spriteVertShaderCode,
+                                  spriteFragShaderCode, spriteInput, true);
+}
 
-  VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-  VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+VkPipeline HelloVK::createPipeline(
+    [[maybe_unused]] const char *name, const std::vector<uint8_t> &vertCode,
+    const std::vector<uint8_t> &fragCode,
+    const VkPipelineVertexInputStateCreateInfo &vertexInput,
+    bool alphaBlend) {
+  VkShaderModule vertShaderModule = createShaderModule(vertCode);
+  VkShaderModule fragShaderModule = createShaderModule(fragCode);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_SHADER_MODULE, vertShaderModule,
+          "%s.vert", name);
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_SHADER_MODULE, fragShaderModule,
+          "%s.frag", name);
 
   VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
   vertShaderStageInfo.sType =
@@ -1384,17 +2984,22 @@ void HelloVK::createGraphicsPipeline() {
   fragShaderStageInfo.module = fragShaderModule;
   fragShaderStageInfo.pName = "main";
 
+  // Constant 0 (ENCODE_SRGB) makes the fragment shader apply the sRGB curve
+  // itself when the swapchain cannot. Blending then happens on encoded
+  // values, which is the accepted cost of such swapchains.
+  VkBool32 encodeSrgb =
+      isSrgbFormat(swapChainImageFormat) ? VK_FALSE : VK_TRUE;
+  VkSpecializationMapEntry specializationEntry{0, 0, sizeof(encodeSrgb)};
+  VkSpecializationInfo specializationInfo{};
+  specializationInfo.mapEntryCount = 1;
+  specializationInfo.pMapEntries = &specializationEntry;
+  specializationInfo.dataSize = sizeof(encodeSrgb);
+  specializationInfo.pData = &encodeSrgb;
+  fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
   VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
                                                     fragShaderStageInfo};
 
-  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-  vertexInputInfo.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 0;
-  vertexInputInfo.pVertexBindingDescriptions = nullptr;
-  vertexInputInfo.vertexAttributeDescriptionCount = 0;
-  vertexInputInfo.pVertexAttributeDescriptions = nullptr;
-
   VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
   inputAssembly.sType =
       VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -1435,7 +3040,15 @@ void HelloVK::createGraphicsPipeline() {
   colorBlendAttachment.colorWriteMask =
       VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
       VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-  colorBlendAttachment.blendEnable = VK_FALSE;
+  colorBlendAttachment.blendEnable = alphaBlend ? VK_TRUE : VK_FALSE;
+  colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  colorBlendAttachment.dstColorBlendFactor =
+      VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+  colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  colorBlendAttachment.dstAlphaBlendFactor =
+      VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
 
   VkPipelineColorBlendStateCreateInfo colorBlending{};
   colorBlending.sType =
@@ -1449,15 +3062,6 @@ void HelloVK::createGraphicsPipeline() {
   colorBlending.blendConstants[2] = 0.0f;
   colorBlending.blendConstants[3] = 0.0f;
 
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 1;
-  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-  pipelineLayoutInfo.pushConstantRangeCount = 0;
-  pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-  VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
-                                  &pipelineLayout));
   std::vector<VkDynamicState> dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT,
                                                      VK_DYNAMIC_STATE_SCISSOR};
   VkPipelineDynamicStateCreateInfo dynamicStateCI{};
@@ -1470,7 +3074,7 @@ void HelloVK::createGraphicsPipeline() {
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineInfo.stageCount = 2;
   pipelineInfo.pStages = shaderStages;
-  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pVertexInputState = &vertexInput;
   pipelineInfo.pInputAssemblyState = &inputAssembly;
   pipelineInfo.pViewportState = &viewportState;
   pipelineInfo.pRasterizationState = &rasterizer;
@@ -1484,10 +3088,14 @@ void HelloVK::createGraphicsPipeline() {
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
   pipelineInfo.basePipelineIndex = -1;
 
+  VkPipeline pipeline;
   VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-                                     nullptr, &graphicsPipeline));
+                                     nullptr, &pipeline));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_PIPELINE, pipeline, "%s pipeline",
+          name);
   vkDestroyShaderModule(device, fragShaderModule, nullptr);
   vkDestroyShaderModule(device, vertShaderModule, nullptr);
+  return pipeline;
 }
 
 VkShaderModule HelloVK::createShaderModule(const std::vector<uint8_t> &code) {
@@ -1520,6 +3128,8 @@ void HelloVK::createFramebuffers() {
 
     VK_CHECK(vkCreateFramebuffer(device, &framebufferInfo, nullptr,
                                  &swapChainFramebuffers[i]));
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_FRAMEBUFFER,
+            swapChainFramebuffers[i], "swapchain framebuffer %zu", i);
   }
 }
 
@@ -1530,6 +3140,8 @@ void HelloVK::createCommandPool() {
   poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
   poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
   VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_COMMAND_POOL, commandPool,
+          "graphics command pool");
 }
 
 void HelloVK::createCommandBuffer() {
@@ -1541,6 +3153,10 @@ void HelloVK::createCommandBuffer() {
   allocInfo.commandBufferCount = commandBuffers.size();
 
   VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()));
+  for (size_t i = 0; i < commandBuffers.size(); i++) {
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_COMMAND_BUFFER, commandBuffers[i],
+            "frame %zu commands", i);
+  }
 }
 
 void HelloVK::createSyncObjects() {
@@ -1562,7 +3178,106 @@ void HelloVK::createSyncObjects() {
                                &renderFinishedSemaphores[i]));
 
     VK_CHECK(vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]));
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_SEMAPHORE,
+            imageAvailableSemaphores[i], "frame %zu image available", i);
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_SEMAPHORE,
+            renderFinishedSemaphores[i], "frame %zu render finished", i);
+    VK_NAME(debugAnnotations, VK_OBJECT_TYPE_FENCE, inFlightFences[i],
+            "frame %zu in flight", i);
+  }
+}
+
+/*
+ * Sets up the queries behind the GPU track of trace captures, if the
+ * graphics queue supports timestamps, and finds the offset between the GPU
+ * and trace clocks: a timestamp is written and read back, and taken to have
+ * happened halfway between submitting and the queue going idle. That is off
+ * by up to half the round trip, tens of microseconds, which is plenty to
+ * line GPU work up with the frame that submitted it.
+ */
+void HelloVK::createTimestampQueries() {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  FixedVector<VkQueueFamilyProperties, 16> queueFamilies;
+  uint32_t queueFamilyCount = queueFamilies.capacity();
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                           queueFamilies.data());
+  queueFamilies.resize(queueFamilyCount);
+  const uint32_t graphicsFamily =
+      findQueueFamilies(physicalDevice).graphicsFamily.value();
+  const uint32_t validBits =
+      graphicsFamily < queueFamilies.size()
+          ? queueFamilies[graphicsFamily].timestampValidBits
+          : 0;
+  if (validBits == 0 || properties.limits.timestampPeriod <= 0.0f) {
+    LOGI("No GPU timestamps, trace captures will have no GPU track");
+    return;
+  }
+  timestampPeriodNs = properties.limits.timestampPeriod;
+  timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = 2 * MAX_FRAMES_IN_FLIGHT;
+  VK_CHECK(vkCreateQueryPool(device, &poolInfo, nullptr, &timestampQueries));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_QUERY_POOL, timestampQueries,
+          "render pass timestamps");
+
+  VkCommandBuffer cmd;
+  VkCommandBufferAllocateInfo cmdAllocInfo{};
+  cmdAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmdAllocInfo.commandPool = commandPool;
+  cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmdAllocInfo.commandBufferCount = 1;
+  VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &cmd));
+  VK_NAME(debugAnnotations, VK_OBJECT_TYPE_COMMAND_BUFFER, cmd,
+          "timestamp calibration commands");
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+  vkCmdResetQueryPool(cmd, timestampQueries, 0, 1);
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      timestampQueries, 0);
+  VK_CHECK(vkEndCommandBuffer(cmd));
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &cmd;
+  const uint64_t submittedNs = traceNowNs();
+  VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+  vkQueueWaitIdle(graphicsQueue);
+  const uint64_t idleNs = traceNowNs();
+  vkFreeCommandBuffers(device, commandPool, 1, &cmd);
+
+  uint64_t ticks = 0;
+  VK_CHECK(vkGetQueryPoolResults(device, timestampQueries, 0, 1,
+                                 sizeof(ticks), &ticks, sizeof(ticks),
+                                 VK_QUERY_RESULT_64_BIT |
+                                     VK_QUERY_RESULT_WAIT_BIT));
+  gpuClockOffsetNs =
+      int64_t(submittedNs + (idleNs - submittedNs) / 2) -
+      int64_t((ticks & timestampMask) * timestampPeriodNs);
+}
+
+// Called once frame's fence has signalled, so its timestamps are written.
+void HelloVK::traceGpuZones(uint32_t frame) {
+  gpuZonePending[frame] = false;
+  uint64_t ticks[2];
+  if (vkGetQueryPoolResults(device, timestampQueries, frame * 2, 2,
+                            sizeof(ticks), ticks, sizeof(ticks[0]),
+                            VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+    return;
   }
+  const uint64_t startNs =
+      gpuClockOffsetNs +
+      int64_t((ticks[0] & timestampMask) * timestampPeriodNs);
+  const uint64_t durationNs = uint64_t(
+      ((ticks[1] - ticks[0]) & timestampMask) * timestampPeriodNs);
+  traceGpuZone("render pass", startNs, durationNs);
 }
 
 }  // namespace vkt
\ No newline at end of file
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The only translation unit compiling the stb_image implementation.
+ *
+ * Only the formats the app ships are compiled in. SSE2 is enabled by
+ * stb_image itself on x86 targets built with SSE2 (every Android x86 ABI and
+ * x86-64); NEON has to be requested explicitly.
+ */
+
+#include "image_codec.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace vkt {
+namespace {
+
+/*
+ * stb_image allocates its output through STBI_MALLOC. While a decode target is
+ * armed on the calling thread, the first allocation of exactly the target's
+ * size is served from the target, so the image is decoded in place.
+ */
+struct DecodeTarget {
+  void *buffer;
+  size_t size;
+  bool used;
+};
+thread_local DecodeTarget *decodeTarget = nullptr;
+
+thread_local DecodeStats stats{};
+
+#if defined(HELLOVK_DECODE_STATS)
+// Heap blocks carry their size in front, so frees can be counted.
+const size_t kSizeHeader = 16;
+thread_local size_t liveBytes = 0;
+
+void countCopy(size_t bytes) { stats.copiedBytes += bytes; }
+
+void *heapMalloc(size_t size) {
+  auto *block = static_cast<uint8_t *>(malloc(size + kSizeHeader));
+  if (block == nullptr) {
+    return nullptr;
+  }
+  memcpy(block, &size, sizeof(size));
+  stats.allocations++;
+  stats.allocatedBytes += size;
+  liveBytes += size;
+  stats.peakBytes = std::max(stats.peakBytes, liveBytes);
+  return block + kSizeHeader;
+}
+
+void heapFree(void *pointer) {
+  if (pointer == nullptr) {
+    return;
+  }
+  uint8_t *block = static_cast<uint8_t *>(pointer) - kSizeHeader;
+  size_t size;
+  memcpy(&size, block, sizeof(size));
+  liveBytes -= size;
+  free(block);
+}
+
+void *heapRealloc(void *pointer, size_t size) {
+  if (pointer == nullptr) {
+    return heapMalloc(size);
+  }
+  uint8_t *block = static_cast<uint8_t *>(pointer) - kSizeHeader;
+  size_t oldSize;
+  memcpy(&oldSize, block, sizeof(oldSize));
+  auto *grown = static_cast<uint8_t *>(realloc(block, size + kSizeHeader));
+  if (grown == nullptr) {
+    return nullptr;
+  }
+  memcpy(grown, &size, sizeof(size));
+  if (grown != block) {
+    countCopy(std::min(size, oldSize));
+  }
+  stats.allocations++;
+  if (size > oldSize) {
+    stats.allocatedBytes += size - oldSize;
+  }
+  liveBytes += size - oldSize;
+  stats.peakBytes = std::max(stats.peakBytes, liveBytes);
+  return grown + kSizeHeader;
+}
+#else
+void countCopy(size_t) {}
+void *heapMalloc(size_t size) { return malloc(size); }
+void heapFree(void *pointer) { free(pointer); }
+void *heapRealloc(void *pointer, size_t size) {
+  return realloc(pointer, size);
+}
+#endif
+
+void *stbiMalloc(size_t size) {
+  DecodeTarget *target = decodeTarget;
+  if (target != nullptr && !target->used && size == target->size) {
+    target->used = true;
+    return target->buffer;
+  }
+  return heapMalloc(size);
+}
+
+void stbiFree(void *pointer) {
+  if (decodeTarget != nullptr && pointer == decodeTarget->buffer) {
+    return;
+  }
+  heapFree(pointer);
+}
+
+void *stbiRealloc(void *pointer, size_t size) {
+  DecodeTarget *target = decodeTarget;
+  if (target != nullptr && pointer != nullptr && pointer == target->buffer) {
+    // The target cannot grow, move the data to the heap instead.
+    void *moved = heapMalloc(size);
+    if (moved != nullptr) {
+      const size_t copied = std::min(size, target->size);
+      memcpy(moved, pointer, copied);
+      countCopy(copied);
+    }
+    return moved;
+  }
+  return heapRealloc(pointer, size);
+}
+
+}  // namespace
+}  // namespace vkt
+
+#define STBI_MALLOC(size) vkt::stbiMalloc(size)
+#define STBI_FREE(pointer) vkt::stbiFree(pointer)
+#define STBI_REALLOC(pointer, size) vkt::stbiRealloc(pointer, size)
+
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define STBI_NEON
+#endif
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+namespace vkt {
+
+stbi_uc *loadImageFromMemory(const stbi_uc *data, int size,
+                             int requiredChannels, void *target,
+                             size_t targetSize, int *width, int *height,
+                             int *channels) {
+  DecodeTarget decode{target, targetSize, false};
+  if (target != nullptr) {
+    decodeTarget = &decode;
+  }
+  stbi_uc *pixels = stbi_load_from_memory(data, size, width, height, channels,
+                                          requiredChannels);
+  decodeTarget = nullptr;
+
+  if (pixels == nullptr || target == nullptr || pixels == target) {
+    return pixels;
+  }
+  const size_t decodedSize = static_cast<size_t>(*width) * *height *
+                             (requiredChannels != 0 ? requiredChannels
+                                                    : *channels);
+  if (decodedSize == targetSize) {
+    // The output did not land in the target (e.g. it was converted after
+    // decoding), copy it so callers can always rely on the target.
+    memcpy(target, pixels, targetSize);
+    countCopy(targetSize);
+    stbi_image_free(pixels);
+    return static_cast<stbi_uc *>(target);
+  }
+  return pixels;
+}
+
+void resetDecodeStats() { stats = {}; }
+
+DecodeStats decodeStats() { return stats; }
+
+}  // namespace vkt
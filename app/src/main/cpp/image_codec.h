@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_IMAGE_CODEC_H
+#define HELLOVK_IMAGE_CODEC_H
+
+#include <cstddef>
+
+// Declarations only, the implementation is compiled once in image_codec.cpp.
+#include <stb_image.h>
+
+namespace vkt {
+
+/*
+ * Decodes a PNG or JPEG held in memory to 8 bits per channel.
+ *
+ * When target is not null and targetSize matches the decoded size, the
+ * decoder writes its output directly into target and returns target; use
+ * this to decode straight into a mapped staging buffer. Decoders read back
+ * what they have written, so target should be in cached memory. Otherwise,
+ * the pixels are returned in a heap buffer that must be released with
+ * stbi_image_free. Returns nullptr on failure, see stbi_failure_reason().
+ */
+stbi_uc *loadImageFromMemory(const stbi_uc *data, int size,
+                             int requiredChannels, void *target,
+                             size_t targetSize, int *width, int *height,
+                             int *channels);
+
+/*
+ * What the decoder did with memory on the calling thread since the last
+ * resetDecodeStats(). Only counted in builds that define
+ * HELLOVK_DECODE_STATS, such as decode_bench; elsewhere it stays zero.
+ */
+struct DecodeStats {
+  size_t allocations;
+  // Heap bytes requested, and the most of them live at once.
+  size_t allocatedBytes;
+  size_t peakBytes;
+  // Bytes copied from one buffer to another: by reallocations that moved,
+  // and into the target when the output did not land there.
+  size_t copiedBytes;
+};
+
+void resetDecodeStats();
+DecodeStats decodeStats();
+
+}  // namespace vkt
+
+#endif  // HELLOVK_IMAGE_CODEC_H
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "job_system.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace vkt {
+
+namespace {
+
+const uint32_t NOT_A_JOB_THREAD = UINT32_MAX;
+
+// Failed attempts to find work before a worker goes to sleep.
+const int IDLE_SPINS_BEFORE_SLEEP = 64;
+
+// The job system the current thread runs jobs for, and its deque index.
+thread_local const JobSystem *currentSystem = nullptr;
+thread_local uint32_t currentIndex = NOT_A_JOB_THREAD;
+thread_local uint32_t victimSeed = 0;
+
+/*
+ * Returns the cores of the requested cluster, or an empty list when the
+ * whole machine should be used: for kAny, when the cores cannot be told
+ * apart, or when their frequencies are not readable.
+ */
+std::vector<uint32_t> clusterCores(CoreAffinity affinity) {
+  std::vector<uint32_t> cores;
+#if defined(__linux__)
+  if (affinity == CoreAffinity::kAny) {
+    return cores;
+  }
+  const uint32_t coreCount = std::thread::hardware_concurrency();
+  std::vector<uint64_t> frequencies(coreCount);
+  for (uint32_t i = 0; i < coreCount; i++) {
+    char path[96];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", i);
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+      return cores;
+    }
+    unsigned long long frequency = 0;
+    bool read = fscanf(file, "%llu", &frequency) == 1;
+    fclose(file);
+    if (!read) {
+      return cores;
+    }
+    frequencies[i] = frequency;
+  }
+  auto range = std::minmax_element(frequencies.begin(), frequencies.end());
+  if (coreCount == 0 || *range.first == *range.second) {
+    return cores;
+  }
+  const uint64_t wanted =
+      affinity == CoreAffinity::kBigCores ? *range.second : *range.first;
+  for (uint32_t i = 0; i < coreCount; i++) {
+    if (frequencies[i] == wanted) {
+      cores.push_back(i);
+    }
+  }
+#endif
+  return cores;
+}
+
+}  // namespace
+
+/*
+ * Fixed capacity Chase-Lev deque, with the memory orderings of Le, Pop,
+ * Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak
+ * Memory Models" (PPoPP 2013). push and pop are only called by the owning
+ * thread, steal by any thread.
+ */
+class JobSystem::Deque {
+ public:
+  // Returns false when full; the caller then queues the job elsewhere.
+  bool push(Job *job) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= static_cast<int64_t>(CAPACITY)) {
+      return false;
+    }
+    buffer[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    // A release store rather than the paper's release fence; equivalent,
+    // and visible to ThreadSanitizer, which does not model fences.
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+  }
+
+  Job *pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Job *job = buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+      // Last job: race thieves for it.
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+        job = nullptr;
+      }
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  Job *steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    Job *job = buffer[t & (CAPACITY - 1)].load(std::memory_order_acquire);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return job;
+  }
+
+ private:
+  static constexpr size_t CAPACITY = 4096;
+
+  // top and bottom are written by different threads; keep them apart.
+  alignas(64) std::atomic<int64_t> top{0};
+  alignas(64) std::atomic<int64_t> bottom{0};
+  alignas(64) std::atomic<Job *> buffer[CAPACITY] = {};
+};
+
+JobSystem::JobSystem(uint32_t workerCount, CoreAffinity affinity) {
+  std::vector<uint32_t> cores = clusterCores(affinity);
+  if (workerCount == UINT32_MAX) {
+    const uint32_t available = cores.empty()
+                                   ? std::thread::hardware_concurrency()
+                                   : static_cast<uint32_t>(cores.size());
+    workerCount = std::max(1u, available) - 1;
+  }
+
+  jobPool = std::make_unique<Job[]>(JOB_POOL_SIZE);
+  for (uint32_t i = 0; i < JOB_POOL_SIZE; i++) {
+    jobPool[i].nextFree.store(i + 1 < JOB_POOL_SIZE ? i + 2 : 0,
+                              std::memory_order_relaxed);
+  }
+  freeJobs.store(1);
+
+  deques.resize(workerCount + 1);
+  for (auto &deque : deques) {
+    deque = std::make_unique<Deque>();
+  }
+  currentSystem = this;
+  currentIndex = 0;
+  for (uint32_t i = 1; i <= workerCount; i++) {
+    workers.emplace_back(&JobSystem::workerMain, this, i, cores);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  if (currentSystem == this) {
+    currentSystem = nullptr;
+    currentIndex = NOT_A_JOB_THREAD;
+  }
+}
+
+Job *JobSystem::allocateJob() {
+  uint64_t head = freeJobs.load(std::memory_order_acquire);
+  for (;;) {
+    const uint32_t index = static_cast<uint32_t>(head);
+    if (index == 0) {
+      // More jobs pending than the pool holds.
+      Job *job = new Job;
+      job->pooled = false;
+      return job;
+    }
+    Job &job = jobPool[index - 1];
+    // job may have been taken and freed again since head was read; then
+    // the count in head has moved on and the exchange fails.
+    const uint64_t next = (((head >> 32) + 1) << 32) |
+                          job.nextFree.load(std::memory_order_relaxed);
+    if (freeJobs.compare_exchange_weak(head, next, std::memory_order_acquire,
+                                       std::memory_order_acquire)) {
+      return &job;
+    }
+  }
+}
+
+void JobSystem::freeJob(Job *job) {
+  if (!job->pooled) {
+    delete job;
+    return;
+  }
+  const uint32_t index = static_cast<uint32_t>(job - jobPool.get()) + 1;
+  uint64_t head = freeJobs.load(std::memory_order_relaxed);
+  do {
+    job->nextFree.store(static_cast<uint32_t>(head),
+                        std::memory_order_relaxed);
+  } while (!freeJobs.compare_exchange_weak(
+      head, (((head >> 32) + 1) << 32) | index, std::memory_order_release,
+      std::memory_order_relaxed));
+}
+
+void JobSystem::schedule(Job *job, JobCounter *counter, JobCounter *after) {
+  job->counter = counter;
+  job->next = nullptr;
+  if (counter != nullptr) {
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (after != nullptr) {
+    std::lock_guard<std::mutex> lock(after->mutex);
+    if (after->pending.load(std::memory_order_relaxed) != 0) {
+      job->next = after->continuations;
+      after->continuations = job;
+      return;
+    }
+  }
+  submit(job);
+}
+
+void JobSystem::submit(Job *job) {
+  const bool owner = currentSystem == this;
+  if (!owner || !deques[currentIndex]->push(job)) {
+    std::lock_guard<std::mutex> lock(injectedMutex);
+    job->next = nullptr;
+    if (injectedTail != nullptr) {
+      injectedTail->next = job;
+    } else {
+      injectedHead = job;
+    }
+    injectedTail = job;
+    hasInjected.store(true, std::memory_order_release);
+  }
+  epoch.fetch_add(1);
+  if (sleepers.load() > 0) {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    wake.notify_one();
+  }
+}
+
+void JobSystem::execute(Job *job) {
+  job->function();
+  job->function.reset();
+  if (JobCounter *counter = job->counter) {
+    // The decrement happens under the lock so that wait(), which takes the
+    // lock last, cannot return and let the counter be destroyed while the
+    // continuations are still being collected.
+    Job *ready = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(counter->mutex);
+      if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::swap(ready, counter->continuations);
+      }
+    }
+    while (ready != nullptr) {
+      Job *continuation = ready;
+      ready = ready->next;
+      submit(continuation);
+    }
+  }
+  freeJob(job);
+}
+
+Job *JobSystem::findJob(uint32_t self) {
+  if (self != NOT_A_JOB_THREAD) {
+    if (Job *job = deques[self]->pop()) {
+      return job;
+    }
+  }
+  if (hasInjected.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(injectedMutex);
+    if (Job *job = injectedHead) {
+      injectedHead = job->next;
+      if (injectedHead == nullptr) {
+        injectedTail = nullptr;
+      }
+      hasInjected.store(injectedHead != nullptr, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  // Start at a random victim so thieves spread over the deques.
+  const uint32_t count = static_cast<uint32_t>(deques.size());
+  victimSeed = victimSeed * 1664525u + 1013904223u;
+  const uint32_t start = (victimSeed >> 8) % count;
+  for (uint32_t i = 0; i < count; i++) {
+    const uint32_t victim = (start + i) % count;
+    if (victim == self) {
+      continue;
+    }
+    if (Job *job = deques[victim]->steal()) {
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+void JobSystem::wait(JobCounter &counter) {
+  const uint32_t self = currentSystem == this ? currentIndex : NOT_A_JOB_THREAD;
+  while (!counter.done()) {
+    if (Job *job = findJob(self)) {
+      execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  // Wait for the thread that finished the last job to let go of the counter.
+  std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::parallelForRanges(uint32_t count, uint32_t grain,
+                                  RangeFunction body, const void *context) {
+  grain = std::max(1u, grain);
+  const uint64_t rangeCount =
+      (static_cast<uint64_t>(count) + grain - 1) / grain;
+  // One job per thread, each claiming ranges until none are left, balances
+  // uneven ranges without a job per range.
+  const uint32_t jobCount = static_cast<uint32_t>(
+      std::min<uint64_t>(rangeCount, threadCount()));
+  std::atomic<uint64_t> next{0};
+  auto claimRanges = [&]() {
+    for (uint64_t first = next.fetch_add(grain); first < count;
+         first = next.fetch_add(grain)) {
+      body(context, static_cast<uint32_t>(first),
+           static_cast<uint32_t>(std::min<uint64_t>(first + grain, count)));
+    }
+  };
+  JobCounter counter;
+  for (uint32_t i = 1; i < jobCount; i++) {
+    run(claimRanges, &counter);
+  }
+  claimRanges();
+  wait(counter);
+}
+
+void JobSystem::workerMain(uint32_t index, std::vector<uint32_t> cores) {
+  currentSystem = this;
+  currentIndex = index;
+  victimSeed = index;
+#if defined(__linux__)
+  if (!cores.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (uint32_t core : cores) {
+      CPU_SET(core, &set);
+    }
+    // Only a hint: a failure leaves the thread free to run anywhere.
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+#endif
+
+  int idleSpins = 0;
+  while (!stopping.load(std::memory_order_relaxed)) {
+    if (Job *job = findJob(index)) {
+      execute(job);
+      idleSpins = 0;
+      continue;
+    }
+    if (++idleSpins < IDLE_SPINS_BEFORE_SLEEP) {
+      std::this_thread::yield();
+      continue;
+    }
+    // Look once more after reading the epoch: anything submitted after that
+    // bumps it, and the wait below returns straight away.
+    const uint64_t seen = epoch.load();
+    if (Job *job = findJob(index)) {
+      execute(job);
+      idleSpins = 0;
+      continue;
+    }
+    sleepers.fetch_add(1);
+    {
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [&] { return stopping || epoch.load() != seen; });
+    }
+    sleepers.fetch_sub(1);
+    idleSpins = 0;
+  }
+}
+
+}  // namespace vkt
@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_JOB_SYSTEM_H
+#define HELLOVK_JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vkt {
+
+class JobCounter;
+
+/*
+ * A job's callable, stored inline so that submitting a job does not
+ * allocate. Captures must fit in CAPACITY bytes; capture a pointer to
+ * anything larger.
+ */
+class JobFunction {
+ public:
+  static constexpr size_t CAPACITY = 64;
+
+  JobFunction() = default;
+  ~JobFunction() { reset(); }
+  JobFunction(const JobFunction &) = delete;
+  JobFunction &operator=(const JobFunction &) = delete;
+
+  template <typename Function>
+  void emplace(Function &&function) {
+    using Stored = std::decay_t<Function>;
+    static_assert(sizeof(Stored) <= CAPACITY,
+                  "job captures too large, capture a pointer instead");
+    static_assert(alignof(Stored) <= alignof(std::max_align_t),
+                  "job captures over-aligned");
+    reset();
+    new (storage) Stored(std::forward<Function>(function));
+    invokeStored = [](void *stored) { (*static_cast<Stored *>(stored))(); };
+    destroyStored = [](void *stored) {
+      static_cast<Stored *>(stored)->~Stored();
+    };
+  }
+
+  void operator()() { invokeStored(storage); }
+
+  void reset() {
+    if (destroyStored != nullptr) {
+      destroyStored(storage);
+      invokeStored = nullptr;
+      destroyStored = nullptr;
+    }
+  }
+
+ private:
+  alignas(std::max_align_t) unsigned char storage[CAPACITY];
+  void (*invokeStored)(void *) = nullptr;
+  void (*destroyStored)(void *) = nullptr;
+};
+
+struct Job {
+  JobFunction function;
+  JobCounter *counter = nullptr;
+  // The next job in a counter's continuations or the injected queue.
+  Job *next = nullptr;
+  // The next free job in the pool, as an index plus one.
+  std::atomic<uint32_t> nextFree{0};
+  // False for jobs allocated once the pool ran out.
+  bool pooled = true;
+};
+
+/*
+ * Counts the jobs submitted against it that have not finished yet. Jobs can
+ * be made to wait for a counter to reach zero, and any thread can wait on
+ * one with JobSystem::wait. A counter may be reused once it reaches zero,
+ * but must not be destroyed before a wait on it has returned.
+ */
+class JobCounter {
+ public:
+  bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+ private:
+  friend class JobSystem;
+  std::atomic<uint32_t> pending{0};
+  // Jobs to submit when pending drops to zero, linked through Job::next.
+  std::mutex mutex;
+  Job *continuations = nullptr;
+};
+
+/*
+ * Which cores the worker threads should run on, on devices with clusters of
+ * different performance (big.LITTLE). Cores are told apart by their maximum
+ * frequency; where that is unknown, or all cores are equal, every hint
+ * behaves like kAny.
+ */
+enum class CoreAffinity {
+  kAny,
+  kBigCores,    // the fastest cluster, for frame-critical work
+  kLittleCores  // the slowest cluster, for background work
+};
+
+/*
+ * A work-stealing job scheduler. Every worker thread, and the thread that
+ * created the JobSystem, owns a Chase-Lev deque: the owner pushes and pops
+ * jobs at the bottom, and threads that run out of work steal from the top
+ * of a random victim's deque. Jobs submitted from other threads go through
+ * a locked queue.
+ *
+ * Threads waiting for a counter run jobs instead of blocking, so jobs may
+ * submit and wait for other jobs. Idle workers sleep until new work is
+ * submitted.
+ *
+ * Jobs come from a pool allocated with the JobSystem and hold their
+ * callable inline, so submitting work from the frame loop does not
+ * allocate unless more than JOB_POOL_SIZE jobs are pending at once.
+ */
+class JobSystem {
+ public:
+  // workerCount == UINT32_MAX picks one worker per core of the chosen
+  // cluster, less one for the creating thread. 0 runs everything on the
+  // threads that wait.
+  explicit JobSystem(uint32_t workerCount = UINT32_MAX,
+                     CoreAffinity affinity = CoreAffinity::kAny);
+  ~JobSystem();
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  // Threads that run jobs: the workers and the creating thread.
+  uint32_t threadCount() const {
+    return static_cast<uint32_t>(workers.size()) + 1;
+  }
+
+  /*
+   * Submits job. If counter is given it is incremented now and decremented
+   * once the job has run. If after is given the job is held back until
+   * after reaches zero.
+   */
+  template <typename Function>
+  void run(Function &&function, JobCounter *counter = nullptr,
+           JobCounter *after = nullptr) {
+    Job *job = allocateJob();
+    job->function.emplace(std::forward<Function>(function));
+    schedule(job, counter, after);
+  }
+
+  // Runs other jobs on the calling thread until counter reaches zero.
+  void wait(JobCounter &counter);
+
+  /*
+   * Calls body(first, end) over [0, count) in ranges of at most grain
+   * items, spread over all threads, and returns when every range is done.
+   */
+  template <typename Body>
+  void parallelFor(uint32_t count, uint32_t grain, const Body &body) {
+    parallelForRanges(
+        count, grain,
+        [](const void *context, uint32_t first, uint32_t end) {
+          (*static_cast<const Body *>(context))(first, end);
+        },
+        &body);
+  }
+
+ private:
+  class Deque;
+  using RangeFunction = void (*)(const void *context, uint32_t first,
+                                 uint32_t end);
+
+  static constexpr uint32_t JOB_POOL_SIZE = 4096;
+
+  Job *allocateJob();
+  void freeJob(Job *job);
+  void schedule(Job *job, JobCounter *counter, JobCounter *after);
+  void parallelForRanges(uint32_t count, uint32_t grain, RangeFunction body,
+                         const void *context);
+  void submit(Job *job);
+  void execute(Job *job);
+  Job *findJob(uint32_t self);
+  void workerMain(uint32_t index, std::vector<uint32_t> cores);
+
+  // Index 0 belongs to the creating thread, 1..n to the workers.
+  std::vector<std::unique_ptr<Deque>> deques;
+  std::vector<std::thread> workers;
+
+  std::unique_ptr<Job[]> jobPool;
+  // Top of the pool's free list: a job index plus one in the low 32 bits,
+  // 0 when empty, and a count of pops and pushes in the high 32 bits
+  // against ABA.
+  std::atomic<uint64_t> freeJobs{0};
+
+  // Jobs from threads without a deque, or whose deque is full, linked
+  // through Job::next.
+  std::mutex injectedMutex;
+  Job *injectedHead = nullptr;
+  Job *injectedTail = nullptr;
+  std::atomic<bool> hasInjected{false};
+
+  // Bumped by every submission, so a worker about to sleep can tell whether
+  // anything arrived since it last looked.
+  std::atomic<uint64_t> epoch{0};
+  std::atomic<uint32_t> sleepers{0};
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::atomic<bool> stopping{false};
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_JOB_SYSTEM_H
@@ -0,0 +1,515 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pixel_format.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// HELLOVK_PIXEL_NO_SIMD forces the scalar path, for benchmarking.
+#if defined(HELLOVK_PIXEL_NO_SIMD)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HELLOVK_PIXEL_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HELLOVK_PIXEL_SSE2 1
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#endif
+
+namespace vkt {
+
+namespace {
+
+/*
+ * round(value * maxValue / 255) for value and maxValue up to 255, without a
+ * division: (x + (x >> 8)) >> 8 divides x by 255 exactly for these ranges.
+ * The SIMD paths use the same arithmetic so all paths agree bit for bit.
+ */
+inline uint32_t scaleRound(uint32_t value, uint32_t maxValue) {
+  uint32_t x = value * maxValue + 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+// 8 to 10 bits: 1023 / 255 = 4 + 3 / 255, and 4 * value is exact.
+inline uint32_t toUnorm10(uint32_t value) {
+  return (value << 2) + scaleRound(value, 3);
+}
+
+inline uint16_t packR5G6B5(const uint8_t *pixel) {
+  return static_cast<uint16_t>((scaleRound(pixel[0], 31) << 11) |
+                               (scaleRound(pixel[1], 63) << 5) |
+                               scaleRound(pixel[2], 31));
+}
+
+inline uint16_t packB4G4R4A4(const uint8_t *pixel) {
+  return static_cast<uint16_t>(
+      (scaleRound(pixel[2], 15) << 12) | (scaleRound(pixel[1], 15) << 8) |
+      (scaleRound(pixel[0], 15) << 4) | scaleRound(pixel[3], 15));
+}
+
+inline uint32_t packA2B10G10R10(const uint8_t *pixel) {
+  return (scaleRound(pixel[3], 3) << 30) | (toUnorm10(pixel[2]) << 20) |
+         (toUnorm10(pixel[1]) << 10) | toUnorm10(pixel[0]);
+}
+
+#if HELLOVK_PIXEL_SSE2
+/*
+ * Gathers one channel of 8 RGBA8 pixels, held in two registers, into 16-bit
+ * lanes, which is as wide as scaleRound needs.
+ */
+inline __m128i channel(__m128i low, __m128i high, int index) {
+  const __m128i mask = _mm_set1_epi32(0xff);
+  return _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(low, index * 8), mask),
+                         _mm_and_si128(_mm_srli_epi32(high, index * 8), mask));
+}
+
+// scaleRound on 16-bit lanes. (x + (x >> 8)) >> 8 is the high half of
+// x * 257, one multiply instead of two shifts and an add.
+inline __m128i scaleRound(__m128i value, __m128i maxValue) {
+  __m128i x = _mm_add_epi16(_mm_mullo_epi16(value, maxValue),
+                            _mm_set1_epi16(128));
+  return _mm_mulhi_epu16(x, _mm_set1_epi16(257));
+}
+
+/*
+ * The 16-bit formats, for 4 RGBA8 pixels: R and B are scaled in the 16-bit
+ * lanes they already share, as are G and A, so no channel is gathered on
+ * its own. The shifts that place each channel in the output are one
+ * multiply-add per pair, leaving one pixel per 32-bit lane.
+ */
+inline __m128i packPairs(__m128i pixels, __m128i rbMax, __m128i gaMax,
+                         __m128i rbShift, __m128i gaShift) {
+  __m128i rb = scaleRound(_mm_and_si128(pixels, _mm_set1_epi16(0xff)), rbMax);
+  __m128i ga = scaleRound(_mm_srli_epi16(pixels, 8), gaMax);
+  return _mm_add_epi32(_mm_madd_epi16(rb, rbShift),
+                       _mm_madd_epi16(ga, gaShift));
+}
+
+// Narrows two registers of 16-bit values in 32-bit lanes to one. SSE2 only
+// packs with signed saturation, so the values are biased into range and back.
+inline __m128i narrow(__m128i low, __m128i high) {
+  const __m128i bias = _mm_set1_epi32(0x8000);
+  return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(low, bias),
+                                       _mm_sub_epi32(high, bias)),
+                       _mm_set1_epi16(-0x8000));
+}
+
+// A multiplier of low and one of high 16-bit lanes, for _mm_madd_epi16.
+inline __m128i lanePair(int16_t low, int16_t high) {
+  return _mm_set1_epi32((uint16_t(high) << 16) | uint16_t(low));
+}
+
+inline __m128i toUnorm10(__m128i value) {
+  return _mm_add_epi16(_mm_slli_epi16(value, 2),
+                       scaleRound(value, _mm_set1_epi16(3)));
+}
+#endif
+
+#if HELLOVK_PIXEL_NEON
+// scaleRound on 8 lanes, widening to 16 bits.
+inline uint16x8_t scaleRound(uint8x8_t value, uint8_t maxValue) {
+  uint16x8_t x = vmlal_u8(vdupq_n_u16(128), value, vdup_n_u8(maxValue));
+  return vshrq_n_u16(vsraq_n_u16(x, x, 8), 8);
+}
+
+inline uint16x8_t toUnorm10(uint8x8_t value) {
+  return vaddq_u16(vshll_n_u8(value, 2), scaleRound(value, 3));
+}
+
+inline uint16x8_t packR5G6B5(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+  return vorrq_u16(vorrq_u16(vshlq_n_u16(scaleRound(r, 31), 11),
+                             vshlq_n_u16(scaleRound(g, 63), 5)),
+                   scaleRound(b, 31));
+}
+
+inline uint16x8_t packB4G4R4A4(uint8x8_t r, uint8x8_t g, uint8x8_t b,
+                               uint8x8_t a) {
+  return vorrq_u16(vorrq_u16(vshlq_n_u16(scaleRound(b, 15), 12),
+                             vshlq_n_u16(scaleRound(g, 15), 8)),
+                   vorrq_u16(vshlq_n_u16(scaleRound(r, 15), 4),
+                             scaleRound(a, 15)));
+}
+
+inline void storeA2B10G10R10(uint8x8_t r, uint8x8_t g, uint8x8_t b,
+                             uint8x8_t a, uint32_t *output) {
+  uint16x8_t r10 = toUnorm10(r);
+  uint16x8_t g10 = toUnorm10(g);
+  uint16x8_t b10 = toUnorm10(b);
+  uint16x8_t a2 = scaleRound(a, 3);
+  uint32x4_t low = vorrq_u32(
+      vorrq_u32(vshlq_n_u32(vmovl_u16(vget_low_u16(a2)), 30),
+                vshlq_n_u32(vmovl_u16(vget_low_u16(b10)), 20)),
+      vorrq_u32(vshlq_n_u32(vmovl_u16(vget_low_u16(g10)), 10),
+                vmovl_u16(vget_low_u16(r10))));
+  uint32x4_t high = vorrq_u32(
+      vorrq_u32(vshlq_n_u32(vmovl_u16(vget_high_u16(a2)), 30),
+                vshlq_n_u32(vmovl_u16(vget_high_u16(b10)), 20)),
+      vorrq_u32(vshlq_n_u32(vmovl_u16(vget_high_u16(g10)), 10),
+                vmovl_u16(vget_high_u16(r10))));
+  vst1q_u32(output, low);
+  vst1q_u32(output + 4, high);
+}
+
+inline uint8x16_t premultiply(uint8x16_t color, uint8x16_t alpha) {
+  const uint16x8_t half = vdupq_n_u16(128);
+  uint16x8_t low = vmlal_u8(half, vget_low_u8(color), vget_low_u8(alpha));
+  uint16x8_t high = vmlal_u8(half, vget_high_u8(color), vget_high_u8(alpha));
+  return vcombine_u8(vshrn_n_u16(vsraq_n_u16(low, low, 8), 8),
+                     vshrn_n_u16(vsraq_n_u16(high, high, 8), 8));
+}
+#endif
+
+float srgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f
+                           : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float value) {
+  return value <= 0.0031308f ? value * 12.92f
+                             : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+const float *srgbDecodeTable() {
+  static const std::array<float, 256> table = [] {
+    std::array<float, 256> result;
+    for (int i = 0; i < 256; i++) {
+      result[i] = srgbToLinear(i / 255.0f);
+    }
+    return result;
+  }();
+  return table.data();
+}
+
+// Indexed by linear value * kSrgbEncodeScale. 16 bits of input precision
+// keep the steep segment near black exact to the nearest 8-bit code.
+const uint32_t kSrgbEncodeScale = 65535;
+
+const uint8_t *srgbEncodeTable() {
+  static const std::vector<uint8_t> table = [] {
+    std::vector<uint8_t> result(kSrgbEncodeScale + 1);
+    for (uint32_t i = 0; i <= kSrgbEncodeScale; i++) {
+      result[i] = static_cast<uint8_t>(
+          std::lround(linearToSrgb(static_cast<float>(i) / kSrgbEncodeScale) *
+                      255.0f));
+    }
+    return result;
+  }();
+  return table.data();
+}
+
+uint8_t encodeUnorm8(float value) {
+  return static_cast<uint8_t>(
+      std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+// Mean squared error of quantizing a channel histogram to maxValue levels.
+double quantizationError(const uint64_t *histogram, uint32_t maxValue) {
+  double error = 0.0;
+  for (uint32_t value = 0; value < 256; value++) {
+    if (histogram[value] == 0) {
+      continue;
+    }
+    // The GPU expands a level back to level / maxValue.
+    const double restored = scaleRound(value, maxValue) * 255.0 / maxValue;
+    const double difference = restored - value;
+    error += difference * difference * histogram[value];
+  }
+  return error;
+}
+
+}  // namespace
+
+uint32_t bytesPerPixel(PixelFormat format) {
+  switch (format) {
+    case PixelFormat::kR8G8B8A8:
+    case PixelFormat::kA2B10G10R10:
+      return 4;
+    case PixelFormat::kR5G6B5:
+    case PixelFormat::kB4G4R4A4:
+      return 2;
+  }
+  return 4;
+}
+
+void convertToR5G6B5(const uint8_t *rgba, uint16_t *output,
+                     size_t pixelCount) {
+  size_t i = 0;
+#if HELLOVK_PIXEL_NEON
+  for (; i + 16 <= pixelCount; i += 16) {
+    uint8x16x4_t pixels = vld4q_u8(rgba + i * 4);
+    vst1q_u16(output + i,
+              packR5G6B5(vget_low_u8(pixels.val[0]),
+                         vget_low_u8(pixels.val[1]),
+                         vget_low_u8(pixels.val[2])));
+    vst1q_u16(output + i + 8,
+              packR5G6B5(vget_high_u8(pixels.val[0]),
+                         vget_high_u8(pixels.val[1]),
+                         vget_high_u8(pixels.val[2])));
+  }
+#elif HELLOVK_PIXEL_SSE2
+  const __m128i rbMax = _mm_set1_epi16(31);
+  const __m128i gaMax = lanePair(63, 0);
+  const __m128i rbShift = lanePair(1 << 11, 1);
+  const __m128i gaShift = lanePair(1 << 5, 0);
+  for (; i + 8 <= pixelCount; i += 8) {
+    const auto *input = reinterpret_cast<const __m128i *>(rgba + i * 4);
+    __m128i low = packPairs(_mm_loadu_si128(input), rbMax, gaMax, rbShift,
+                            gaShift);
+    __m128i high = packPairs(_mm_loadu_si128(input + 1), rbMax, gaMax,
+                             rbShift, gaShift);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i),
+                     narrow(low, high));
+  }
+#endif
+  for (; i < pixelCount; i++) {
+    output[i] = packR5G6B5(rgba + i * 4);
+  }
+}
+
+void convertToB4G4R4A4(const uint8_t *rgba, uint16_t *output,
+                       size_t pixelCount) {
+  size_t i = 0;
+#if HELLOVK_PIXEL_NEON
+  for (; i + 16 <= pixelCount; i += 16) {
+    uint8x16x4_t pixels = vld4q_u8(rgba + i * 4);
+    vst1q_u16(output + i, packB4G4R4A4(vget_low_u8(pixels.val[0]),
+                                       vget_low_u8(pixels.val[1]),
+                                       vget_low_u8(pixels.val[2]),
+                                       vget_low_u8(pixels.val[3])));
+    vst1q_u16(output + i + 8, packB4G4R4A4(vget_high_u8(pixels.val[0]),
+                                           vget_high_u8(pixels.val[1]),
+                                           vget_high_u8(pixels.val[2]),
+                                           vget_high_u8(pixels.val[3])));
+  }
+#elif HELLOVK_PIXEL_SSE2
+  const __m128i max4 = _mm_set1_epi16(15);
+  const __m128i rbShift = lanePair(1 << 4, 1 << 12);
+  const __m128i gaShift = lanePair(1 << 8, 1);
+  for (; i + 8 <= pixelCount; i += 8) {
+    const auto *input = reinterpret_cast<const __m128i *>(rgba + i * 4);
+    __m128i low = packPairs(_mm_loadu_si128(input), max4, max4, rbShift,
+                            gaShift);
+    __m128i high = packPairs(_mm_loadu_si128(input + 1), max4, max4,
+                             rbShift, gaShift);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i),
+                     narrow(low, high));
+  }
+#endif
+  for (; i < pixelCount; i++) {
+    output[i] = packB4G4R4A4(rgba + i * 4);
+  }
+}
+
+void convertToA2B10G10R10(const uint8_t *rgba, uint32_t *output,
+                          size_t pixelCount) {
+  size_t i = 0;
+#if HELLOVK_PIXEL_NEON
+  for (; i + 16 <= pixelCount; i += 16) {
+    uint8x16x4_t pixels = vld4q_u8(rgba + i * 4);
+    storeA2B10G10R10(vget_low_u8(pixels.val[0]), vget_low_u8(pixels.val[1]),
+                     vget_low_u8(pixels.val[2]), vget_low_u8(pixels.val[3]),
+                     output + i);
+    storeA2B10G10R10(vget_high_u8(pixels.val[0]), vget_high_u8(pixels.val[1]),
+                     vget_high_u8(pixels.val[2]), vget_high_u8(pixels.val[3]),
+                     output + i + 8);
+  }
+#elif HELLOVK_PIXEL_SSE2
+  for (; i + 8 <= pixelCount; i += 8) {
+    const auto *input = reinterpret_cast<const __m128i *>(rgba + i * 4);
+    __m128i low = _mm_loadu_si128(input);
+    __m128i high = _mm_loadu_si128(input + 1);
+    __m128i r = toUnorm10(channel(low, high, 0));
+    __m128i g = toUnorm10(channel(low, high, 1));
+    __m128i b = toUnorm10(channel(low, high, 2));
+    __m128i a = scaleRound(channel(low, high, 3), _mm_set1_epi16(3));
+    // Widen back to one pixel per 32-bit lane: R and G share the low half,
+    // B and A the high half.
+    __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 10));
+    __m128i gba = _mm_or_si128(
+        _mm_or_si128(_mm_srli_epi16(g, 6), _mm_slli_epi16(b, 4)),
+        _mm_slli_epi16(a, 14));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i),
+                     _mm_unpacklo_epi16(rg, gba));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i + 4),
+                     _mm_unpackhi_epi16(rg, gba));
+  }
+#endif
+  for (; i < pixelCount; i++) {
+    output[i] = packA2B10G10R10(rgba + i * 4);
+  }
+}
+
+void convertPixels(PixelFormat format, const uint8_t *rgba, void *output,
+                   size_t pixelCount) {
+  switch (format) {
+    case PixelFormat::kR8G8B8A8:
+      if (output != rgba) {
+        memcpy(output, rgba, pixelCount * 4);
+      }
+      break;
+    case PixelFormat::kR5G6B5:
+      convertToR5G6B5(rgba, static_cast<uint16_t *>(output), pixelCount);
+      break;
+    case PixelFormat::kB4G4R4A4:
+      convertToB4G4R4A4(rgba, static_cast<uint16_t *>(output), pixelCount);
+      break;
+    case PixelFormat::kA2B10G10R10:
+      convertToA2B10G10R10(rgba, static_cast<uint32_t *>(output), pixelCount);
+      break;
+  }
+}
+
+void premultiplyAlpha(uint8_t *rgba, size_t pixelCount) {
+  size_t i = 0;
+#if HELLOVK_PIXEL_NEON
+  for (; i + 16 <= pixelCount; i += 16) {
+    uint8x16x4_t pixels = vld4q_u8(rgba + i * 4);
+    pixels.val[0] = premultiply(pixels.val[0], pixels.val[3]);
+    pixels.val[1] = premultiply(pixels.val[1], pixels.val[3]);
+    pixels.val[2] = premultiply(pixels.val[2], pixels.val[3]);
+    vst4q_u8(rgba + i * 4, pixels);
+  }
+#elif HELLOVK_PIXEL_SSE2
+  for (; i + 8 <= pixelCount; i += 8) {
+    auto *data = reinterpret_cast<__m128i *>(rgba + i * 4);
+    __m128i low = _mm_loadu_si128(data);
+    __m128i high = _mm_loadu_si128(data + 1);
+    __m128i alpha = channel(low, high, 3);
+    __m128i r = scaleRound(channel(low, high, 0), alpha);
+    __m128i g = scaleRound(channel(low, high, 1), alpha);
+    __m128i b = scaleRound(channel(low, high, 2), alpha);
+    __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    __m128i ba = _mm_or_si128(b, _mm_slli_epi16(alpha, 8));
+    _mm_storeu_si128(data, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128(data + 1, _mm_unpackhi_epi16(rg, ba));
+  }
+#endif
+  for (; i < pixelCount; i++) {
+    uint8_t *pixel = rgba + i * 4;
+    for (int c = 0; c < 3; c++) {
+      pixel[c] = static_cast<uint8_t>(scaleRound(pixel[c], pixel[3]));
+    }
+  }
+}
+
+void swizzleChannels(const uint8_t *input, uint8_t *output, size_t pixelCount,
+                     const uint8_t order[4]) {
+  size_t i = 0;
+#if HELLOVK_PIXEL_NEON
+  for (; i + 16 <= pixelCount; i += 16) {
+    uint8x16x4_t pixels = vld4q_u8(input + i * 4);
+    uint8x16x4_t result;
+    for (int c = 0; c < 4; c++) {
+      result.val[c] = pixels.val[order[c]];
+    }
+    vst4q_u8(output + i * 4, result);
+  }
+#elif HELLOVK_PIXEL_SSE2 && defined(__SSSE3__)
+  alignas(16) uint8_t shuffle[16];
+  for (int p = 0; p < 4; p++) {
+    for (int c = 0; c < 4; c++) {
+      shuffle[p * 4 + c] = static_cast<uint8_t>(p * 4 + order[c]);
+    }
+  }
+  const __m128i mask = _mm_load_si128(reinterpret_cast<__m128i *>(shuffle));
+  for (; i + 4 <= pixelCount; i += 4) {
+    __m128i pixels =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i * 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i * 4),
+                     _mm_shuffle_epi8(pixels, mask));
+  }
+#endif
+  for (; i < pixelCount; i++) {
+    uint8_t pixel[4];
+    memcpy(pixel, input + i * 4, 4);
+    for (int c = 0; c < 4; c++) {
+      output[i * 4 + c] = pixel[order[c]];
+    }
+  }
+}
+
+void decodeSrgb(const uint8_t *rgba, float *linear, size_t pixelCount) {
+  const float *table = srgbDecodeTable();
+  for (size_t i = 0; i < pixelCount * 4; i += 4) {
+    linear[i] = table[rgba[i]];
+    linear[i + 1] = table[rgba[i + 1]];
+    linear[i + 2] = table[rgba[i + 2]];
+    linear[i + 3] = rgba[i + 3] / 255.0f;
+  }
+}
+
+void encodeSrgb(const float *linear, uint8_t *rgba, size_t pixelCount) {
+  const uint8_t *table = srgbEncodeTable();
+  auto index = [](float value) {
+    return static_cast<uint32_t>(
+        std::clamp(value, 0.0f, 1.0f) * kSrgbEncodeScale + 0.5f);
+  };
+  for (size_t i = 0; i < pixelCount * 4; i += 4) {
+    rgba[i] = table[index(linear[i])];
+    rgba[i + 1] = table[index(linear[i + 1])];
+    rgba[i + 2] = table[index(linear[i + 2])];
+    rgba[i + 3] = encodeUnorm8(linear[i + 3]);
+  }
+}
+
+PixelFormat choosePixelFormat(const uint8_t *rgba, size_t pixelCount,
+                              const FormatPolicy &policy) {
+  if (!policy.allowLowPrecision || policy.srgb || pixelCount == 0) {
+    return PixelFormat::kR8G8B8A8;
+  }
+
+  // Quantization error only depends on the value distribution of each
+  // channel, so one pass building histograms is enough.
+  std::vector<uint64_t> histograms(4 * 256, 0);
+  for (size_t i = 0; i < pixelCount * 4; i += 4) {
+    histograms[rgba[i]]++;
+    histograms[256 + rgba[i + 1]]++;
+    histograms[512 + rgba[i + 2]]++;
+    histograms[768 + rgba[i + 3]]++;
+  }
+  const bool opaque = histograms[768 + 255] == pixelCount;
+
+  auto psnr = [&](const uint32_t *maxValues, int channels) {
+    double error = 0.0;
+    for (int c = 0; c < channels; c++) {
+      error += quantizationError(histograms.data() + c * 256, maxValues[c]);
+    }
+    const double meanError =
+        error / (static_cast<double>(pixelCount) * channels);
+    return meanError == 0.0 ? INFINITY
+                            : 10.0 * std::log10(255.0 * 255.0 / meanError);
+  };
+
+  if (opaque) {
+    const uint32_t r5g6b5[3] = {31, 63, 31};
+    if (psnr(r5g6b5, 3) >= policy.minPsnr) {
+      return PixelFormat::kR5G6B5;
+    }
+  }
+  const uint32_t b4g4r4a4[4] = {15, 15, 15, 15};
+  if (psnr(b4g4r4a4, 4) >= policy.minPsnr) {
+    return PixelFormat::kB4G4R4A4;
+  }
+  return PixelFormat::kR8G8B8A8;
+}
+
+}  // namespace vkt
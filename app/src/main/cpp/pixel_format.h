@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_PIXEL_FORMAT_H
+#define HELLOVK_PIXEL_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Conversion kernels from tightly packed RGBA8 pixels to the smaller texture
+ * formats, plus the per-pixel operations done while preparing textures.
+ * Kernels use NEON on ARM and SSE2 on x86, with a scalar path for the tail and
+ * for other targets; all paths produce identical results.
+ *
+ * Packed formats follow the bit layout of the Vulkan format of the same name,
+ * and only formats every Vulkan implementation must support for sampling are
+ * offered (hence B4G4R4A4 rather than R4G4B4A4).
+ */
+
+namespace vkt {
+
+enum class PixelFormat {
+  kR8G8B8A8,
+  kR5G6B5,      // VK_FORMAT_R5G6B5_UNORM_PACK16
+  kB4G4R4A4,    // VK_FORMAT_B4G4R4A4_UNORM_PACK16
+  kA2B10G10R10  // VK_FORMAT_A2B10G10R10_UNORM_PACK32
+};
+
+uint32_t bytesPerPixel(PixelFormat format);
+
+// Channels are rounded to the nearest representable value.
+void convertToR5G6B5(const uint8_t *rgba, uint16_t *output, size_t pixelCount);
+void convertToB4G4R4A4(const uint8_t *rgba, uint16_t *output,
+                       size_t pixelCount);
+void convertToA2B10G10R10(const uint8_t *rgba, uint32_t *output,
+                          size_t pixelCount);
+
+// Converts to any format; output must hold bytesPerPixel(format) per pixel.
+void convertPixels(PixelFormat format, const uint8_t *rgba, void *output,
+                   size_t pixelCount);
+
+// Multiplies the colour channels by alpha, in place.
+void premultiplyAlpha(uint8_t *rgba, size_t pixelCount);
+
+/*
+ * Reorders the channels of each pixel: output channel i is input channel
+ * order[i], e.g. {2, 1, 0, 3} converts between RGBA and BGRA. input and
+ * output may be the same buffer.
+ */
+void swizzleChannels(const uint8_t *input, uint8_t *output, size_t pixelCount,
+                     const uint8_t order[4]);
+
+/*
+ * Table based conversions between sRGB encoded RGBA8 and linear floats.
+ * Alpha is always linear and only rescaled.
+ */
+void decodeSrgb(const uint8_t *rgba, float *linear, size_t pixelCount);
+void encodeSrgb(const float *linear, uint8_t *rgba, size_t pixelCount);
+
+struct FormatPolicy {
+  // Allow 16 bit formats at all, e.g. false for UI or normal maps.
+  bool allowLowPrecision = true;
+  // Lowest peak signal-to-noise ratio, in dB, a smaller format may have
+  // compared to the RGBA8 source.
+  double minPsnr = 40.0;
+  // The image is sRGB encoded colour. Only formats with an _SRGB Vulkan
+  // variant qualify, so the sampler can decode before filtering; none of
+  // the packed 16-bit formats has one.
+  bool srgb = false;
+};
+
+/*
+ * Picks the smallest format that represents the image adequately: R5G6B5 for
+ * opaque images, B4G4R4A4 otherwise, when their quantization error meets the
+ * policy, and R8G8B8A8 in every other case, including sRGB images.
+ * A2B10G10R10 is never smaller than the source and is only used on request.
+ */
+PixelFormat choosePixelFormat(const uint8_t *rgba, size_t pixelCount,
+                              const FormatPolicy &policy);
+
+}  // namespace vkt
+
+#endif  // HELLOVK_PIXEL_FORMAT_H
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_PLATFORM_H
+#define HELLOVK_PLATFORM_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * The few things the renderer needs from the operating system: a log,
+ * settings, read access to assets, and a surface to present to. HelloVK
+ * only talks to the interfaces below; platform_android.cpp implements them
+ * on top of the NDK and platform_linux.cpp on top of POSIX files and
+ * VK_EXT_headless_surface, so the renderer core also builds and runs on
+ * desktop Linux.
+ */
+
+#if defined(__ANDROID__)
+struct AAssetManager;
+struct ANativeWindow;
+#endif
+
+namespace vkt {
+
+enum class LogLevel { kInfo, kError };
+
+// Formats a message printf style and sends it to the platform log.
+void logMessage(LogLevel level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#define LOGI(...) ::vkt::logMessage(::vkt::LogLevel::kInfo, __VA_ARGS__)
+#define LOGE(...) ::vkt::logMessage(::vkt::LogLevel::kError, __VA_ARGS__)
+
+// A setting that can be changed without a rebuild: the system property
+// debug.hellovk.<name> on Android (adb shell setprop), and the environment
+// variable HELLOVK_<NAME> elsewhere. Empty if it is not set.
+std::string readSetting(const char *name);
+
+// The contents of an asset, valid for the lifetime of the object.
+class Asset {
+ public:
+  virtual ~Asset() = default;
+  virtual const uint8_t *data() const = 0;
+  virtual size_t size() const = 0;
+};
+
+class AssetSource {
+ public:
+  virtual ~AssetSource() = default;
+  // Returns null if there is no asset at path. Implementations map the
+  // asset where they can instead of reading it.
+  virtual std::unique_ptr<Asset> open(const char *path) = 0;
+};
+
+/*
+ * Where the swapchain presents: the Android window, or an offscreen
+ * headless surface on desktop.
+ */
+class SurfaceProvider {
+ public:
+  virtual ~SurfaceProvider() = default;
+  // The instance extension createSurface needs, besides VK_KHR_surface.
+  virtual const char *instanceExtension() const = 0;
+  virtual VkResult createSurface(VkInstance instance,
+                                 VkSurfaceKHR *surface) = 0;
+  // Used when the surface leaves the swapchain size up to the application.
+  virtual VkExtent2D windowExtent() const = 0;
+};
+
+#if defined(__ANDROID__)
+// Assets come from the APK. The surface provider holds a reference to the
+// window for as long as it exists.
+std::unique_ptr<AssetSource> createAndroidAssetSource(
+    AAssetManager *assetManager);
+std::unique_ptr<SurfaceProvider> createAndroidSurfaceProvider(
+    ANativeWindow *window);
+#else
+// Assets are looked up in each directory in turn. The surface is a
+// VK_EXT_headless_surface of a fixed size, which needs no window system.
+std::unique_ptr<AssetSource> createFileAssetSource(
+    std::vector<std::string> directories);
+std::unique_ptr<SurfaceProvider> createHeadlessSurfaceProvider(
+    VkExtent2D extent);
+#endif
+
+}  // namespace vkt
+
+#endif  // HELLOVK_PLATFORM_H
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_window.h>
+#include <sys/system_properties.h>
+
+#include <cstdarg>
+#include <cstdio>
+
+#include "platform.h"
+
+namespace vkt {
+
+namespace {
+
+const char *const LOG_TAG = "hellovkjni";
+
+class AndroidAsset : public Asset {
+ public:
+  AndroidAsset(AAsset *asset, const void *buffer)
+      : asset(asset), buffer(static_cast<const uint8_t *>(buffer)) {}
+  ~AndroidAsset() override { AAsset_close(asset); }
+  const uint8_t *data() const override { return buffer; }
+  size_t size() const override { return AAsset_getLength(asset); }
+
+ private:
+  AAsset *asset;
+  const uint8_t *buffer;
+};
+
+class AndroidAssetSource : public AssetSource {
+ public:
+  explicit AndroidAssetSource(AAssetManager *assetManager)
+      : assetManager(assetManager) {}
+
+  std::unique_ptr<Asset> open(const char *path) override {
+    AAsset *asset =
+        AAssetManager_open(assetManager, path, AASSET_MODE_BUFFER);
+    if (asset == nullptr) {
+      return nullptr;
+    }
+    // Maps assets stored uncompressed in the APK, and inflates the others.
+    const void *buffer = AAsset_getBuffer(asset);
+    if (buffer == nullptr) {
+      AAsset_close(asset);
+      return nullptr;
+    }
+    return std::make_unique<AndroidAsset>(asset, buffer);
+  }
+
+ private:
+  AAssetManager *assetManager;
+};
+
+class AndroidSurfaceProvider : public SurfaceProvider {
+ public:
+  explicit AndroidSurfaceProvider(ANativeWindow *window) : window(window) {
+    ANativeWindow_acquire(window);
+  }
+  ~AndroidSurfaceProvider() override { ANativeWindow_release(window); }
+
+  const char *instanceExtension() const override {
+    return VK_KHR_ANDROID_SURFACE_EXTENSION_NAME;
+  }
+
+  VkResult createSurface(VkInstance instance,
+                         VkSurfaceKHR *surface) override {
+    const VkAndroidSurfaceCreateInfoKHR createInfo{
+        .sType = VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR,
+        .pNext = nullptr,
+        .flags = 0,
+        .window = window};
+    return vkCreateAndroidSurfaceKHR(instance, &createInfo,
+                                     nullptr /* pAllocator */, surface);
+  }
+
+  VkExtent2D windowExtent() const override {
+    return {static_cast<uint32_t>(ANativeWindow_getWidth(window)),
+            static_cast<uint32_t>(ANativeWindow_getHeight(window))};
+  }
+
+ private:
+  ANativeWindow *window;
+};
+
+}  // namespace
+
+void logMessage(LogLevel level, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  __android_log_vprint(
+      level == LogLevel::kError ? ANDROID_LOG_ERROR : ANDROID_LOG_INFO,
+      LOG_TAG, format, args);
+  va_end(args);
+}
+
+std::string readSetting(const char *name) {
+  char property[PROP_NAME_MAX];
+  snprintf(property, sizeof(property), "debug.hellovk.%s", name);
+  char value[PROP_VALUE_MAX] = {};
+  __system_property_get(property, value);
+  return value;
+}
+
+std::unique_ptr<AssetSource> createAndroidAssetSource(
+    AAssetManager *assetManager) {
+  return std::make_unique<AndroidAssetSource>(assetManager);
+}
+
+std::unique_ptr<SurfaceProvider> createAndroidSurfaceProvider(
+    ANativeWindow *window) {
+  return std::make_unique<AndroidSurfaceProvider>(window);
+}
+
+}  // namespace vkt
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+#include "platform.h"
+
+namespace vkt {
+
+namespace {
+
+class MappedAsset : public Asset {
+ public:
+  MappedAsset(void *mapping, size_t length)
+      : mapping(mapping), length(length) {}
+  ~MappedAsset() override { munmap(mapping, length); }
+  const uint8_t *data() const override {
+    return static_cast<const uint8_t *>(mapping);
+  }
+  size_t size() const override { return length; }
+
+ private:
+  void *mapping;
+  size_t length;
+};
+
+// mmap cannot map an empty file, so those get a buffer of their own.
+class EmptyAsset : public Asset {
+ public:
+  const uint8_t *data() const override { return &placeholder; }
+  size_t size() const override { return 0; }
+
+ private:
+  uint8_t placeholder = 0;
+};
+
+class FileAssetSource : public AssetSource {
+ public:
+  explicit FileAssetSource(std::vector<std::string> directories)
+      : directories(std::move(directories)) {}
+
+  std::unique_ptr<Asset> open(const char *path) override {
+    for (const std::string &directory : directories) {
+      const std::string fullPath = directory + "/" + path;
+      const int fd = ::open(fullPath.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        continue;
+      }
+      struct stat status;
+      std::unique_ptr<Asset> asset;
+      if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode)) {
+        const size_t length = status.st_size;
+        void *mapping = length > 0 ? mmap(nullptr, length, PROT_READ,
+                                          MAP_PRIVATE, fd, 0)
+                                   : MAP_FAILED;
+        if (mapping != MAP_FAILED) {
+          asset = std::make_unique<MappedAsset>(mapping, length);
+        } else if (length == 0) {
+          asset = std::make_unique<EmptyAsset>();
+        }
+      }
+      close(fd);
+      if (asset != nullptr) {
+        return asset;
+      }
+    }
+    return nullptr;
+  }
+
+ private:
+  std::vector<std::string> directories;
+};
+
+class HeadlessSurfaceProvider : public SurfaceProvider {
+ public:
+  explicit HeadlessSurfaceProvider(VkExtent2D extent) : extent(extent) {}
+
+  const char *instanceExtension() const override {
+    return VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME;
+  }
+
+  VkResult createSurface(VkInstance instance,
+                         VkSurfaceKHR *surface) override {
+    // The loader does not export extension entry points like this one.
+    auto createHeadlessSurface =
+        reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+            vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT"));
+    if (createHeadlessSurface == nullptr) {
+      return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+    VkHeadlessSurfaceCreateInfoEXT createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+    return createHeadlessSurface(instance, &createInfo,
+                                 nullptr /* pAllocator */, surface);
+  }
+
+  VkExtent2D windowExtent() const override { return extent; }
+
+ private:
+  VkExtent2D extent;
+};
+
+}  // namespace
+
+void logMessage(LogLevel level, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  FILE *stream = level == LogLevel::kError ? stderr : stdout;
+  vfprintf(stream, format, args);
+  fputc('\n', stream);
+  va_end(args);
+}
+
+std::string readSetting(const char *name) {
+  std::string variable = "HELLOVK_";
+  for (const char *c = name; *c != 0; c++) {
+    variable += static_cast<char>(toupper(static_cast<unsigned char>(*c)));
+  }
+  const char *value = getenv(variable.c_str());
+  return value != nullptr ? value : "";
+}
+
+std::unique_ptr<AssetSource> createFileAssetSource(
+    std::vector<std::string> directories) {
+  return std::make_unique<FileAssetSource>(std::move(directories));
+}
+
+std::unique_ptr<SurfaceProvider> createHeadlessSurfaceProvider(
+    VkExtent2D extent) {
+  return std::make_unique<HeadlessSurfaceProvider>(extent);
+}
+
+}  // namespace vkt
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scene_graph.h"
+
+#include <assert.h>
+
+#include <algorithm>
+
+#include "job_system.h"
+
+namespace vkt {
+
+namespace {
+
+// Below this many nodes per thread, handing work to other threads costs
+// more than the matrix work they would take over.
+const uint32_t PARALLEL_MIN_NODES_PER_THREAD = 2048;
+
+}  // namespace
+
+uint32_t SceneGraph::addNode(uint32_t parent, const glm::vec3 &position,
+                             const glm::quat &rotation,
+                             const glm::vec3 &scale) {
+  const uint32_t node = size();
+  // The parent's subtree must end here, or the new node would split another
+  // subtree.
+  assert(parent == kNoParent || subtreeEnds[parent] == node);
+  for (uint32_t p = parent; p != kNoParent; p = parents[p]) {
+    subtreeEnds[p]++;
+  }
+  parents.push_back(parent);
+  subtreeEnds.push_back(node + 1);
+  locals.resize(node + 1);
+  locals.set(node, position, rotation, scale);
+  worlds.emplace_back(1.0f);
+  dirty.push_back(0);
+  markDirty(node);
+  return node;
+}
+
+void SceneGraph::setLocal(uint32_t node, const glm::vec3 &position,
+                          const glm::quat &rotation, const glm::vec3 &scale) {
+  locals.set(node, position, rotation, scale);
+  markDirty(node);
+}
+
+void SceneGraph::setPosition(uint32_t node, const glm::vec3 &position) {
+  locals.set(node, position, locals.rotation(node), locals.scale(node));
+  markDirty(node);
+}
+
+void SceneGraph::setRotation(uint32_t node, const glm::quat &rotation) {
+  locals.set(node, locals.position(node), rotation, locals.scale(node));
+  markDirty(node);
+}
+
+void SceneGraph::markDirty(uint32_t node) {
+  if (!dirty[node]) {
+    dirty[node] = 1;
+    dirtyNodes.push_back(node);
+  }
+}
+
+void SceneGraph::updateRange(uint32_t first, uint32_t end) {
+  // Local matrices go straight into the world array and are then multiplied
+  // by the parent in place; the parent is either earlier in this range or
+  // outside it and already up to date.
+  locals.computeMatrices(first, end - first, glm::mat4(1.0f), &worlds[first],
+                         nullptr);
+  for (uint32_t i = first; i < end; i++) {
+    if (parents[i] != kNoParent) {
+      worlds[i] = worlds[parents[i]] * worlds[i];
+    }
+  }
+}
+
+uint32_t SceneGraph::update(JobSystem *jobs) {
+  if (dirtyNodes.empty()) {
+    return 0;
+  }
+
+  // A dirty node's subtree covers any dirty descendants, so after sorting
+  // each node either starts a new range or falls inside the previous one.
+  std::sort(dirtyNodes.begin(), dirtyNodes.end());
+  ranges.clear();
+  uint32_t nodeCount = 0;
+  for (uint32_t node : dirtyNodes) {
+    dirty[node] = 0;
+    if (!ranges.empty() && node < ranges.back().second) {
+      continue;
+    }
+    ranges.emplace_back(node, subtreeEnds[node]);
+    nodeCount += subtreeEnds[node] - node;
+  }
+  dirtyNodes.clear();
+
+  uint32_t threadCount = 1;
+  if (jobs != nullptr) {
+    threadCount = std::max(
+        1u, std::min(jobs->threadCount(),
+                     nodeCount / PARALLEL_MIN_NODES_PER_THREAD));
+  }
+  if (threadCount == 1) {
+    for (const auto &range : ranges) {
+      updateRange(range.first, range.second);
+    }
+    return nodeCount;
+  }
+
+  // Split large ranges so the threads get comparable shares: update the
+  // range's root here, after which each child subtree only depends on it.
+  // The first child takes over the slot and is looked at again.
+  const uint32_t target = nodeCount / (threadCount * 4) + 1;
+  for (size_t r = 0; r < ranges.size();) {
+    const uint32_t first = ranges[r].first;
+    const uint32_t end = ranges[r].second;
+    if (end - first <= target) {
+      r++;
+      continue;
+    }
+    updateRange(first, first + 1);
+    ranges[r] = {first + 1, subtreeEnds[first + 1]};
+    for (uint32_t child = subtreeEnds[first + 1]; child < end;
+         child = subtreeEnds[child]) {
+      ranges.emplace_back(child, subtreeEnds[child]);
+    }
+  }
+  // Largest first, so the small ones fill in the gaps at the end.
+  std::sort(ranges.begin(), ranges.end(), [](const auto &a, const auto &b) {
+    return a.second - a.first > b.second - b.first;
+  });
+
+  jobs->parallelFor(static_cast<uint32_t>(ranges.size()), 1,
+                    [this](uint32_t first, uint32_t end) {
+                      for (uint32_t r = first; r < end; r++) {
+                        updateRange(ranges[r].first, ranges[r].second);
+                      }
+                    });
+  return nodeCount;
+}
+
+}  // namespace vkt
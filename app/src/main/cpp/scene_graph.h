@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_SCENE_GRAPH_H
+#define HELLOVK_SCENE_GRAPH_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "transform_batch.h"
+
+namespace vkt {
+
+class JobSystem;
+
+/*
+ * SceneGraph stores a transform hierarchy as flat arrays indexed by node:
+ * parent index, local translation/rotation/scale (in a TransformBatch),
+ * world matrix and a dirty bit.
+ *
+ * Nodes are kept in depth-first order, so every parent comes before its
+ * children and each subtree occupies a contiguous range of indices. Moving
+ * a node marks it dirty; update() then recomputes only the ranges under
+ * dirty nodes, walking each one front to back so a parent's world matrix is
+ * always ready before its children read it. A frame in which nothing moved
+ * costs nothing beyond clearing an empty list.
+ */
+class SceneGraph {
+ public:
+  static constexpr uint32_t kNoParent = UINT32_MAX;
+
+  uint32_t size() const { return static_cast<uint32_t>(parents.size()); }
+
+  /*
+   * Appends a node and returns its index. To keep subtrees contiguous the
+   * parent must be kNoParent or the last node added or one of its
+   * ancestors, i.e. nodes are added in depth-first order.
+   */
+  uint32_t addNode(uint32_t parent, const glm::vec3 &position,
+                   const glm::quat &rotation, const glm::vec3 &scale);
+
+  void setLocal(uint32_t node, const glm::vec3 &position,
+                const glm::quat &rotation, const glm::vec3 &scale);
+  void setPosition(uint32_t node, const glm::vec3 &position);
+  void setRotation(uint32_t node, const glm::quat &rotation);
+
+  uint32_t parent(uint32_t node) const { return parents[node]; }
+  // One past the last node of the subtree rooted at node.
+  uint32_t subtreeEnd(uint32_t node) const { return subtreeEnds[node]; }
+  const TransformBatch &localTransforms() const { return locals; }
+
+  // Valid for every node after update().
+  const glm::mat4 &world(uint32_t node) const { return worlds[node]; }
+  const glm::mat4 *worldMatrices() const { return worlds.data(); }
+
+  /*
+   * Brings the world matrices of all dirty subtrees up to date and returns
+   * the number of nodes recomputed. Disjoint subtrees are independent, so
+   * given a job system and enough work they are spread over its threads.
+   */
+  uint32_t update(JobSystem *jobs = nullptr);
+
+ private:
+  void markDirty(uint32_t node);
+  void updateRange(uint32_t first, uint32_t end);
+
+  std::vector<uint32_t> parents;
+  std::vector<uint32_t> subtreeEnds;
+  TransformBatch locals;
+  std::vector<glm::mat4> worlds;
+  std::vector<uint8_t> dirty;
+  // Nodes whose dirty bit is set, in the order they were marked.
+  std::vector<uint32_t> dirtyNodes;
+  // Scratch for update(), kept to avoid allocating every frame.
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_SCENE_GRAPH_H
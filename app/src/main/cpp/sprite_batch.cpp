@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sprite_batch.h"
+
+#include <cstddef>
+
+namespace vkt {
+
+void SpriteBatch::begin(SpriteInstance *mappedInstances, uint32_t capacity) {
+  instances = mappedInstances;
+  instanceCapacity = capacity;
+  instanceCount = 0;
+}
+
+bool SpriteBatch::draw(const AtlasEntry &entry, float x, float y, float width,
+                       float height, uint32_t color, float rotation) {
+  if (instanceCount == instanceCapacity) {
+    return false;
+  }
+  // Build the instance locally and store it with one write, mapped memory is
+  // usually write-combined and should not be read or written piecemeal.
+  SpriteInstance instance;
+  instance.center[0] = x;
+  instance.center[1] = y;
+  instance.halfSize[0] = width * 0.5f;
+  instance.halfSize[1] = height * 0.5f;
+  instance.uvRect[0] = entry.u0;
+  instance.uvRect[1] = entry.v0;
+  instance.uvRect[2] = entry.u1;
+  instance.uvRect[3] = entry.v1;
+  instance.rotation = rotation;
+  instance.color = color;
+  instances[instanceCount++] = instance;
+  return true;
+}
+
+uint32_t SpriteBatch::end() {
+  instances = nullptr;
+  return instanceCount;
+}
+
+void SpriteBatch::record(VkCommandBuffer commandBuffer, VkBuffer instanceBuffer,
+                         VkDeviceSize offset, VkBuffer indexBuffer) const {
+  if (instanceCount == 0) {
+    return;
+  }
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &instanceBuffer, &offset);
+  vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+  vkCmdDrawIndexed(commandBuffer, 6, instanceCount, 0, 0, 0);
+}
+
+VkVertexInputBindingDescription SpriteBatch::bindingDescription() {
+  VkVertexInputBindingDescription binding{};
+  binding.binding = 0;
+  binding.stride = sizeof(SpriteInstance);
+  binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+  return binding;
+}
+
+std::array<VkVertexInputAttributeDescription, 5>
+SpriteBatch::attributeDescriptions() {
+  std::array<VkVertexInputAttributeDescription, 5> attributes{};
+  attributes[0] = {0, 0, VK_FORMAT_R32G32_SFLOAT,
+                   offsetof(SpriteInstance, center)};
+  attributes[1] = {1, 0, VK_FORMAT_R32G32_SFLOAT,
+                   offsetof(SpriteInstance, halfSize)};
+  attributes[2] = {2, 0, VK_FORMAT_R32G32B32A32_SFLOAT,
+                   offsetof(SpriteInstance, uvRect)};
+  attributes[3] = {3, 0, VK_FORMAT_R32_SFLOAT,
+                   offsetof(SpriteInstance, rotation)};
+  attributes[4] = {4, 0, VK_FORMAT_R8G8B8A8_UNORM,
+                   offsetof(SpriteInstance, color)};
+  return attributes;
+}
+
+}  // namespace vkt
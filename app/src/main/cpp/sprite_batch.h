@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_SPRITE_BATCH_H
+#define HELLOVK_SPRITE_BATCH_H
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+
+#include "texture_atlas.h"
+
+namespace vkt {
+
+// Index buffer contents for the batch: the four corners of a sprite, which
+// shaders/sprite.vert generates from gl_VertexIndex, as two triangles.
+const uint16_t SPRITE_QUAD_INDICES[6] = {0, 1, 2, 2, 3, 0};
+
+/*
+ * Per-instance vertex data consumed by shaders/sprite.vert. Each instance
+ * expands to one quad, so the whole batch is drawn with a single
+ * vkCmdDrawIndexed.
+ */
+struct SpriteInstance {
+  float center[2];
+  float halfSize[2];
+  // u0, v0, u1, v1 of the sprite inside the atlas.
+  float uvRect[4];
+  float rotation;
+  // RGBA8 tint, unpacked by the VK_FORMAT_R8G8B8A8_UNORM attribute.
+  uint32_t color;
+};
+
+/*
+ * SpriteBatch writes sprite instances straight into a persistently mapped
+ * vertex buffer (see MemoryUsage::kDynamic) and records them as one instanced
+ * draw. Every sprite samples the same atlas, so the batch needs one
+ * descriptor set no matter how many different images it shows.
+ */
+class SpriteBatch {
+ public:
+  void begin(SpriteInstance *mappedInstances, uint32_t capacity);
+  // Returns false once the batch is full.
+  bool draw(const AtlasEntry &entry, float x, float y, float width,
+            float height, uint32_t color = 0xffffffff, float rotation = 0.0f);
+  uint32_t end();
+
+  // indexBuffer holds SPRITE_QUAD_INDICES.
+  void record(VkCommandBuffer commandBuffer, VkBuffer instanceBuffer,
+              VkDeviceSize offset, VkBuffer indexBuffer) const;
+
+  static VkVertexInputBindingDescription bindingDescription();
+  static std::array<VkVertexInputAttributeDescription, 5>
+  attributeDescriptions();
+
+ private:
+  SpriteInstance *instances = nullptr;
+  uint32_t instanceCapacity = 0;
+  uint32_t instanceCount = 0;
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_SPRITE_BATCH_H
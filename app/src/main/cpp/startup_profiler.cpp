@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "startup_profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#include "platform.h"
+
+namespace vkt {
+
+void StartupProfiler::start() {
+  std::lock_guard<std::mutex> lock(mutex);
+  originNs = traceNowNs();
+  firstPresentNs = 0;
+  mainThread = std::this_thread::get_id();
+  stages.clear();
+  running.store(true, std::memory_order_release);
+}
+
+void StartupProfiler::setReportPath(std::string path) {
+  std::lock_guard<std::mutex> lock(mutex);
+  reportPath = std::move(path);
+}
+
+void StartupProfiler::addStage(const char *name, uint64_t startNs,
+                               uint64_t endNs) {
+  record({name, startNs, endNs, false, false});
+}
+
+void StartupProfiler::addEvent(const char *name) {
+  const uint64_t nowNs = traceNowNs();
+  record({name, nowNs, nowNs, false, true});
+}
+
+void StartupProfiler::record(const Stage &stage) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!active() || stages.size() == stages.capacity()) {
+    return;
+  }
+  stages.push_back(stage);
+  stages[stages.size() - 1].mainThread =
+      std::this_thread::get_id() == mainThread;
+}
+
+void StartupProfiler::markFirstPresent() {
+  const uint64_t nowNs = traceNowNs();
+  std::lock_guard<std::mutex> lock(mutex);
+  if (active() && firstPresentNs == 0) {
+    firstPresentNs = nowNs;
+  }
+}
+
+void StartupProfiler::finish(bool failed) {
+  // Logging and writing the file happen after the lock is released, so
+  // other threads recording into the profiler never wait on them.
+  Launch launch;
+  launch.completeNs = traceNowNs();
+  launch.failed = failed;
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!active()) {
+      return;
+    }
+    running.store(false, std::memory_order_release);
+    launch.stages = stages;
+    launch.originNs = originNs;
+    launch.firstPresentNs = firstPresentNs;
+    path = reportPath;
+  }
+  std::sort(launch.stages.begin(), launch.stages.end(),
+            [](const Stage &a, const Stage &b) {
+              return a.startNs < b.startNs;
+            });
+  logLaunch(launch);
+  if (!path.empty()) {
+    writeReport(launch, path);
+  }
+}
+
+void StartupProfiler::logLaunch(const Launch &launch) {
+  const uint64_t originNs = launch.originNs;
+  uint64_t busyNs = 0;
+  LOGI("  %-24s %7s %9s", "startup stage (ms)", "start", "duration");
+  for (const Stage &stage : launch.stages) {
+    if (stage.event) {
+      LOGI("  %-24s %7.2f", stage.name, (stage.startNs - originNs) / 1e6);
+      continue;
+    }
+    LOGI("  %-24s %7.2f %9.2f%s", stage.name,
+         (stage.startNs - originNs) / 1e6, (stage.endNs - stage.startNs) / 1e6,
+         stage.mainThread ? "" : "  (worker)");
+    busyNs += stage.endNs - stage.startNs;
+  }
+  LOGI("Startup: first present at %.2f ms, %s at %.2f ms, "
+       "%.2f ms of stages",
+       launch.firstPresentNs ? (launch.firstPresentNs - originNs) / 1e6 : 0.0,
+       launch.failed ? "failed" : "complete",
+       (launch.completeNs - originNs) / 1e6, busyNs / 1e6);
+}
+
+void StartupProfiler::writeReport(const Launch &launch,
+                                  const std::string &path) {
+  FILE *file = fopen(path.c_str(), "a");
+  if (file == nullptr) {
+    LOGE("Cannot append the startup report to %s", path.c_str());
+    return;
+  }
+  const uint64_t originNs = launch.originNs;
+  fprintf(file,
+          "{\"time\": %lld, \"first_present_ms\": %.2f, "
+          "\"complete_ms\": %.2f, \"failed\": %s, \"events\": [",
+          static_cast<long long>(time(nullptr)),
+          launch.firstPresentNs ? (launch.firstPresentNs - originNs) / 1e6
+                                : 0.0,
+          (launch.completeNs - originNs) / 1e6,
+          launch.failed ? "true" : "false");
+  const char *separator = "";
+  for (const Stage &stage : launch.stages) {
+    if (stage.event) {
+      fprintf(file, "%s[\"%s\", %.2f]", separator, stage.name,
+              (stage.startNs - originNs) / 1e6);
+      separator = ", ";
+    }
+  }
+  fprintf(file, "], \"stages\": [");
+  separator = "";
+  for (const Stage &stage : launch.stages) {
+    if (!stage.event) {
+      fprintf(file, "%s[\"%s\", %.2f, %.2f, \"%s\"]", separator, stage.name,
+              (stage.startNs - originNs) / 1e6,
+              (stage.endNs - stage.startNs) / 1e6,
+              stage.mainThread ? "main" : "worker");
+      separator = ", ";
+    }
+  }
+  fprintf(file, "]}\n");
+  fclose(file);
+}
+
+}  // namespace vkt
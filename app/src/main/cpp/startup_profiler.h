@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_STARTUP_PROFILER_H
+#define HELLOVK_STARTUP_PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "fixed_vector.h"
+#include "trace.h"
+
+namespace vkt {
+
+/*
+ * Records when each stage of a launch ran and on which thread, relative to
+ * start(), so the stages initVulkan runs concurrently can be told apart
+ * from the ones on its critical path, along with lifecycle events and the
+ * time to the first present. finish() logs a table and appends the launch
+ * to the report file as one line of JSON:
+ *
+ *   {"time": 1700000000, "first_present_ms": 180.41, "complete_ms": 212.07,
+ *    "failed": false, "events": [["APP_CMD_START", 0.35], ...],
+ *    "stages": [["createInstance", 0.52, 41.30, "main"], ...]}
+ *
+ * where stages are [name, start, duration, thread] in milliseconds, so runs
+ * of different builds can be lined up stage by stage. Everything may be
+ * called from any thread.
+ */
+class StartupProfiler {
+ public:
+  // Forgets the previous launch and records from now on, until finish().
+  void start();
+  bool active() const { return running.load(std::memory_order_acquire); }
+  // Where finish() appends its line. Empty, the default, only logs.
+  void setReportPath(std::string path);
+
+  void addStage(const char *name, uint64_t startNs, uint64_t endNs);
+  // A point in time, e.g. a lifecycle callback. name must outlive the
+  // launch.
+  void addEvent(const char *name);
+  // Only the first call of a launch counts.
+  void markFirstPresent();
+  // The launch is complete: reports it and stops recording. A failed launch
+  // ended without ever being usable, e.g. its texture did not load.
+  void finish(bool failed = false);
+
+ private:
+  struct Stage {
+    const char *name;
+    uint64_t startNs;
+    uint64_t endNs;
+    bool mainThread;  // the thread that called start()
+    bool event;
+  };
+
+  // A finished launch, copied out of the profiler to be reported without
+  // holding its lock.
+  struct Launch {
+    FixedVector<Stage, 48> stages;
+    uint64_t originNs;
+    uint64_t firstPresentNs;
+    uint64_t completeNs;
+    bool failed;
+  };
+
+  void record(const Stage &stage);
+  static void logLaunch(const Launch &launch);
+  static void writeReport(const Launch &launch, const std::string &path);
+
+  std::mutex mutex;
+  std::atomic<bool> running{false};
+  uint64_t originNs = 0;
+  uint64_t firstPresentNs = 0;
+  std::thread::id mainThread;
+  std::string reportPath;
+  // Startup has a fixed set of stages; any past the capacity are dropped.
+  decltype(Launch::stages) stages;
+};
+
+// Times the enclosing scope as a stage, and traces it as a zone.
+class ScopedStartupStage {
+ public:
+  ScopedStartupStage(StartupProfiler &profiler, const char *name)
+      : profiler(profiler), name(name), trace(name), startNs(traceNowNs()) {}
+  ~ScopedStartupStage() { profiler.addStage(name, startNs, traceNowNs()); }
+  ScopedStartupStage(const ScopedStartupStage &) = delete;
+  ScopedStartupStage &operator=(const ScopedStartupStage &) = delete;
+
+ private:
+  StartupProfiler &profiler;
+  const char *name;
+  TraceScope trace;
+  uint64_t startNs;
+};
+
+}  // namespace vkt
+
+#define STARTUP_STAGE(profiler, name)                      \
+  ::vkt::ScopedStartupStage HELLOVK_TRACE_CONCAT(startupStage, \
+                                                 __LINE__)(profiler, name)
+
+#endif  // HELLOVK_STARTUP_PROFILER_H
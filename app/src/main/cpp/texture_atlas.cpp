@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "texture_atlas.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace vkt {
+
+namespace {
+
+const uint32_t kBytesPerPixel = 4;
+
+uint32_t alignUp(uint32_t value, uint32_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t nextPowerOfTwo(uint32_t value) {
+  uint32_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+}  // namespace
+
+SkylinePacker::SkylinePacker(uint32_t width, uint32_t height) {
+  reset(width, height);
+}
+
+void SkylinePacker::reset(uint32_t width, uint32_t height) {
+  atlasWidth = width;
+  atlasHeight = height;
+  usedArea = 0;
+  skyline.clear();
+  skyline.push_back({0, 0, width});
+}
+
+/*
+ * Checks whether a width x height rectangle can sit with its left edge on
+ * the given skyline segment. On success y is the lowest position at which it
+ * clears every segment it spans.
+ */
+bool SkylinePacker::fits(size_t segment, uint32_t width, uint32_t height,
+                         uint32_t &y) const {
+  if (skyline[segment].x + width > atlasWidth) {
+    return false;
+  }
+  y = skyline[segment].y;
+  int64_t widthLeft = width;
+  for (size_t i = segment; widthLeft > 0; i++) {
+    y = std::max(y, skyline[i].y);
+    if (y + height > atlasHeight) {
+      return false;
+    }
+    widthLeft -= skyline[i].width;
+  }
+  return true;
+}
+
+bool SkylinePacker::pack(uint32_t width, uint32_t height, AtlasRect &rect) {
+  size_t bestSegment = SIZE_MAX;
+  uint32_t bestTop = UINT32_MAX;
+  uint32_t bestWidth = UINT32_MAX;
+  for (size_t i = 0; i < skyline.size(); i++) {
+    uint32_t y;
+    if (!fits(i, width, height, y)) {
+      continue;
+    }
+    // Bottom-left: lowest top edge, then the narrowest segment to limit waste.
+    uint32_t top = y + height;
+    if (top < bestTop || (top == bestTop && skyline[i].width < bestWidth)) {
+      bestSegment = i;
+      bestTop = top;
+      bestWidth = skyline[i].width;
+      rect = {skyline[i].x, y, width, height};
+    }
+  }
+  if (bestSegment == SIZE_MAX) {
+    return false;
+  }
+
+  addSkylineLevel(bestSegment, rect);
+  usedArea += static_cast<uint64_t>(width) * height;
+  return true;
+}
+
+void SkylinePacker::addSkylineLevel(size_t segment, const AtlasRect &rect) {
+  skyline.insert(skyline.begin() + segment,
+                 {rect.x, rect.y + rect.height, rect.width});
+
+  // Trim the segments now covered by the new one.
+  for (size_t i = segment + 1; i < skyline.size(); i++) {
+    const Segment &previous = skyline[i - 1];
+    uint32_t previousEnd = previous.x + previous.width;
+    if (skyline[i].x >= previousEnd) {
+      break;
+    }
+    uint32_t shrink = previousEnd - skyline[i].x;
+    if (skyline[i].width <= shrink) {
+      skyline.erase(skyline.begin() + i);
+      i--;
+    } else {
+      skyline[i].x += shrink;
+      skyline[i].width -= shrink;
+      break;
+    }
+  }
+
+  // Merge neighbours at the same height.
+  for (size_t i = 0; i + 1 < skyline.size(); i++) {
+    if (skyline[i].y == skyline[i + 1].y) {
+      skyline[i].width += skyline[i + 1].width;
+      skyline.erase(skyline.begin() + i + 1);
+      i--;
+    }
+  }
+}
+
+double SkylinePacker::occupancy() const {
+  return static_cast<double>(usedArea) /
+         (static_cast<double>(atlasWidth) * atlasHeight);
+}
+
+bool TextureAtlas::build(const std::vector<AtlasImage> &images,
+                         const AtlasBuildOptions &options) {
+  // Aligning every image to the footprint of one texel of the smallest mip
+  // keeps image borders on texel boundaries at every level, and scaling the
+  // gutter the same way leaves `padding` texels between images at that level.
+  const uint32_t alignment = 1u << (std::max(options.mipLevels, 1u) - 1);
+  const uint32_t gutter = options.padding * alignment;
+
+  std::vector<uint32_t> order(images.size());
+  std::iota(order.begin(), order.end(), 0);
+  // Packing tall images first gives the skyline fewer, flatter steps.
+  std::sort(order.begin(), order.end(), [&images](uint32_t a, uint32_t b) {
+    if (images[a].height != images[b].height) {
+      return images[a].height > images[b].height;
+    }
+    return images[a].width > images[b].width;
+  });
+
+  uint64_t area = 0;
+  uint32_t maxCellWidth = 1;
+  uint32_t maxCellHeight = 1;
+  for (const AtlasImage &image : images) {
+    uint32_t cellWidth = alignUp(image.width + 2 * gutter, alignment);
+    uint32_t cellHeight = alignUp(image.height + 2 * gutter, alignment);
+    area += static_cast<uint64_t>(cellWidth) * cellHeight;
+    maxCellWidth = std::max(maxCellWidth, cellWidth);
+    maxCellHeight = std::max(maxCellHeight, cellHeight);
+  }
+
+  // Start from the smallest power-of-two rectangle that covers the area.
+  uint32_t width = 1;
+  uint32_t height = 1;
+  while (static_cast<uint64_t>(width) * height < area) {
+    if (width <= height) {
+      width <<= 1;
+    } else {
+      height <<= 1;
+    }
+  }
+  width = std::max(width, nextPowerOfTwo(maxCellWidth));
+  height = std::max(height, nextPowerOfTwo(maxCellHeight));
+
+  // Grow the atlas one dimension at a time until everything fits.
+  while (width <= options.maxSize && height <= options.maxSize) {
+    if (pack(images, order, gutter, alignment, width, height)) {
+      return true;
+    }
+    if (width <= height) {
+      width <<= 1;
+    } else {
+      height <<= 1;
+    }
+  }
+  return false;
+}
+
+bool TextureAtlas::pack(const std::vector<AtlasImage> &images,
+                        const std::vector<uint32_t> &order, uint32_t gutter,
+                        uint32_t alignment, uint32_t width, uint32_t height) {
+  SkylinePacker packer(width, height);
+  std::vector<AtlasRect> cells(images.size());
+  for (uint32_t index : order) {
+    const AtlasImage &image = images[index];
+    if (!packer.pack(alignUp(image.width + 2 * gutter, alignment),
+                     alignUp(image.height + 2 * gutter, alignment),
+                     cells[index])) {
+      return false;
+    }
+  }
+
+  atlasWidth = width;
+  atlasHeight = height;
+  atlasPixels.assign(static_cast<size_t>(width) * height * kBytesPerPixel, 0);
+  atlasEntries.resize(images.size());
+
+  uint64_t imageArea = 0;
+  for (size_t i = 0; i < images.size(); i++) {
+    blit(images[i], cells[i], gutter);
+
+    AtlasEntry &entry = atlasEntries[i];
+    entry.rect = {cells[i].x + gutter, cells[i].y + gutter, images[i].width,
+                  images[i].height};
+    entry.u0 = static_cast<float>(entry.rect.x) / width;
+    entry.v0 = static_cast<float>(entry.rect.y) / height;
+    entry.u1 = static_cast<float>(entry.rect.x + entry.rect.width) / width;
+    entry.v1 = static_cast<float>(entry.rect.y + entry.rect.height) / height;
+    imageArea += static_cast<uint64_t>(images[i].width) * images[i].height;
+  }
+  atlasOccupancy =
+      static_cast<double>(imageArea) / (static_cast<double>(width) * height);
+  return true;
+}
+
+/*
+ * Copies the image into its cell and fills the rest of the cell by clamping
+ * to the nearest edge texel of the image.
+ */
+void TextureAtlas::blit(const AtlasImage &image, const AtlasRect &cell,
+                        uint32_t gutter) {
+  if (image.width == 0 || image.height == 0) {
+    return;
+  }
+  const size_t rowBytes = static_cast<size_t>(image.width) * kBytesPerPixel;
+  for (uint32_t y = 0; y < cell.height; y++) {
+    uint32_t sourceY = static_cast<uint32_t>(std::clamp<int64_t>(
+        static_cast<int64_t>(y) - gutter, 0, image.height - 1));
+    const uint8_t *source = image.pixels + sourceY * rowBytes;
+    uint8_t *row = atlasPixels.data() +
+                   ((static_cast<size_t>(cell.y) + y) * atlasWidth + cell.x) *
+                       kBytesPerPixel;
+
+    for (uint32_t x = 0; x < gutter; x++) {
+      memcpy(row + x * kBytesPerPixel, source, kBytesPerPixel);
+    }
+    memcpy(row + gutter * kBytesPerPixel, source, rowBytes);
+    const uint8_t *lastTexel = source + rowBytes - kBytesPerPixel;
+    for (uint32_t x = gutter + image.width; x < cell.width; x++) {
+      memcpy(row + x * kBytesPerPixel, lastTexel, kBytesPerPixel);
+    }
+  }
+}
+
+}  // namespace vkt
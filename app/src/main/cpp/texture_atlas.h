@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_TEXTURE_ATLAS_H
+#define HELLOVK_TEXTURE_ATLAS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vkt {
+
+struct AtlasRect {
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+};
+
+/*
+ * SkylinePacker places rectangles with the skyline bottom-left heuristic:
+ * the atlas is described by the top edge ("skyline") of everything placed so
+ * far, and each rectangle goes where its top ends up lowest. It is fast
+ * enough to pack thousands of images at load time.
+ */
+class SkylinePacker {
+ public:
+  SkylinePacker(uint32_t width, uint32_t height);
+
+  void reset(uint32_t width, uint32_t height);
+  bool pack(uint32_t width, uint32_t height, AtlasRect &rect);
+
+  // Fraction of the atlas area covered by packed rectangles.
+  double occupancy() const;
+
+ private:
+  struct Segment {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+  };
+
+  bool fits(size_t segment, uint32_t width, uint32_t height,
+            uint32_t &y) const;
+  void addSkylineLevel(size_t segment, const AtlasRect &rect);
+
+  std::vector<Segment> skyline;
+  uint32_t atlasWidth;
+  uint32_t atlasHeight;
+  uint64_t usedArea = 0;
+};
+
+// Tightly packed RGBA8 source image.
+struct AtlasImage {
+  const uint8_t *pixels;
+  uint32_t width;
+  uint32_t height;
+};
+
+struct AtlasEntry {
+  // Texel rectangle of the image inside the atlas, gutters excluded.
+  AtlasRect rect;
+  // Normalized texture coordinates of the rectangle.
+  float u0, v0, u1, v1;
+};
+
+struct AtlasBuildOptions {
+  uint32_t maxSize = 4096;
+  // Texels of gutter kept around each image at the smallest mip level.
+  uint32_t padding = 1;
+  // Mip levels the atlas will be sampled with. Images are aligned and
+  // gutters scaled so neighbours never bleed into each other at any level.
+  uint32_t mipLevels = 1;
+};
+
+/*
+ * TextureAtlas packs many small RGBA8 images into a single power-of-two
+ * texture so they can share one image, one descriptor and one draw call.
+ * Gutters are filled by extruding the edge texels of each image, which keeps
+ * bilinear filtering and mip generation from pulling in neighbouring images.
+ */
+class TextureAtlas {
+ public:
+  // Returns false if the images do not fit in options.maxSize.
+  bool build(const std::vector<AtlasImage> &images,
+             const AtlasBuildOptions &options);
+
+  uint32_t width() const { return atlasWidth; }
+  uint32_t height() const { return atlasHeight; }
+  const std::vector<uint8_t> &pixels() const { return atlasPixels; }
+  // Entries are in the same order as the images passed to build().
+  const std::vector<AtlasEntry> &entries() const { return atlasEntries; }
+  double occupancy() const { return atlasOccupancy; }
+
+ private:
+  bool pack(const std::vector<AtlasImage> &images,
+            const std::vector<uint32_t> &order, uint32_t gutter,
+            uint32_t alignment, uint32_t width, uint32_t height);
+  void blit(const AtlasImage &image, const AtlasRect &rect, uint32_t gutter);
+
+  uint32_t atlasWidth = 0;
+  uint32_t atlasHeight = 0;
+  std::vector<uint8_t> atlasPixels;
+  std::vector<AtlasEntry> atlasEntries;
+  double atlasOccupancy = 0.0;
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_TEXTURE_ATLAS_H
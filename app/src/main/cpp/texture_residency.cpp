@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "texture_residency.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace vkt {
+
+namespace {
+const uint32_t kNoPendingMip = UINT32_MAX;
+}
+
+TextureResidencyManager::TextureResidencyManager(uint64_t budgetBytes,
+                                                 uint32_t maxLoadsPerFrame)
+    : budget(budgetBytes), maxLoads(maxLoadsPerFrame) {}
+
+TextureId TextureResidencyManager::registerTexture(const TextureDesc &desc) {
+  assert(desc.mipLevels > 0);
+  TextureState state{};
+  state.desc = desc;
+  state.residentMip = desc.mipLevels - 1;
+  state.pendingMip = kNoPendingMip;
+  state.requestedMip = desc.mipLevels - 1;
+  state.frameRequestedMip = desc.mipLevels - 1;
+  textures.push_back(state);
+  candidates.reserve(textures.size());
+
+  TextureId id = static_cast<TextureId>(textures.size() - 1);
+  // The smallest mip is loaded with the texture and never evicted.
+  committed += mipBytes(id, state.residentMip);
+  return id;
+}
+
+void TextureResidencyManager::requestFromScreenSize(TextureId texture,
+                                                    float screenWidth,
+                                                    float screenHeight) {
+  const TextureDesc &desc = textures[texture].desc;
+  float ratio = std::max(desc.width / std::max(screenWidth, 1.0f),
+                         desc.height / std::max(screenHeight, 1.0f));
+  // The coarsest level that still has at least one texel per pixel.
+  uint32_t mip = ratio <= 1.0f ? 0 : static_cast<uint32_t>(std::log2(ratio));
+  requestMip(texture, mip);
+}
+
+void TextureResidencyManager::requestMip(TextureId texture, uint32_t mip) {
+  TextureState &state = textures[texture];
+  mip = std::min(mip, state.desc.mipLevels - 1);
+  if (!state.usedThisFrame) {
+    state.usedThisFrame = true;
+    state.frameRequestedMip = mip;
+  } else {
+    state.frameRequestedMip = std::min(state.frameRequestedMip, mip);
+  }
+}
+
+void TextureResidencyManager::update(uint64_t frame,
+                                     std::vector<MipLoad> &loads,
+                                     std::vector<MipEviction> &evictions) {
+  loads.clear();
+  evictions.clear();
+
+  for (TextureState &state : textures) {
+    if (state.usedThisFrame) {
+      state.requestedMip = state.frameRequestedMip;
+      state.lastUsedFrame = frame;
+    }
+  }
+
+  // The budget may have shrunk since the last update.
+  while (committed > budget &&
+         (evictOne(frame, true, UINT32_MAX, evictions) ||
+          evictOne(frame, false, UINT32_MAX, evictions))) {
+  }
+
+  candidates.clear();
+  for (TextureId id = 0; id < textures.size(); id++) {
+    const TextureState &state = textures[id];
+    if (state.pendingMip == kNoPendingMip &&
+        state.requestedMip < state.residentMip) {
+      candidates.push_back(id);
+    }
+  }
+  // Textures on screen right now first, then the most recently used ones,
+  // then the ones missing the most detail.
+  std::sort(candidates.begin(), candidates.end(),
+            [this](TextureId a, TextureId b) {
+              const TextureState &sa = textures[a];
+              const TextureState &sb = textures[b];
+              if (sa.usedThisFrame != sb.usedThisFrame) {
+                return sa.usedThisFrame;
+              }
+              if (sa.lastUsedFrame != sb.lastUsedFrame) {
+                return sa.lastUsedFrame > sb.lastUsedFrame;
+              }
+              return sa.residentMip - sa.requestedMip >
+                     sb.residentMip - sb.requestedMip;
+            });
+
+  for (TextureId id : candidates) {
+    if (loads.size() >= maxLoads) {
+      break;
+    }
+    TextureState &state = textures[id];
+    uint32_t mip = state.residentMip - 1;
+    uint64_t bytes = mipBytes(id, mip);
+    // Only textures on screen take detail from others, otherwise two
+    // textures that no longer both fit would keep evicting each other.
+    while (committed + bytes > budget &&
+           (evictOne(frame, true, id, evictions) ||
+            (state.usedThisFrame &&
+             evictOne(frame, false, id, evictions)))) {
+    }
+    if (committed + bytes > budget) {
+      // Nothing else can be evicted this frame, stop streaming until then.
+      break;
+    }
+    state.pendingMip = mip;
+    committed += bytes;
+    loads.push_back({id, mip});
+  }
+
+  for (TextureState &state : textures) {
+    state.usedThisFrame = false;
+  }
+}
+
+/*
+ * Evicts the finest resident mip of the least recently used eligible texture.
+ * With onlyUnrequested set, only mips finer than what their texture currently
+ * requests are eligible, which never causes a visible quality drop. The
+ * texture `keep` is never chosen, so a load cannot evict its own texture.
+ */
+bool TextureResidencyManager::evictOne(uint64_t frame, bool onlyUnrequested,
+                                       TextureId keep,
+                                       std::vector<MipEviction> &evictions) {
+  TextureId victim = UINT32_MAX;
+  uint64_t oldestUse = UINT64_MAX;
+  for (TextureId id = 0; id < textures.size(); id++) {
+    const TextureState &state = textures[id];
+    if (id == keep || state.pendingMip != kNoPendingMip ||
+        state.residentMip + 1 >= state.desc.mipLevels) {
+      continue;
+    }
+    if (onlyUnrequested ? state.residentMip >= state.requestedMip
+                        : state.lastUsedFrame == frame) {
+      continue;
+    }
+    if (state.lastUsedFrame < oldestUse) {
+      oldestUse = state.lastUsedFrame;
+      victim = id;
+    }
+  }
+  if (victim == UINT32_MAX) {
+    return false;
+  }
+
+  TextureState &state = textures[victim];
+  evictions.push_back({victim, state.residentMip});
+  committed -= mipBytes(victim, state.residentMip);
+  state.residentMip++;
+  return true;
+}
+
+void TextureResidencyManager::onMipLoaded(TextureId texture, uint32_t mip) {
+  TextureState &state = textures[texture];
+  assert(state.pendingMip == mip);  // mip was not scheduled by update()
+  state.residentMip = mip;
+  state.pendingMip = kNoPendingMip;
+}
+
+uint32_t TextureResidencyManager::residentMip(TextureId texture) const {
+  return textures[texture].residentMip;
+}
+
+uint32_t TextureResidencyManager::requestedMip(TextureId texture) const {
+  return textures[texture].requestedMip;
+}
+
+float TextureResidencyManager::minLod(TextureId texture) const {
+  return static_cast<float>(textures[texture].residentMip);
+}
+
+uint64_t TextureResidencyManager::mipBytes(TextureId texture,
+                                           uint32_t mip) const {
+  const TextureDesc &desc = textures[texture].desc;
+  uint64_t width = std::max(desc.width >> mip, 1u);
+  uint64_t height = std::max(desc.height >> mip, 1u);
+  return width * height * desc.bytesPerPixel;
+}
+
+}  // namespace vkt
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_TEXTURE_RESIDENCY_H
+#define HELLOVK_TEXTURE_RESIDENCY_H
+
+#include <cstdint>
+#include <vector>
+
+namespace vkt {
+
+using TextureId = uint32_t;
+
+struct TextureDesc {
+  uint32_t width;
+  uint32_t height;
+  uint32_t mipLevels;
+  uint32_t bytesPerPixel;
+};
+
+// A mip level the renderer should start streaming in.
+struct MipLoad {
+  TextureId texture;
+  uint32_t mip;
+};
+
+// A mip level the renderer should release. The sampler LOD clamp of the
+// texture has already been raised past it when this is reported.
+struct MipEviction {
+  TextureId texture;
+  uint32_t mip;
+};
+
+/*
+ * TextureResidencyManager decides which mip levels of which textures should
+ * be resident under a memory budget. It contains no Vulkan calls so the
+ * policy can be driven by recorded or synthetic access traces on any host.
+ *
+ * Every texture keeps a contiguous range of mips resident, from
+ * residentMip() down to the smallest level; the smallest level is always
+ * resident so there is something to sample. Each frame the renderer reports
+ * the on-screen size of the textures it draws, calls update() and then:
+ *   - streams in the mips listed in `loads` and calls onMipLoaded() once the
+ *     upload has completed,
+ *   - releases the mips listed in `evictions`,
+ *   - clamps sampling of each texture to minLod(), which only ever references
+ *     resident levels.
+ *
+ * Mips are streamed one level at a time from coarse to fine. When the budget
+ * is exceeded, levels finer than what is currently requested are dropped
+ * first, then the finest levels of the least recently used textures, but
+ * only to make room for textures drawn in the current frame. Those are never
+ * evicted below what they request.
+ */
+class TextureResidencyManager {
+ public:
+  explicit TextureResidencyManager(uint64_t budgetBytes,
+                                   uint32_t maxLoadsPerFrame = 4);
+
+  TextureId registerTexture(const TextureDesc &desc);
+
+  /*
+   * Records a use of the texture this frame covering the given number of
+   * pixels on screen. The requested mip is the coarsest one that still has
+   * at least one texel per pixel. Multiple uses keep the finest request.
+   */
+  void requestFromScreenSize(TextureId texture, float screenWidth,
+                             float screenHeight);
+  void requestMip(TextureId texture, uint32_t mip);
+
+  void update(uint64_t frame, std::vector<MipLoad> &loads,
+              std::vector<MipEviction> &evictions);
+
+  void onMipLoaded(TextureId texture, uint32_t mip);
+
+  void setBudget(uint64_t budgetBytes) { budget = budgetBytes; }
+  uint64_t budgetBytes() const { return budget; }
+  // Resident bytes plus the bytes reserved by loads in flight.
+  uint64_t committedBytes() const { return committed; }
+
+  uint32_t residentMip(TextureId texture) const;
+  uint32_t requestedMip(TextureId texture) const;
+  // Value for VkSamplerCreateInfo::minLod (or a view's baseMipLevel).
+  float minLod(TextureId texture) const;
+
+  uint64_t mipBytes(TextureId texture, uint32_t mip) const;
+
+ private:
+  struct TextureState {
+    TextureDesc desc;
+    uint32_t residentMip;
+    // UINT32_MAX when no load is in flight.
+    uint32_t pendingMip;
+    uint32_t requestedMip;
+    uint32_t frameRequestedMip;
+    uint64_t lastUsedFrame;
+    bool usedThisFrame;
+  };
+
+  bool evictOne(uint64_t frame, bool onlyUnrequested, TextureId keep,
+                std::vector<MipEviction> &evictions);
+
+  std::vector<TextureState> textures;
+  // Reused by update(), which the renderer calls every frame.
+  std::vector<TextureId> candidates;
+  uint64_t budget;
+  uint64_t committed = 0;
+  uint32_t maxLoads;
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_TEXTURE_RESIDENCY_H
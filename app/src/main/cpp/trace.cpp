@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace.h"
+
+#if defined(__ANDROID__)
+#include <android/trace.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace vkt {
+
+std::atomic<bool> traceCaptureActive{false};
+
+namespace {
+
+const auto TRACE_FLUSH_INTERVAL = std::chrono::milliseconds(5);
+// Track ids in the file: threads get their slot index plus one.
+const uint32_t GPU_TRACK = 0;
+
+/*
+ * Maps traceTicks() onto the trace clock. The rate is estimated over the
+ * time since the capture started and refined at every flush, so events are
+ * always converted with a rate measured over at least their own distance
+ * from the origin, which keeps the error at the level of the clock reads'
+ * jitter.
+ */
+class TickClock {
+ public:
+  void start() {
+    sample(originTicks, originNs);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    refine();
+  }
+
+  void refine() {
+    uint64_t ticks, ns;
+    sample(ticks, ns);
+    if (ticks > originTicks && ns > originNs) {
+      nsPerTick = double(ns - originNs) / double(ticks - originTicks);
+    }
+  }
+
+  uint64_t toNs(uint64_t ticks) const {
+    return originNs + int64_t(int64_t(ticks - originTicks) * nsPerTick);
+  }
+
+ private:
+  static void sample(uint64_t &ticks, uint64_t &ns) {
+    const uint64_t before = traceNowNs();
+    ticks = traceTicks();
+    ns = before + (traceNowNs() - before) / 2;
+  }
+
+  uint64_t originTicks = 0;
+  uint64_t originNs = 0;
+  double nsPerTick = 1.0;
+};
+
+/*
+ * The rings are allocated together by the first capture and then kept for
+ * the life of the process, so a thread that is still recording while a
+ * capture stops never writes to freed memory, and claiming a ring mid-frame
+ * does not allocate.
+ */
+std::atomic<TraceRing *> rings{nullptr};
+std::atomic<uint32_t> claimedRings{0};
+// Set before the thread may have a ring, copied into it when claimed.
+thread_local char threadName[32] = {};
+std::mutex nameMutex;
+
+std::mutex captureMutex;  // start/stop and the members below
+FILE *captureFile = nullptr;
+std::thread flushThread;
+std::condition_variable flushWake;
+bool flushStopping = false;
+bool firstEvent = true;
+TickClock tickClock;
+
+// Chrome trace timestamps are in microseconds; keep the nanoseconds as
+// three decimals, formatted as integers since that is much faster.
+#define US_FORMAT "%llu.%03u"
+#define US_ARGS(ns) \
+  static_cast<unsigned long long>((ns) / 1000), unsigned((ns) % 1000)
+
+/*
+ * Zones make up most of a capture. Formatting them by hand rather than with
+ * fprintf keeps the flush thread ahead of many recording threads.
+ */
+char *appendText(char *out, const char *text, size_t maxLength) {
+  for (size_t i = 0; i < maxLength && text[i] != 0; i++) {
+    *out++ = text[i];
+  }
+  return out;
+}
+
+char *appendUint(char *out, uint64_t value) {
+  char digits[20];
+  int count = 0;
+  do {
+    digits[count++] = char('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  while (count > 0) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+
+// The same as US_FORMAT.
+char *appendUs(char *out, uint64_t ns) {
+  out = appendUint(out, ns / 1000);
+  const uint32_t fraction = ns % 1000;
+  *out++ = '.';
+  *out++ = char('0' + fraction / 100);
+  *out++ = char('0' + fraction / 10 % 10);
+  *out++ = char('0' + fraction % 10);
+  return out;
+}
+
+void writeZone(FILE *file, const char *name, uint32_t track, uint64_t startNs,
+               uint64_t durationNs) {
+  // Longer names are cut short.
+  const size_t kMaxName = 256;
+  char line[kMaxName + 128];
+  char *out = appendText(line, "{\"name\":\"", 9);
+  out = appendText(out, name, kMaxName);
+  out = appendText(out, "\",\"ph\":\"X\",\"pid\":1,\"tid\":", 28);
+  out = appendUint(out, track);
+  out = appendText(out, ",\"ts\":", 6);
+  out = appendUs(out, startNs);
+  out = appendText(out, ",\"dur\":", 7);
+  out = appendUs(out, durationNs);
+  *out++ = '}';
+  fwrite(line, 1, out - line, file);
+}
+
+void writeEvent(FILE *file, const TraceEvent &event, uint32_t track) {
+  fputs(firstEvent ? "\n" : ",\n", file);
+  firstEvent = false;
+  uint64_t startNs = event.time;
+  uint64_t durationNs = event.duration;
+  switch (event.type) {
+    case TraceEventType::kTickZone:
+      startNs = tickClock.toNs(event.time);
+      durationNs = tickClock.toNs(event.endTicks) - startNs;
+      [[fallthrough]];
+    case TraceEventType::kZone:
+    case TraceEventType::kGpuZone:
+      writeZone(file, event.name,
+                event.type == TraceEventType::kGpuZone ? GPU_TRACK : track,
+                startNs, durationNs);
+      break;
+    case TraceEventType::kCounter:
+      fprintf(file,
+              "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,"
+              "\"ts\":" US_FORMAT ",\"args\":{\"value\":%g}}",
+              event.name, US_ARGS(tickClock.toNs(event.time)), event.value);
+      break;
+  }
+}
+
+void writeTrackName(FILE *file, uint32_t track, const char *name) {
+  fputs(firstEvent ? "\n" : ",\n", file);
+  firstEvent = false;
+  fprintf(file,
+          "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+          "\"args\":{\"name\":\"%s\"}}",
+          track, name);
+}
+
+// Moves every ring's pending events into the file. Flush thread only, or
+// with it stopped.
+void drainRings(FILE *file) {
+  tickClock.refine();
+  TraceRing *allRings = rings.load();
+  const uint32_t count = std::min(claimedRings.load(), MAX_TRACE_THREADS);
+  for (uint32_t r = 0; r < count; r++) {
+    TraceRing &ring = allRings[r];
+    const uint32_t head = ring.head.load(std::memory_order_acquire);
+    uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+    for (; tail != head; tail++) {
+      writeEvent(file, ring.events[tail & (TRACE_RING_SIZE - 1)], r + 1);
+    }
+    ring.tail.store(tail, std::memory_order_release);
+  }
+}
+
+void flushMain(FILE *file) {
+  std::unique_lock<std::mutex> lock(captureMutex);
+  while (!flushStopping) {
+    flushWake.wait_for(lock, TRACE_FLUSH_INTERVAL);
+    lock.unlock();
+    drainRings(file);
+    lock.lock();
+  }
+}
+
+}  // namespace
+
+TraceRing *claimTraceRing() {
+  if (traceThreadRing != nullptr) {
+    return traceThreadRing;
+  }
+  TraceRing *allRings = rings.load(std::memory_order_acquire);
+  if (allRings == nullptr) {
+    return nullptr;
+  }
+  const uint32_t index = claimedRings.fetch_add(1);
+  if (index < MAX_TRACE_THREADS) {
+    traceThreadRing = &allRings[index];
+    std::lock_guard<std::mutex> lock(nameMutex);
+    memcpy(traceThreadRing->name, threadName, sizeof(threadName));
+  }
+  return traceThreadRing;
+}
+
+void wakeTraceFlush() { flushWake.notify_one(); }
+
+bool startTracing(const char *path) {
+  std::lock_guard<std::mutex> lock(captureMutex);
+  if (captureFile != nullptr) {
+    return false;
+  }
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) {
+    return false;
+  }
+  TraceRing *allRings = rings.load();
+  if (allRings == nullptr) {
+    allRings = new TraceRing[MAX_TRACE_THREADS];
+    rings.store(allRings);
+  }
+  // Skip whatever was recorded after the previous capture stopped.
+  const uint32_t count = std::min(claimedRings.load(), MAX_TRACE_THREADS);
+  for (uint32_t r = 0; r < count; r++) {
+    allRings[r].tail.store(allRings[r].head.load());
+    allRings[r].dropped.store(0);
+  }
+
+  captureFile = file;
+  firstEvent = true;
+  tickClock.start();
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+  writeTrackName(file, GPU_TRACK, "GPU");
+  flushStopping = false;
+  flushThread = std::thread(flushMain, file);
+  traceCaptureActive.store(true);
+  return true;
+}
+
+uint32_t stopTracing() {
+  {
+    std::lock_guard<std::mutex> lock(captureMutex);
+    if (captureFile == nullptr) {
+      return 0;
+    }
+    traceCaptureActive.store(false);
+    flushStopping = true;
+  }
+  flushWake.notify_one();
+  flushThread.join();
+
+  std::lock_guard<std::mutex> lock(captureMutex);
+  FILE *file = captureFile;
+  drainRings(file);
+  TraceRing *allRings = rings.load();
+  uint32_t dropped = 0;
+  const uint32_t count = std::min(claimedRings.load(), MAX_TRACE_THREADS);
+  {
+    std::lock_guard<std::mutex> nameLock(nameMutex);
+    for (uint32_t r = 0; r < count; r++) {
+      char fallback[32];
+      snprintf(fallback, sizeof(fallback), "thread %u", r + 1);
+      const char *name = allRings[r].name;
+      writeTrackName(file, r + 1, name[0] != 0 ? name : fallback);
+      dropped += allRings[r].dropped.load();
+    }
+  }
+  fprintf(file, "\n],\"otherData\":{\"droppedEvents\":%u}}\n", dropped);
+  fclose(file);
+  captureFile = nullptr;
+  return dropped;
+}
+
+#if defined(__ANDROID__)
+bool systemTraceEnabled() { return ATrace_isEnabled(); }
+void systemTraceBegin(const char *name) { ATrace_beginSection(name); }
+void systemTraceEnd() { ATrace_endSection(); }
+void systemTraceCounter(const char *name, int64_t value) {
+  ATrace_setCounter(name, value);
+}
+#else
+bool systemTraceEnabled() { return false; }
+void systemTraceBegin(const char *) {}
+void systemTraceEnd() {}
+void systemTraceCounter(const char *, int64_t) {}
+#endif
+
+void setTraceThreadName(const char *name) {
+  std::lock_guard<std::mutex> lock(nameMutex);
+  snprintf(threadName, sizeof(threadName), "%s", name);
+  if (traceThreadRing != nullptr) {
+    memcpy(traceThreadRing->name, threadName, sizeof(threadName));
+  }
+}
+
+void traceZone(const char *name, uint64_t startNs, uint64_t durationNs) {
+  if (TraceRing *ring = traceRing()) {
+    TraceEvent event{name, startNs, {durationNs}, TraceEventType::kZone};
+    ring->push(event);
+  }
+}
+
+void traceGpuZone(const char *name, uint64_t startNs, uint64_t durationNs) {
+  if (TraceRing *ring = traceRing()) {
+    TraceEvent event{name, startNs, {durationNs}, TraceEventType::kGpuZone};
+    ring->push(event);
+  }
+}
+
+void traceCounter(const char *name, double value) {
+  if (TraceRing *ring = traceRing()) {
+    TraceEvent event{name, traceTicks(), {0}, TraceEventType::kCounter};
+    event.value = value;
+    ring->push(event);
+  }
+}
+
+}  // namespace vkt
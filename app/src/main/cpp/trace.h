@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_TRACE_H
+#define HELLOVK_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Tracing of CPU zones, GPU zones and counters, written as Chrome trace
+ * event JSON, which ui.perfetto.dev and chrome://tracing open.
+ *
+ *   TRACE_SCOPE("updateUniformBuffer");  // a zone until the end of scope
+ *   TRACE_COUNTER("visible nodes", visibleNodes.size());
+ *
+ * Names are kept as pointers and must be string literals. Each thread
+ * records into a ring buffer of its own that only the flush thread reads,
+ * so recording takes no lock and no call: a zone is two reads of the CPU's
+ * tick counter and a store into the ring, all inline. The flush thread
+ * drains the rings into the file every few milliseconds, or as soon as one
+ * is half full, converting ticks to the trace clock as it goes; a ring that
+ * fills up anyway drops events, and the drops are counted in the trace.
+ * While no capture is running a zone costs a relaxed load.
+ *
+ * On Android zones and counters also go to ATrace, so they show up in
+ * system traces (Perfetto, the Android Studio profiler) whenever those
+ * record. Define HELLOVK_NO_TRACING to compile the macros out entirely.
+ */
+
+namespace vkt {
+
+extern std::atomic<bool> traceCaptureActive;
+
+// The trace clock, in nanoseconds. Same as std::chrono::steady_clock.
+inline uint64_t traceNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/*
+ * A monotonic counter that is much cheaper to read than the clock: the
+ * virtual counter on arm64, the TSC on x86-64 (both constant rate and
+ * synchronized between cores on the hardware we run on) and the trace
+ * clock itself elsewhere.
+ */
+inline uint64_t traceTicks() {
+#if defined(__aarch64__)
+  uint64_t ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#elif defined(__x86_64__)
+  return __rdtsc();
+#else
+  return traceNowNs();
+#endif
+}
+
+inline bool tracingActive() {
+  return traceCaptureActive.load(std::memory_order_relaxed);
+}
+
+// Starts writing a capture to path. Fails if one is already running or the
+// file cannot be created.
+bool startTracing(const char *path);
+// Writes out what is left and closes the file. Returns the number of events
+// dropped because a thread's ring was full.
+uint32_t stopTracing();
+
+// Threads past this many go unrecorded.
+const uint32_t MAX_TRACE_THREADS = 32;
+// Per thread, a power of two. At 32 bytes an event, 512 KiB a thread.
+const uint32_t TRACE_RING_SIZE = 16384;
+
+enum class TraceEventType : uint32_t { kZone, kTickZone, kGpuZone, kCounter };
+
+/*
+ * kZone and kGpuZone hold a start and duration in nanoseconds, kTickZone a
+ * start and end in traceTicks(), and kCounter its time in ticks.
+ */
+struct TraceEvent {
+  const char *name;
+  uint64_t time;
+  union {
+    uint64_t duration;
+    uint64_t endTicks;
+    double value;
+  };
+  TraceEventType type;
+};
+
+// Has the flush thread drain the rings now rather than at its next interval.
+void wakeTraceFlush();
+
+/*
+ * A single-producer single-consumer ring: the owning thread pushes, the
+ * flush thread pops. head and tail only grow and wrap through the mask.
+ */
+struct alignas(64) TraceRing {
+  alignas(64) std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> dropped{0};
+  alignas(64) std::atomic<uint32_t> tail{0};
+  TraceEvent events[TRACE_RING_SIZE];
+  // Guarded by the name mutex in trace.cpp.
+  char name[32] = {};
+
+  void push(const TraceEvent &event) {
+    const uint32_t h = head.load(std::memory_order_relaxed);
+    const uint32_t pending = h - tail.load(std::memory_order_acquire);
+    if (pending == TRACE_RING_SIZE) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    events[h & (TRACE_RING_SIZE - 1)] = event;
+    head.store(h + 1, std::memory_order_release);
+    if (pending == TRACE_RING_SIZE / 2) {
+      wakeTraceFlush();
+    }
+  }
+};
+
+// The calling thread's ring, once its first event has claimed one.
+inline thread_local TraceRing *traceThreadRing = nullptr;
+// Claims a ring for the calling thread. nullptr before the first capture
+// and for threads past MAX_TRACE_THREADS.
+TraceRing *claimTraceRing();
+
+inline TraceRing *traceRing() {
+  TraceRing *ring = traceThreadRing;
+  return ring != nullptr ? ring : claimTraceRing();
+}
+
+// Markers for the system tracer: ATrace on Android, nothing elsewhere.
+// Begin and end nest per thread.
+bool systemTraceEnabled();
+void systemTraceBegin(const char *name);
+void systemTraceEnd();
+void systemTraceCounter(const char *name, int64_t value);
+
+// Names the calling thread's track in captures. Copies name.
+void setTraceThreadName(const char *name);
+
+// Records a zone on the calling thread's track, in trace clock time.
+void traceZone(const char *name, uint64_t startNs, uint64_t durationNs);
+// Records a zone on the GPU track, in trace clock time.
+void traceGpuZone(const char *name, uint64_t startNs, uint64_t durationNs);
+void traceCounter(const char *name, double value);
+
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name) : name(name) {
+    if (tracingActive()) {
+      ring = traceRing();
+      startTicks = traceTicks();
+    }
+    systemTrace = systemTraceEnabled();
+    if (systemTrace) {
+      systemTraceBegin(name);
+    }
+  }
+  ~TraceScope() {
+    if (ring != nullptr) {
+      ring->push({name, startTicks, {traceTicks()}, TraceEventType::kTickZone});
+    }
+    if (systemTrace) {
+      systemTraceEnd();
+    }
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+ private:
+  const char *name;
+  TraceRing *ring = nullptr;
+  uint64_t startTicks;
+  bool systemTrace;
+};
+
+inline void traceCounterValue(const char *name, double value) {
+  if (tracingActive()) {
+    traceCounter(name, value);
+  }
+  if (systemTraceEnabled()) {
+    systemTraceCounter(name, static_cast<int64_t>(value));
+  }
+}
+
+}  // namespace vkt
+
+#define HELLOVK_TRACE_CONCAT_(a, b) a##b
+#define HELLOVK_TRACE_CONCAT(a, b) HELLOVK_TRACE_CONCAT_(a, b)
+
+#if defined(HELLOVK_NO_TRACING)
+#define TRACE_SCOPE(name) \
+  do {                    \
+  } while (0)
+#define TRACE_COUNTER(name, value) \
+  do {                             \
+  } while (0)
+#else
+#define TRACE_SCOPE(name) \
+  ::vkt::TraceScope HELLOVK_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_COUNTER(name, value) \
+  ::vkt::traceCounterValue(name, static_cast<double>(value))
+#endif
+
+#endif  // HELLOVK_TRACE_H
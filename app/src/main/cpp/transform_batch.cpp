@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "transform_batch.h"
+
+// HELLOVK_TRANSFORM_NO_SIMD forces the scalar path, for benchmarking.
+#if defined(HELLOVK_TRANSFORM_NO_SIMD)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HELLOVK_TRANSFORM_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HELLOVK_TRANSFORM_SSE2 1
+#endif
+
+namespace vkt {
+
+namespace {
+
+/*
+ * Four lanes, each holding the same quantity for a different object. Only
+ * the handful of operations the kernel needs are wrapped, so the kernel
+ * itself is written once for both instruction sets.
+ */
+#if HELLOVK_TRANSFORM_NEON
+typedef float32x4_t Lanes;
+inline Lanes load(const float *p) { return vld1q_f32(p); }
+inline Lanes splat(float value) { return vdupq_n_f32(value); }
+inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+inline Lanes sub(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+inline Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+// a + b * c
+inline Lanes madd(Lanes a, Lanes b, Lanes c) { return vmlaq_f32(a, b, c); }
+
+// Turns one column of four objects' matrices, given row by row, into that
+// column of each object's matrix.
+inline void storeColumn(Lanes row0, Lanes row1, Lanes row2, Lanes row3,
+                        glm::mat4 *matrices, int column) {
+  float32x4x2_t t01 = vtrnq_f32(row0, row1);
+  float32x4x2_t t23 = vtrnq_f32(row2, row3);
+  vst1q_f32(&matrices[0][column][0],
+            vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0])));
+  vst1q_f32(&matrices[1][column][0],
+            vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1])));
+  vst1q_f32(&matrices[2][column][0], vcombine_f32(vget_high_f32(t01.val[0]),
+                                                  vget_high_f32(t23.val[0])));
+  vst1q_f32(&matrices[3][column][0], vcombine_f32(vget_high_f32(t01.val[1]),
+                                                  vget_high_f32(t23.val[1])));
+}
+#elif HELLOVK_TRANSFORM_SSE2
+typedef __m128 Lanes;
+inline Lanes load(const float *p) { return _mm_loadu_ps(p); }
+inline Lanes splat(float value) { return _mm_set1_ps(value); }
+inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes madd(Lanes a, Lanes b, Lanes c) {
+  return _mm_add_ps(a, _mm_mul_ps(b, c));
+}
+
+inline void storeColumn(Lanes row0, Lanes row1, Lanes row2, Lanes row3,
+                        glm::mat4 *matrices, int column) {
+  _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+  _mm_storeu_ps(&matrices[0][column][0], row0);
+  _mm_storeu_ps(&matrices[1][column][0], row1);
+  _mm_storeu_ps(&matrices[2][column][0], row2);
+  _mm_storeu_ps(&matrices[3][column][0], row3);
+}
+#endif
+
+}  // namespace
+
+void TransformBatch::resize(size_t count) {
+  // New objects get the identity transform.
+  for (std::vector<float> *component :
+       {&positionX, &positionY, &positionZ, &rotationX, &rotationY,
+        &rotationZ}) {
+    component->resize(count, 0.0f);
+  }
+  for (std::vector<float> *component :
+       {&rotationW, &scaleX, &scaleY, &scaleZ}) {
+    component->resize(count, 1.0f);
+  }
+}
+
+void TransformBatch::set(size_t index, const glm::vec3 &position,
+                         const glm::quat &rotation, const glm::vec3 &scale) {
+  positionX[index] = position.x;
+  positionY[index] = position.y;
+  positionZ[index] = position.z;
+  rotationX[index] = rotation.x;
+  rotationY[index] = rotation.y;
+  rotationZ[index] = rotation.z;
+  rotationW[index] = rotation.w;
+  scaleX[index] = scale.x;
+  scaleY[index] = scale.y;
+  scaleZ[index] = scale.z;
+}
+
+glm::vec3 TransformBatch::position(size_t index) const {
+  return glm::vec3(positionX[index], positionY[index], positionZ[index]);
+}
+
+glm::quat TransformBatch::rotation(size_t index) const {
+  return glm::quat(rotationW[index], rotationX[index], rotationY[index],
+                   rotationZ[index]);
+}
+
+glm::vec3 TransformBatch::scale(size_t index) const {
+  return glm::vec3(scaleX[index], scaleY[index], scaleZ[index]);
+}
+
+void TransformBatch::computeMatrices(size_t first, size_t count,
+                                     const glm::mat4 &viewProjection,
+                                     glm::mat4 *models,
+                                     glm::mat4 *mvps) const {
+  const size_t end = first + count;
+  size_t i = first;
+#if HELLOVK_TRANSFORM_NEON || HELLOVK_TRANSFORM_SSE2
+  Lanes vp[4][4];
+  for (int c = 0; c < 4; c++) {
+    for (int r = 0; r < 4; r++) {
+      vp[c][r] = splat(viewProjection[c][r]);
+    }
+  }
+  const Lanes zero = splat(0.0f);
+  const Lanes one = splat(1.0f);
+  const Lanes two = splat(2.0f);
+
+  for (; i + 4 <= end; i += 4) {
+    const Lanes x = load(&rotationX[i]);
+    const Lanes y = load(&rotationY[i]);
+    const Lanes z = load(&rotationZ[i]);
+    const Lanes w = load(&rotationW[i]);
+    const Lanes x2 = mul(x, two);
+    const Lanes y2 = mul(y, two);
+    const Lanes z2 = mul(z, two);
+    const Lanes xx = mul(x, x2), yy = mul(y, y2), zz = mul(z, z2);
+    const Lanes xy = mul(x, y2), xz = mul(x, z2), yz = mul(y, z2);
+    const Lanes wx = mul(w, x2), wy = mul(w, y2), wz = mul(w, z2);
+
+    // model[column][row], same layout as glm::mat4_cast scaled per column.
+    Lanes m[4][4];
+    const Lanes sx = load(&scaleX[i]);
+    const Lanes sy = load(&scaleY[i]);
+    const Lanes sz = load(&scaleZ[i]);
+    m[0][0] = mul(sub(one, add(yy, zz)), sx);
+    m[0][1] = mul(add(xy, wz), sx);
+    m[0][2] = mul(sub(xz, wy), sx);
+    m[1][0] = mul(sub(xy, wz), sy);
+    m[1][1] = mul(sub(one, add(xx, zz)), sy);
+    m[1][2] = mul(add(yz, wx), sy);
+    m[2][0] = mul(add(xz, wy), sz);
+    m[2][1] = mul(sub(yz, wx), sz);
+    m[2][2] = mul(sub(one, add(xx, yy)), sz);
+    m[3][0] = load(&positionX[i]);
+    m[3][1] = load(&positionY[i]);
+    m[3][2] = load(&positionZ[i]);
+
+    if (models != nullptr) {
+      glm::mat4 *out = models + (i - first);
+      for (int c = 0; c < 3; c++) {
+        storeColumn(m[c][0], m[c][1], m[c][2], zero, out, c);
+      }
+      storeColumn(m[3][0], m[3][1], m[3][2], one, out, 3);
+    }
+
+    if (mvps != nullptr) {
+      // The model matrix's last row is (0, 0, 0, 1), which saves a quarter
+      // of the multiply-adds of a general 4x4 product.
+      glm::mat4 *out = mvps + (i - first);
+      for (int c = 0; c < 4; c++) {
+        Lanes column[4];
+        for (int r = 0; r < 4; r++) {
+          Lanes sum = c == 3 ? vp[3][r] : zero;
+          sum = madd(sum, vp[0][r], m[c][0]);
+          sum = madd(sum, vp[1][r], m[c][1]);
+          column[r] = madd(sum, vp[2][r], m[c][2]);
+        }
+        storeColumn(column[0], column[1], column[2], column[3], out, c);
+      }
+    }
+  }
+#endif
+
+  for (; i < end; i++) {
+    const float x = rotationX[i], y = rotationY[i], z = rotationZ[i],
+                w = rotationW[i];
+    const float xx = 2 * x * x, yy = 2 * y * y, zz = 2 * z * z;
+    const float xy = 2 * x * y, xz = 2 * x * z, yz = 2 * y * z;
+    const float wx = 2 * w * x, wy = 2 * w * y, wz = 2 * w * z;
+    glm::mat4 model;
+    model[0] = glm::vec4(1 - (yy + zz), xy + wz, xz - wy, 0) * scaleX[i];
+    model[1] = glm::vec4(xy - wz, 1 - (xx + zz), yz + wx, 0) * scaleY[i];
+    model[2] = glm::vec4(xz + wy, yz - wx, 1 - (xx + yy), 0) * scaleZ[i];
+    model[3] = glm::vec4(positionX[i], positionY[i], positionZ[i], 1);
+    if (models != nullptr) {
+      models[i - first] = model;
+    }
+    if (mvps != nullptr) {
+      mvps[i - first] = viewProjection * model;
+    }
+  }
+}
+
+}  // namespace vkt
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_TRANSFORM_BATCH_H
+#define HELLOVK_TRANSFORM_BATCH_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace vkt {
+
+/*
+ * TransformBatch stores the translation, rotation and scale of many objects
+ * as structure-of-arrays, one array per component. This lets the matrix
+ * kernel load the same component of four objects with one SIMD load and
+ * build four model matrices at once, instead of going through glm::translate,
+ * glm::mat4_cast and glm::scale object by object.
+ */
+class TransformBatch {
+ public:
+  size_t size() const { return positionX.size(); }
+  void resize(size_t count);
+
+  void set(size_t index, const glm::vec3 &position, const glm::quat &rotation,
+           const glm::vec3 &scale);
+  glm::vec3 position(size_t index) const;
+  glm::quat rotation(size_t index) const;
+  glm::vec3 scale(size_t index) const;
+
+  /*
+   * Computes model = T * R * S and mvp = viewProjection * model for objects
+   * [first, first + count). Either output may be null. Outputs are written
+   * sequentially in whole 16-byte columns and never read, so they can point
+   * straight into persistently mapped (write-combined) GPU memory.
+   */
+  void computeMatrices(size_t first, size_t count,
+                       const glm::mat4 &viewProjection, glm::mat4 *models,
+                       glm::mat4 *mvps) const;
+
+ private:
+  std::vector<float> positionX, positionY, positionZ;
+  // Unit quaternions.
+  std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+  std::vector<float> scaleX, scaleY, scaleZ;
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_TRANSFORM_BATCH_H
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 
 #include <iostream>
+#include <string>
 
 #include "hellovk.h"
 
@@ -35,6 +36,8 @@
  * vkt::HelloVK - a pointer to our (this) Vulkan application in order to call
  *  the rendering logic
  *
+ * vkt::AssetSource - the APK's assets, which outlive every window
+ *
  * bool canRender - a flag which signals that we are ready to call the vulkan
  * rendering logic
  *
@@ -42,6 +45,7 @@
 struct VulkanEngine {
   struct android_app *app;
   vkt::HelloVK *app_backend;
+  std::unique_ptr<vkt::AssetSource> assets;
   bool canRender = false;
 };
 
@@ -53,17 +57,25 @@ static void HandleCmd(struct android_app *app, int32_t cmd) {
   auto *engine = (VulkanEngine *)app->userData;
   switch (cmd) {
     case APP_CMD_START:
+      engine->app_backend->startup().addEvent("APP_CMD_START");
       if (engine->app->window != nullptr) {
-        engine->app_backend->reset(app->window, app->activity->assetManager);
+        engine->app_backend->reset(
+            vkt::createAndroidSurfaceProvider(app->window),
+            engine->assets.get());
         engine->app_backend->initVulkan();
         engine->canRender = true;
       }
     case APP_CMD_INIT_WINDOW:
       // The window is being shown, get it ready.
       LOGI("Called - APP_CMD_INIT_WINDOW");
+      if (cmd == APP_CMD_INIT_WINDOW) {
+        engine->app_backend->startup().addEvent("APP_CMD_INIT_WINDOW");
+      }
       if (engine->app->window != nullptr) {
         LOGI("Setting a new surface");
-        engine->app_backend->reset(app->window, app->activity->assetManager);
+        engine->app_backend->reset(
+            vkt::createAndroidSurfaceProvider(app->window),
+            engine->assets.get());
         if (!engine->app_backend->initialized) {
           LOGI("Starting application");
           engine->app_backend->initVulkan();
@@ -125,8 +137,17 @@ void android_main(struct android_app *state) {
   VulkanEngine engine{};
   vkt::HelloVK vulkanBackend{};
 
+  // Launches are timed from here, and each appends a line to startup.jsonl
+  // in the app's files directory, see startup_profiler.h.
+  vulkanBackend.startup().start();
+  if (state->activity->internalDataPath != nullptr) {
+    vulkanBackend.startup().setReportPath(
+        std::string(state->activity->internalDataPath) + "/startup.jsonl");
+  }
+
   engine.app = state;
   engine.app_backend = &vulkanBackend;
+  engine.assets = vkt::createAndroidAssetSource(state->activity->assetManager);
   state->userData = &engine;
   state->onAppCmd = HandleCmd;
 
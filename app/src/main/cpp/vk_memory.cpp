@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vk_memory.h"
+
+namespace vkt {
+
+namespace {
+
+struct UsageFlags {
+  // Flags a memory type must have to be considered at all.
+  VkMemoryPropertyFlags required;
+  // Flags that make a memory type a better fit, in decreasing importance.
+  VkMemoryPropertyFlags preferred[2];
+  // Flags that make a memory type a worse fit.
+  VkMemoryPropertyFlags avoided;
+};
+
+UsageFlags flagsForUsage(MemoryUsage usage) {
+  switch (usage) {
+    case MemoryUsage::kGpuOnly:
+      // Host visibility is a tie breaker only, and only on unified memory
+      // (see findMemoryType), where it enables writing the resource in place.
+      return {0,
+              {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT},
+              VK_MEMORY_PROPERTY_HOST_CACHED_BIT};
+    case MemoryUsage::kUpload:
+      // Sequential CPU writes are fastest to uncached, write-combined memory.
+      return {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+              {0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT},
+              VK_MEMORY_PROPERTY_HOST_CACHED_BIT};
+    case MemoryUsage::kReadback:
+      // CPU reads from uncached memory are very slow.
+      return {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+              {VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT},
+              0};
+    case MemoryUsage::kDynamic:
+      return {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+              {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0},
+              VK_MEMORY_PROPERTY_HOST_CACHED_BIT};
+    case MemoryUsage::kHostDecode:
+      return {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+              {VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT},
+              0};
+  }
+  return {0, {0, 0}, 0};
+}
+
+}  // namespace
+
+void MemoryTypeSelector::init(VkPhysicalDevice newPhysicalDevice,
+                              bool memoryBudgetSupported) {
+  physicalDevice = newPhysicalDevice;
+  budgetSupported = memoryBudgetSupported;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+  unifiedMemory = true;
+  for (uint32_t heap = 0; heap < memProperties.memoryHeapCount; heap++) {
+    if (!(memProperties.memoryHeaps[heap].flags &
+          VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+      continue;
+    }
+    bool mappable = false;
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+      const VkMemoryType &type = memProperties.memoryTypes[i];
+      if (type.heapIndex == heap &&
+          (type.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+        mappable = true;
+        break;
+      }
+    }
+    unifiedMemory = unifiedMemory && mappable;
+  }
+}
+
+std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS>
+MemoryTypeSelector::heapBudgets() const {
+  std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> budgets{};
+  for (uint32_t heap = 0; heap < memProperties.memoryHeapCount; heap++) {
+    budgets[heap] = memProperties.memoryHeaps[heap].size;
+  }
+  if (!budgetSupported) {
+    return budgets;
+  }
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+  budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  VkPhysicalDeviceMemoryProperties2 properties2{};
+  properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  properties2.pNext = &budget;
+  vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties2);
+
+  for (uint32_t heap = 0; heap < memProperties.memoryHeapCount; heap++) {
+    budgets[heap] = budget.heapBudget[heap] > budget.heapUsage[heap]
+                        ? budget.heapBudget[heap] - budget.heapUsage[heap]
+                        : 0;
+  }
+  return budgets;
+}
+
+uint32_t MemoryTypeSelector::findMemoryType(uint32_t typeFilter,
+                                            MemoryUsage usage,
+                                            VkDeviceSize size) const {
+  UsageFlags flags = flagsForUsage(usage);
+  if (usage == MemoryUsage::kGpuOnly && !unifiedMemory) {
+    // Host visible device local memory is then a small window (the PCIe
+    // BAR) that resources the CPU never touches should leave alone.
+    flags.preferred[1] = 0;
+    flags.avoided |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  }
+  // Queried for every decision, so earlier allocations, ours or another
+  // process's, are accounted for.
+  const std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> budgets = heapBudgets();
+  // Never hand out lazily allocated or protected memory implicitly.
+  const VkMemoryPropertyFlags excluded =
+      VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT |
+      VK_MEMORY_PROPERTY_PROTECTED_BIT;
+
+  uint32_t bestType = kInvalidMemoryType;
+  int bestScore = -1;
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    const VkMemoryType &type = memProperties.memoryTypes[i];
+    if (!(typeFilter & (1u << i)) ||
+        (type.propertyFlags & flags.required) != flags.required ||
+        (type.propertyFlags & excluded)) {
+      continue;
+    }
+    if (budgets[type.heapIndex] < size) {
+      continue;
+    }
+
+    int score = 1;
+    if (flags.preferred[0] &&
+        (type.propertyFlags & flags.preferred[0]) == flags.preferred[0]) {
+      score += 4;
+    }
+    if (flags.preferred[1] &&
+        (type.propertyFlags & flags.preferred[1]) == flags.preferred[1]) {
+      score += 2;
+    }
+    if (type.propertyFlags & flags.avoided) {
+      score -= 1;
+    }
+    // Lower indices win ties, as the spec orders types by performance.
+    if (score > bestScore) {
+      bestScore = score;
+      bestType = i;
+    }
+  }
+  return bestType;
+}
+
+uint32_t MemoryTypeSelector::findMemoryType(
+    uint32_t typeFilter, VkMemoryPropertyFlags required) const {
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1u << i)) &&
+        (memProperties.memoryTypes[i].propertyFlags & required) == required) {
+      return i;
+    }
+  }
+  return kInvalidMemoryType;
+}
+
+bool MemoryTypeSelector::isHostVisible(uint32_t memoryType) const {
+  return memProperties.memoryTypes[memoryType].propertyFlags &
+         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+bool MemoryTypeSelector::isHostCoherent(uint32_t memoryType) const {
+  return memProperties.memoryTypes[memoryType].propertyFlags &
+         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+bool MemoryTypeSelector::isHostCached(uint32_t memoryType) const {
+  return memProperties.memoryTypes[memoryType].propertyFlags &
+         VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+}
+
+}  // namespace vkt
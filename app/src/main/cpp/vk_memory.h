@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_VK_MEMORY_H
+#define HELLOVK_VK_MEMORY_H
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+
+namespace vkt {
+
+/*
+ * Describes how a resource is accessed over its lifetime. The memory type is
+ * chosen from this intent rather than from a raw set of property flags, which
+ * lets the same call site pick the best type on both discrete-style and
+ * unified-memory (most Android) GPUs.
+ */
+enum class MemoryUsage {
+  // Only accessed by the GPU. Filled through a transfer, or written directly
+  // when the hardware exposes host visible device local memory.
+  kGpuOnly,
+  // Written sequentially by the CPU once and read by the GPU, i.e. staging.
+  kUpload,
+  // Written by the GPU and read back by the CPU.
+  kReadback,
+  // Rewritten by the CPU every frame, i.e. uniform buffers.
+  kDynamic,
+  // Written by the CPU with reads in between, i.e. an image decoder working
+  // in place, then read by the GPU. Prefers cached memory.
+  kHostDecode,
+};
+
+/*
+ * MemoryTypeSelector caches the physical device memory properties once and
+ * picks memory types by scoring every compatible type against the usage
+ * intent. Types whose heap cannot fit the allocation within its budget are
+ * skipped. When VK_EXT_memory_budget is available the budget comes from the
+ * driver and is queried again for every allocation, otherwise the heap size
+ * is used.
+ */
+class MemoryTypeSelector {
+ public:
+  static constexpr uint32_t kInvalidMemoryType = UINT32_MAX;
+
+  void init(VkPhysicalDevice physicalDevice, bool memoryBudgetSupported);
+
+  // What each heap can still take: the driver's budget less its current
+  // usage with VK_EXT_memory_budget, otherwise the heap size.
+  std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapBudgets() const;
+
+  // Returns the best memory type allowed by typeFilter for the given usage,
+  // or kInvalidMemoryType if none of the allowed types qualifies.
+  uint32_t findMemoryType(uint32_t typeFilter, MemoryUsage usage,
+                          VkDeviceSize size) const;
+
+  // Returns the first type containing all of the required property flags.
+  uint32_t findMemoryType(uint32_t typeFilter,
+                          VkMemoryPropertyFlags required) const;
+
+  bool isHostVisible(uint32_t memoryType) const;
+  bool isHostCoherent(uint32_t memoryType) const;
+  bool isHostCached(uint32_t memoryType) const;
+
+  /*
+   * True when every device local heap can also be mapped by the CPU. On such
+   * hardware a kGpuOnly buffer can be written directly instead of going
+   * through a staging buffer and a copy.
+   */
+  bool isUnifiedMemory() const { return unifiedMemory; }
+
+  const VkPhysicalDeviceMemoryProperties &properties() const {
+    return memProperties;
+  }
+
+ private:
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties memProperties{};
+  bool budgetSupported = false;
+  bool unifiedMemory = false;
+};
+
+}  // namespace vkt
+
+#endif  // HELLOVK_VK_MEMORY_H
@@ -1,4 +1,5 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
 layout(location = 0) in vec2 vTexCoords;
 
@@ -7,6 +8,11 @@ layout(binding = 1) uniform sampler2D samp;
 // Output colour for the fragment
 layout(location = 0) out vec4 outColor;
 
+#include "srgb.glsl"
+
 void main() {
     outColor = texture(samp, vTexCoords);
+    if (ENCODE_SRGB) {
+        outColor.rgb = linearToSrgb(outColor.rgb);
+    }
 }
\ No newline at end of file
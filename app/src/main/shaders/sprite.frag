@@ -0,0 +1,19 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout(location = 0) in vec2 vTexCoords;
+layout(location = 1) in vec4 vColor;
+
+// The atlas shared by every sprite in the batch.
+layout(binding = 1) uniform sampler2D samp;
+
+layout(location = 0) out vec4 outColor;
+
+#include "srgb.glsl"
+
+void main() {
+    outColor = texture(samp, vTexCoords) * vColor;
+    if (ENCODE_SRGB) {
+        outColor.rgb = linearToSrgb(outColor.rgb);
+    }
+}
@@ -0,0 +1,38 @@
+#version 450
+
+// Same uniform buffer as shader.vert, so sprites share the descriptor set
+// layout and follow the pre-rotation.
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 MVP;
+} ubo;
+
+// Per-instance attributes, see SpriteInstance in sprite_batch.h.
+layout(location = 0) in vec2 inCenter;
+layout(location = 1) in vec2 inHalfSize;
+layout(location = 2) in vec4 inUvRect;
+layout(location = 3) in float inRotation;
+layout(location = 4) in vec4 inColor;
+
+// Corners of the unit quad, indexed as two clockwise triangles by
+// SPRITE_QUAD_INDICES in sprite_batch.h.
+vec2 corners[4] = vec2[](
+    vec2(-1.0, -1.0),
+    vec2(1.0, -1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, 1.0)
+);
+
+layout(location = 0) out vec2 vTexCoords;
+layout(location = 1) out vec4 vColor;
+
+void main() {
+    vec2 corner = corners[gl_VertexIndex];
+    float s = sin(inRotation);
+    float c = cos(inRotation);
+    vec2 offset = corner * inHalfSize;
+    vec2 position = inCenter + vec2(c * offset.x - s * offset.y,
+                                    s * offset.x + c * offset.y);
+    gl_Position = ubo.MVP * vec4(position, 0.0, 1.0);
+    vTexCoords = mix(inUvRect.xy, inUvRect.zw, corner * 0.5 + 0.5);
+    vColor = inColor;
+}
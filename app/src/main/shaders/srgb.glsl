@@ -0,0 +1,10 @@
+// Encoding to sRGB for the fragment shaders, included by them.
+
+// Set when the swapchain is UNORM and cannot encode to sRGB itself.
+layout(constant_id = 0) const bool ENCODE_SRGB = false;
+
+vec3 linearToSrgb(vec3 color) {
+    vec3 higher = 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055;
+    vec3 lower = color * 12.92;
+    return mix(higher, lower, lessThan(color, vec3(0.0031308)));
+}
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Offline asset cooker. Decodes a source image, generates its mip chain and
+ * writes it in the GPU-ready layout described in cooked_texture.h, so the
+ * app only has to copy (or inflate) the data into a staging buffer.
+ *
+ * Usage: asset_cooker [--no-mips] [--zlib] [--chunk-rows N] [--format F]
+ *                     [--linear] <input image> <output .vkt>
+ *
+ * --format is one of auto (the default), r8g8b8a8, r5g6b5, b4g4r4a4 or
+ * a2b10g10r10. auto picks the smallest format that keeps the image within
+ * the default vkt::FormatPolicy.
+ *
+ * Images are treated as sRGB encoded colour unless --linear is given, for
+ * data such as normal maps or masks. Colour mips are filtered in linear space
+ * and the texture is flagged to be sampled through an _SRGB format.
+ *
+ * With --zlib, each mip is compressed as independent bands of N rows (64 by
+ * default) so the app can inflate them on several threads.
+ */
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "cooked_texture.h"
+#include "pixel_format.h"
+
+namespace {
+
+const uint32_t kBytesPerPixel = 4;
+const uint32_t kDefaultChunkRows = 64;
+
+struct Image {
+  uint32_t width;
+  uint32_t height;
+  std::vector<uint8_t> pixels;
+};
+
+// 2x2 box filter. Odd edges reuse the last row/column.
+Image downsample(const Image &source) {
+  Image result;
+  result.width = std::max(source.width / 2, 1u);
+  result.height = std::max(source.height / 2, 1u);
+  result.pixels.resize(static_cast<size_t>(result.width) * result.height *
+                       kBytesPerPixel);
+  for (uint32_t y = 0; y < result.height; y++) {
+    uint32_t y0 = std::min(y * 2, source.height - 1);
+    uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+    for (uint32_t x = 0; x < result.width; x++) {
+      uint32_t x0 = std::min(x * 2, source.width - 1);
+      uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+      for (uint32_t c = 0; c < kBytesPerPixel; c++) {
+        auto texel = [&](uint32_t sx, uint32_t sy) {
+          return source.pixels[(static_cast<size_t>(sy) * source.width + sx) *
+                                   kBytesPerPixel +
+                               c];
+        };
+        uint32_t sum = texel(x0, y0) + texel(x1, y0) + texel(x0, y1) +
+                       texel(x1, y1);
+        result.pixels[(static_cast<size_t>(y) * result.width + x) *
+                          kBytesPerPixel +
+                      c] = static_cast<uint8_t>((sum + 2) / 4);
+      }
+    }
+  }
+  return result;
+}
+
+// The same filter applied to linear values. Averaging sRGB encoded values
+// directly would darken every mip.
+Image downsampleSrgb(const Image &source) {
+  const size_t sourceCount =
+      static_cast<size_t>(source.width) * source.height;
+  std::vector<float> linear(sourceCount * kBytesPerPixel);
+  vkt::decodeSrgb(source.pixels.data(), linear.data(), sourceCount);
+
+  Image result;
+  result.width = std::max(source.width / 2, 1u);
+  result.height = std::max(source.height / 2, 1u);
+  const size_t resultCount =
+      static_cast<size_t>(result.width) * result.height;
+  std::vector<float> filtered(resultCount * kBytesPerPixel);
+  for (uint32_t y = 0; y < result.height; y++) {
+    uint32_t y0 = std::min(y * 2, source.height - 1);
+    uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+    for (uint32_t x = 0; x < result.width; x++) {
+      uint32_t x0 = std::min(x * 2, source.width - 1);
+      uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+      for (uint32_t c = 0; c < kBytesPerPixel; c++) {
+        auto texel = [&](uint32_t sx, uint32_t sy) {
+          return linear[(static_cast<size_t>(sy) * source.width + sx) *
+                            kBytesPerPixel +
+                        c];
+        };
+        filtered[(static_cast<size_t>(y) * result.width + x) *
+                     kBytesPerPixel +
+                 c] = (texel(x0, y0) + texel(x1, y0) + texel(x0, y1) +
+                       texel(x1, y1)) *
+                      0.25f;
+      }
+    }
+  }
+  result.pixels.resize(resultCount * kBytesPerPixel);
+  vkt::encodeSrgb(filtered.data(), result.pixels.data(), resultCount);
+  return result;
+}
+
+struct FormatName {
+  const char *name;
+  vkt::PixelFormat format;
+};
+
+const FormatName kFormatNames[] = {
+    {"r8g8b8a8", vkt::PixelFormat::kR8G8B8A8},
+    {"r5g6b5", vkt::PixelFormat::kR5G6B5},
+    {"b4g4r4a4", vkt::PixelFormat::kB4G4R4A4},
+    {"a2b10g10r10", vkt::PixelFormat::kA2B10G10R10},
+};
+
+uint64_t alignOffset(uint64_t offset) {
+  const uint64_t alignment = vkt::COOKED_TEXTURE_ALIGNMENT;
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+void printUsage() {
+  fprintf(stderr,
+          "usage: asset_cooker [--no-mips] [--zlib] [--chunk-rows N] "
+          "[--format auto|r8g8b8a8|r5g6b5|b4g4r4a4|a2b10g10r10] "
+          "[--linear] <input image> <output .vkt>\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  bool generateMips = true;
+  bool compress = false;
+  uint32_t chunkRows = kDefaultChunkRows;
+  const FormatName *format = nullptr;  // auto
+  bool srgb = true;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--no-mips") == 0) {
+      generateMips = false;
+    } else if (strcmp(argv[i], "--zlib") == 0) {
+      compress = true;
+    } else if (strcmp(argv[i], "--chunk-rows") == 0 && i + 1 < argc &&
+               atoi(argv[i + 1]) > 0) {
+      chunkRows = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--linear") == 0) {
+      srgb = false;
+    } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      const char *name = argv[++i];
+      format = nullptr;
+      for (const FormatName &candidate : kFormatNames) {
+        if (strcmp(name, candidate.name) == 0) {
+          format = &candidate;
+        }
+      }
+      if (format == nullptr && strcmp(name, "auto") != 0) {
+        printUsage();
+        return 1;
+      }
+    } else if (argv[i][0] == '-') {
+      printUsage();
+      return 1;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.size() != 2) {
+    printUsage();
+    return 1;
+  }
+
+  int width, height, channels;
+  stbi_uc *decoded = stbi_load(paths[0].c_str(), &width, &height, &channels,
+                               kBytesPerPixel);
+  if (decoded == nullptr) {
+    fprintf(stderr, "failed to load %s: %s\n", paths[0].c_str(),
+            stbi_failure_reason());
+    return 1;
+  }
+
+  std::vector<Image> mips(1);
+  mips[0].width = width;
+  mips[0].height = height;
+  mips[0].pixels.assign(decoded,
+                        decoded + static_cast<size_t>(width) * height *
+                                      kBytesPerPixel);
+  stbi_image_free(decoded);
+  while (generateMips && (mips.back().width > 1 || mips.back().height > 1)) {
+    mips.push_back(srgb ? downsampleSrgb(mips.back())
+                        : downsample(mips.back()));
+  }
+
+  // The format is chosen on the top level and used for the whole chain.
+  if (format == nullptr) {
+    vkt::FormatPolicy policy;
+    policy.srgb = srgb;
+    const vkt::PixelFormat chosen = vkt::choosePixelFormat(
+        mips[0].pixels.data(), mips[0].pixels.size() / kBytesPerPixel,
+        policy);
+    for (const FormatName &candidate : kFormatNames) {
+      if (candidate.format == chosen) {
+        format = &candidate;
+      }
+    }
+  }
+  if (srgb && format->format != vkt::PixelFormat::kR8G8B8A8) {
+    fprintf(stderr, "%s has no sRGB variant, use --linear for data\n",
+            format->name);
+    return 1;
+  }
+  const uint32_t bytesPerPixel = vkt::bytesPerPixel(format->format);
+  for (Image &mip : mips) {
+    const size_t pixelCount = static_cast<size_t>(mip.width) * mip.height;
+    std::vector<uint8_t> converted(pixelCount * bytesPerPixel);
+    vkt::convertPixels(format->format, mip.pixels.data(), converted.data(),
+                       pixelCount);
+    mip.pixels = std::move(converted);
+  }
+
+  vkt::CookedTextureHeader header{};
+  header.magic = vkt::COOKED_TEXTURE_MAGIC;
+  header.version = vkt::COOKED_TEXTURE_VERSION;
+  header.format = static_cast<uint32_t>(format->format);
+  header.flags = (compress ? uint32_t(vkt::COOKED_TEXTURE_ZLIB) : 0u) |
+                 (srgb ? uint32_t(vkt::COOKED_TEXTURE_SRGB) : 0u);
+  header.width = width;
+  header.height = height;
+  header.mipLevels = static_cast<uint32_t>(mips.size());
+  header.bytesPerPixel = bytesPerPixel;
+
+  std::vector<vkt::CookedTextureMip> mipTable(mips.size());
+  std::vector<vkt::CookedTextureChunk> chunkTable;
+  // Payloads hold one entry per chunk, or one per mip when uncompressed.
+  std::vector<std::vector<uint8_t>> payloads;
+  for (size_t i = 0; i < mips.size(); i++) {
+    mipTable[i].uncompressedSize =
+        static_cast<uint64_t>(mips[i].width) * mips[i].height * bytesPerPixel;
+    mipTable[i].width = mips[i].width;
+    mipTable[i].height = mips[i].height;
+    if (!compress) {
+      payloads.push_back(std::move(mips[i].pixels));
+      continue;
+    }
+
+    const size_t rowBytes = static_cast<size_t>(mips[i].width) * bytesPerPixel;
+    mipTable[i].firstChunk = static_cast<uint32_t>(chunkTable.size());
+    for (uint32_t row = 0; row < mips[i].height; row += chunkRows) {
+      vkt::CookedTextureChunk chunk{};
+      chunk.firstRow = row;
+      chunk.rowCount = std::min(chunkRows, mips[i].height - row);
+      const size_t chunkBytes = rowBytes * chunk.rowCount;
+      uLongf compressedSize = compressBound(chunkBytes);
+      std::vector<uint8_t> payload(compressedSize);
+      if (compress2(payload.data(), &compressedSize,
+                    mips[i].pixels.data() + rowBytes * row, chunkBytes,
+                    Z_BEST_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "failed to compress mip %zu\n", i);
+        return 1;
+      }
+      payload.resize(compressedSize);
+      chunk.size = compressedSize;
+      chunkTable.push_back(chunk);
+      payloads.push_back(std::move(payload));
+    }
+    mipTable[i].chunkCount =
+        static_cast<uint32_t>(chunkTable.size()) - mipTable[i].firstChunk;
+  }
+
+  // Chunks of a mip are stored back to back, so the mip's offset and size
+  // still describe its whole data region.
+  uint64_t offset = alignOffset(
+      sizeof(header) + mipTable.size() * sizeof(mipTable[0]) +
+      chunkTable.size() * sizeof(vkt::CookedTextureChunk));
+  std::vector<uint64_t> payloadOffsets;
+  for (size_t i = 0; i < mips.size(); i++) {
+    mipTable[i].offset = offset;
+    if (!compress) {
+      payloadOffsets.push_back(offset);
+      offset += payloads[i].size();
+    } else {
+      for (uint32_t c = 0; c < mipTable[i].chunkCount; c++) {
+        vkt::CookedTextureChunk &chunk = chunkTable[mipTable[i].firstChunk + c];
+        chunk.offset = offset;
+        payloadOffsets.push_back(offset);
+        offset += chunk.size;
+      }
+    }
+    mipTable[i].size = offset - mipTable[i].offset;
+    offset = alignOffset(offset);
+  }
+
+  FILE *output = fopen(paths[1].c_str(), "wb");
+  if (output == nullptr) {
+    fprintf(stderr, "failed to open %s for writing\n", paths[1].c_str());
+    return 1;
+  }
+  std::vector<uint8_t> file(offset, 0);
+  uint8_t *tables = file.data();
+  memcpy(tables, &header, sizeof(header));
+  tables += sizeof(header);
+  memcpy(tables, mipTable.data(), mipTable.size() * sizeof(mipTable[0]));
+  tables += mipTable.size() * sizeof(mipTable[0]);
+  memcpy(tables, chunkTable.data(),
+         chunkTable.size() * sizeof(vkt::CookedTextureChunk));
+  for (size_t i = 0; i < payloads.size(); i++) {
+    memcpy(file.data() + payloadOffsets[i], payloads[i].data(),
+           payloads[i].size());
+  }
+  bool written = fwrite(file.data(), 1, file.size(), output) == file.size();
+  written = fclose(output) == 0 && written;
+  if (!written) {
+    fprintf(stderr, "failed to write %s\n", paths[1].c_str());
+    return 1;
+  }
+
+  printf("%s: %dx%d %s, %zu mips, %zu bytes", paths[1].c_str(), width,
+         height, format->name, mips.size(), file.size());
+  if (compress) {
+    printf(" (zlib, %zu chunks)", chunkTable.size());
+  }
+  printf("\n");
+  return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Builds the kind of transient containers a frame needs (a draw list grown
+ * by push_back, reserved barrier batches, many small per-object lists and a
+ * node-based map) with std::allocator and with a LinearArena that is reset
+ * every frame, and reports the time per frame for each.
+ *
+ * Usage: arena_bench [frames] [draws per frame]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "frame_arena.h"
+
+namespace {
+
+struct Draw {
+  uint32_t vertexCount, instanceCount, firstVertex, firstInstance;
+};
+
+// The size of a VkImageMemoryBarrier.
+struct Barrier {
+  uint64_t words[9];
+};
+
+const int kBarrierBatches = 8;
+const int kBarriersPerBatch = 16;
+const int kObjectLists = 256;
+const int kMapEntries = 128;
+
+/*
+ * One frame's worth of containers from allocators made by makeAllocator,
+ * which is called with a dummy value of each element type. Returns a
+ * checksum so the work cannot be optimized away.
+ */
+template <template <typename> class Allocator, typename Make>
+uint64_t buildFrame(uint32_t draws, const Make &makeAllocator) {
+  uint64_t checksum = 0;
+
+  std::vector<Draw, Allocator<Draw>> drawList(makeAllocator(Draw{}));
+  for (uint32_t i = 0; i < draws; i++) {
+    drawList.push_back({3, 1, 0, i});
+  }
+  checksum += drawList.size();
+
+  for (int b = 0; b < kBarrierBatches; b++) {
+    std::vector<Barrier, Allocator<Barrier>> barriers(makeAllocator(Barrier{}));
+    barriers.reserve(kBarriersPerBatch);
+    for (int i = 0; i < kBarriersPerBatch; i++) {
+      barriers.push_back({{uint64_t(b), uint64_t(i)}});
+    }
+    checksum += barriers.back().words[1];
+  }
+
+  for (int o = 0; o < kObjectLists; o++) {
+    std::vector<uint32_t, Allocator<uint32_t>> list(makeAllocator(0u));
+    for (uint32_t i = 0; i < 8; i++) {
+      list.push_back(o + i);
+    }
+    checksum += list[7];
+  }
+
+  using Entry = std::pair<const uint32_t, uint32_t>;
+  std::map<uint32_t, uint32_t, std::less<uint32_t>, Allocator<Entry>> map(
+      makeAllocator(Entry{0, 0}));
+  for (uint32_t i = 0; i < kMapEntries; i++) {
+    map.emplace((i * 2654435761u) % 1000, i);
+  }
+  checksum += map.begin()->second;
+  return checksum;
+}
+
+double bestNsPerFrame(uint32_t frames, const std::function<uint64_t()> &frame,
+                      uint64_t &checksum) {
+  double best = 1e30;
+  for (int repeat = 0; repeat < 5; repeat++) {
+    checksum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t f = 0; f < frames; f++) {
+      checksum += frame();
+    }
+    const std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count() / frames);
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000;
+  const uint32_t draws = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000;
+
+  uint64_t heapChecksum = 0;
+  const double heapNs = bestNsPerFrame(
+      frames,
+      [&] {
+        return buildFrame<std::allocator>(draws, [](auto value) {
+          return std::allocator<decltype(value)>();
+        });
+      },
+      heapChecksum);
+
+  vkt::LinearArena arena;
+  uint64_t arenaChecksum = 0;
+  const double arenaNs = bestNsPerFrame(
+      frames,
+      [&] {
+        arena.reset();
+        return buildFrame<vkt::ArenaAllocator>(draws, [&](auto value) {
+          return vkt::ArenaAllocator<decltype(value)>(arena);
+        });
+      },
+      arenaChecksum);
+
+  printf("%u draws, %d barrier batches, %d object lists, %d map entries\n",
+         draws, kBarrierBatches, kObjectLists, kMapEntries);
+  printf("- std::allocator: %9.1f us/frame\n", heapNs / 1e3);
+  printf("- LinearArena:    %9.1f us/frame %5.2fx, %zu KiB used of %zu\n",
+         arenaNs / 1e3, heapNs / arenaNs, arena.bytesUsed() / 1024,
+         arena.capacity() / 1024);
+  if (heapChecksum != arenaChecksum) {
+    fprintf(stderr, "checksums differ\n");
+    return 1;
+  }
+  return 0;
+}
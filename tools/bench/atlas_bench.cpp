@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures packing efficiency and time of the texture atlas builder on
+ * synthetic image sets.
+ *
+ * Usage: atlas_bench [image count] [mip levels]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "texture_atlas.h"
+
+int main(int argc, char **argv) {
+  const uint32_t imageCount = argc > 1 ? atoi(argv[1]) : 4096;
+  const uint32_t mipLevels = argc > 2 ? atoi(argv[2]) : 1;
+
+  // Sprite-like size distribution: mostly small, a few large images.
+  std::mt19937 random(42);
+  std::lognormal_distribution<float> size(3.5f, 0.6f);
+  std::vector<uint32_t> dimensions;
+  size_t largest = 0;
+  for (uint32_t i = 0; i < imageCount * 2; i++) {
+    uint32_t dimension =
+        std::min<uint32_t>(std::max<uint32_t>(size(random), 4), 256);
+    dimensions.push_back(dimension);
+    largest = std::max<size_t>(largest, dimension);
+  }
+
+  // The packer does not care about contents, share one source buffer.
+  std::vector<uint8_t> pixels(largest * largest * 4, 0xff);
+  std::vector<vkt::AtlasImage> images;
+  for (uint32_t i = 0; i < imageCount; i++) {
+    images.push_back({pixels.data(), dimensions[2 * i], dimensions[2 * i + 1]});
+  }
+
+  vkt::AtlasBuildOptions options;
+  options.maxSize = 16384;
+  options.mipLevels = mipLevels;
+
+  const int iterations = 5;
+  double bestMs = 1e30;
+  vkt::TextureAtlas atlas;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    if (!atlas.build(images, options)) {
+      fprintf(stderr, "images do not fit in %ux%u\n", options.maxSize,
+              options.maxSize);
+      return 1;
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    bestMs = std::min(bestMs, elapsed.count());
+  }
+
+  printf("images=%u mips=%u atlas=%ux%u occupancy=%.1f%% time=%.2fms\n",
+         imageCount, mipLevels, atlas.width(), atlas.height(),
+         atlas.occupancy() * 100.0, bestMs);
+  return 0;
+}
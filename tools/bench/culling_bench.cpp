@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures frustum culling throughput for bounding spheres and boxes, and
+ * checks the visible lists against a double precision reference.
+ *
+ * Usage: culling_bench [objects] [threads]
+ * Defaults to 200000 objects scattered around a perspective camera.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum_culling.h"
+#include "job_system.h"
+
+namespace {
+
+double bestTimeMs(const std::function<void()> &kernel) {
+  const int iterations = 20;
+  double bestMs = 1e30;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    kernel();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    bestMs = std::min(bestMs, elapsed.count());
+  }
+  return bestMs;
+}
+
+/*
+ * Counts objects whose visibility differs from the reference, ignoring
+ * objects within a rounding margin of a plane. reach(i, plane) is the
+ * object's extent towards the plane.
+ */
+int countMismatches(const vkt::Frustum &frustum, uint32_t count,
+                    const std::vector<uint32_t> &visible,
+                    const std::function<glm::dvec3(uint32_t)> &center,
+                    const std::function<double(uint32_t, int)> &reach) {
+  std::vector<bool> culledVisible(count);
+  for (uint32_t index : visible) {
+    culledVisible[index] = true;
+  }
+  int mismatches = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    double closest = 1e30;
+    for (int p = 0; p < 6; p++) {
+      const glm::dvec4 plane(frustum.planes[p]);
+      closest = std::min(closest, glm::dot(glm::dvec3(plane), center(i)) +
+                                      plane.w + reach(i, p));
+    }
+    if (std::abs(closest) > 1e-3 && (closest >= 0) != culledVisible[i]) {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+  const uint32_t threads =
+      argc > 2 ? strtoul(argv[2], nullptr, 10)
+               : std::max(1u, std::thread::hardware_concurrency());
+
+  // Objects fill a cube around the camera, so roughly a tenth of them end
+  // up inside the frustum.
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+  std::uniform_real_distribution<float> size(0.5f, 5.0f);
+  vkt::BoundingSpheres spheres;
+  vkt::BoundingBoxes boxes;
+  spheres.resize(count);
+  boxes.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 center(position(random), position(random), position(random));
+    glm::vec3 extent(size(random), size(random), size(random));
+    spheres.set(i, center, glm::length(extent));
+    boxes.set(i, center - extent, center + extent);
+  }
+  const glm::mat4 viewProjection =
+      glm::perspectiveRH_ZO(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 400.0f) *
+      glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, -1.0f),
+                  glm::vec3(0.0f, 1.0f, 0.0f));
+  const vkt::Frustum frustum = vkt::extractFrustum(viewProjection);
+
+  std::vector<uint32_t> visible;
+  printf("%u objects\n", count);
+  int mismatches = 0;
+  for (uint32_t threadCount : {1u, threads}) {
+    vkt::JobSystem jobs(threadCount - 1);
+    double ms = bestTimeMs(
+        [&] { vkt::cullSpheres(frustum, spheres, visible, &jobs); });
+    printf("- spheres, %u threads: %7.3fms %6.1f objects/us %6zu visible\n",
+           threadCount, ms, count / (ms * 1e3), visible.size());
+    mismatches += countMismatches(
+        frustum, count, visible,
+        [&](uint32_t i) {
+          return glm::dvec3(spheres.centerX[i], spheres.centerY[i],
+                            spheres.centerZ[i]);
+        },
+        [&](uint32_t i, int) { return double(spheres.radius[i]); });
+
+    ms = bestTimeMs(
+        [&] { vkt::cullBoxes(frustum, boxes, visible, &jobs); });
+    printf("- boxes,   %u threads: %7.3fms %6.1f objects/us %6zu visible\n",
+           threadCount, ms, count / (ms * 1e3), visible.size());
+    mismatches += countMismatches(
+        frustum, count, visible,
+        [&](uint32_t i) {
+          return glm::dvec3(boxes.centerX[i], boxes.centerY[i],
+                            boxes.centerZ[i]);
+        },
+        [&](uint32_t i, int p) {
+          const glm::vec4 &plane = frustum.planes[p];
+          return std::abs(double(plane.x)) * boxes.extentX[i] +
+                 std::abs(double(plane.y)) * boxes.extentY[i] +
+                 std::abs(double(plane.z)) * boxes.extentZ[i];
+        });
+    if (threads == 1) {
+      break;
+    }
+  }
+
+  if (mismatches != 0) {
+    fprintf(stderr, "%d objects differ from the reference\n", mismatches);
+    return 1;
+  }
+  printf("all visible lists match the reference\n");
+  return 0;
+}
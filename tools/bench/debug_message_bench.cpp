@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures what a validation message costs the thread that triggers it:
+ * formatting and writing it on the spot, as the debug callback used to, and
+ * posting it to a DebugMessageSink. Then checks that the sink counted every
+ * message under its ID.
+ *
+ * Usage: debug_message_bench [threads]
+ * Output goes to /dev/null, so the synchronous numbers are a lower bound:
+ * a terminal or logcat is much slower. Messages are posted in batches the
+ * queue can hold, with pauses for the logger thread in between, so nothing
+ * is dropped and the timings are of the posting path alone.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "debug_messages.h"
+
+namespace {
+
+const int kBatches = 50;
+const int kMessagesPerBatch = 96;
+const int kDistinctIds = 20;
+
+FILE *output = nullptr;
+
+void writeMessage(vkt::MessageSeverity, const char *text) {
+  fputs(text, output);
+  fputc('\n', output);
+}
+
+// A validation message of typical length.
+const std::string &messageText() {
+  static const std::string text =
+      "Validation Performance Warning: [ UNASSIGNED-BestPractices-vkCmdDraw-"
+      "many-small-draws ] Object 0: handle = 0x7f00aa001230, type = "
+      "VK_OBJECT_TYPE_COMMAND_BUFFER; | vkCmdDraw(): the command buffer "
+      "records " +
+      std::string(240, 'x') + " draws with few vertices each.";
+  return text;
+}
+
+double nowNs() {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Best nanoseconds per message over the batches.
+template <typename Post>
+double messageNs(int messagesPerBatch, Post post) {
+  char names[kDistinctIds][32];
+  for (int i = 0; i < kDistinctIds; i++) {
+    snprintf(names[i], sizeof(names[i]), "UNASSIGNED-bench-%d", i);
+  }
+  double best = 1e30;
+  for (int b = 0; b < kBatches; b++) {
+    const double start = nowNs();
+    for (int i = 0; i < messagesPerBatch; i++) {
+      const int id = i % kDistinctIds;
+      post(id, names[id], messageText().c_str());
+    }
+    best = std::min(best, (nowNs() - start) / messagesPerBatch);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t threads =
+      std::max(1ul, argc > 1 ? strtoul(argv[1], nullptr, 10) : 4ul);
+  output = fopen("/dev/null", "w");
+  if (output == nullptr) {
+    fprintf(stderr, "cannot open /dev/null\n");
+    return 1;
+  }
+
+  const double synchronousNs =
+      messageNs(kMessagesPerBatch, [](int id, const char * /* name */,
+                                      const char *text) {
+        fprintf(output, "[%s: %s]\n%s (%d)\n", "WARNING",
+                vkt::messageTypeName(vkt::MESSAGE_TYPE_VALIDATION |
+                                     vkt::MESSAGE_TYPE_PERFORMANCE),
+                text, id);
+        fflush(output);
+      });
+  printf("- synchronous write:  %7.1f ns/message\n", synchronousNs);
+
+  vkt::DebugMessageSink sink(writeMessage);
+  sink.start(vkt::DebugMessageFilter());
+  auto post = [&sink](int id, const char *name, const char *text) {
+    sink.post(vkt::MessageSeverity::kWarning,
+              vkt::MESSAGE_TYPE_VALIDATION | vkt::MESSAGE_TYPE_PERFORMANCE,
+              id, name, text);
+  };
+  printf("- sink, 1 thread:     %7.1f ns/message\n",
+         messageNs(kMessagesPerBatch, post));
+
+  // Together the threads post no more per batch than the queue holds.
+  const int perThread = std::max(1, kMessagesPerBatch / int(threads));
+  std::vector<double> results(threads);
+  std::vector<std::thread> workers;
+  for (uint32_t t = 0; t < threads; t++) {
+    workers.emplace_back([t, perThread, &results, &post] {
+      results[t] = messageNs(perThread, post);
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  printf("- sink, %u threads:    %7.1f ns/message (slowest thread)\n",
+         threads, *std::max_element(results.begin(), results.end()));
+
+  const vkt::DebugMessageStats stats = sink.stop();
+  fclose(output);
+  const uint64_t expected =
+      uint64_t(kBatches) * (kMessagesPerBatch + perThread * threads);
+  printf("%llu of %llu messages received, %llu dropped, %u distinct IDs\n",
+         (unsigned long long)stats.received, (unsigned long long)expected,
+         (unsigned long long)stats.dropped, stats.distinct);
+  if (stats.received != expected || stats.distinct != kDistinctIds) {
+    fprintf(stderr, "messages went missing\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures PNG/JPEG decode throughput of the app's image codec build, both
+ * decoding to the heap and copying into a staging area (the old path) and
+ * decoding in place. For each it also reports the decoder's peak heap use
+ * and the bytes it allocated and copied, counted by the stb allocation
+ * hooks in image_codec.cpp. decode_bench_scalar is the same benchmark built
+ * with STBI_NO_SIMD, for comparison.
+ *
+ * Usage: decode_bench [image files...]
+ * Defaults to the app's texture.png.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "image_codec.h"
+
+namespace {
+
+const int kRequiredChannels = 4;
+const int kIterations = 20;
+
+template <typename Decode>
+double bestTimeMs(Decode decode) {
+  double bestMs = 1e30;
+  for (int i = 0; i < kIterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    decode();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    bestMs = std::min(bestMs, elapsed.count());
+  }
+  return bestMs;
+}
+
+// Runs decode once more, counting what it does with memory. copiedBytes are
+// bytes the caller copies on top of the decoder.
+template <typename Decode>
+vkt::DecodeStats measureMemory(Decode decode, size_t copiedBytes) {
+  vkt::resetDecodeStats();
+  decode();
+  vkt::DecodeStats stats = vkt::decodeStats();
+  stats.copiedBytes += copiedBytes;
+  return stats;
+}
+
+void printMemory(const char *name, const vkt::DecodeStats &stats) {
+  printf("  %s: peak %.2f MiB, allocated %.2f MiB in %zu blocks, "
+         "copied %.2f MiB\n",
+         name, stats.peakBytes / 1048576.0, stats.allocatedBytes / 1048576.0,
+         stats.allocations, stats.copiedBytes / 1048576.0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> paths(argv + 1, argv + argc);
+  if (paths.empty()) {
+    paths.push_back(HELLOVK_ASSETS_DIR "/texture.png");
+  }
+
+#if defined(STBI_NO_SIMD)
+  printf("simd=off\n");
+#else
+  printf("simd=on\n");
+#endif
+
+  double totalHeapMs = 0.0;
+  double totalInPlaceMs = 0.0;
+  double totalMegapixels = 0.0;
+  for (const std::string &path : paths) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<stbi_uc> encoded((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>());
+    int width, height, channels;
+    if (encoded.empty() ||
+        !stbi_info_from_memory(encoded.data(), encoded.size(), &width,
+                               &height, &channels)) {
+      fprintf(stderr, "cannot read %s\n", path.c_str());
+      return 1;
+    }
+    const size_t imageSize =
+        static_cast<size_t>(width) * height * kRequiredChannels;
+    std::vector<stbi_uc> staging(imageSize);
+
+    bool failed = false;
+    auto heapDecode = [&] {
+      stbi_uc *pixels = vkt::loadImageFromMemory(
+          encoded.data(), encoded.size(), kRequiredChannels, nullptr, 0,
+          &width, &height, &channels);
+      failed |= pixels == nullptr;
+      if (pixels != nullptr) {
+        memcpy(staging.data(), pixels, imageSize);
+        stbi_image_free(pixels);
+      }
+    };
+    auto inPlaceDecode = [&] {
+      failed |= vkt::loadImageFromMemory(
+                    encoded.data(), encoded.size(), kRequiredChannels,
+                    staging.data(), imageSize, &width, &height,
+                    &channels) == nullptr;
+    };
+    double heapMs = bestTimeMs(heapDecode);
+    double inPlaceMs = bestTimeMs(inPlaceDecode);
+    vkt::DecodeStats heapMemory = measureMemory(heapDecode, imageSize);
+    vkt::DecodeStats inPlaceMemory = measureMemory(inPlaceDecode, 0);
+    if (failed) {
+      fprintf(stderr, "cannot decode %s: %s\n", path.c_str(),
+              stbi_failure_reason());
+      return 1;
+    }
+
+    const double megapixels = static_cast<double>(width) * height / 1e6;
+    printf("%s %dx%d heap+copy=%.2fms (%.1f MP/s) "
+           "in-place=%.2fms (%.1f MP/s)\n",
+           path.c_str(), width, height, heapMs, megapixels / heapMs * 1e3,
+           inPlaceMs, megapixels / inPlaceMs * 1e3);
+    printMemory("heap+copy", heapMemory);
+    printMemory("in-place", inPlaceMemory);
+    totalHeapMs += heapMs;
+    totalInPlaceMs += inPlaceMs;
+    totalMegapixels += megapixels;
+  }
+
+  printf("total %.2f MP heap+copy=%.1f MP/s in-place=%.1f MP/s\n",
+         totalMegapixels, totalMegapixels / totalHeapMs * 1e3,
+         totalMegapixels / totalInPlaceMs * 1e3);
+  return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the renderer on a headless surface through a set of scenarios and
+ * writes the results as JSON, one object per scenario:
+ *   frames_per_second   iterations per second of wall time
+ *   cpu_ms              mean CPU milliseconds per render() stage, or the
+ *                       whole iteration for the non-frame scenarios
+ *   allocations_per_iteration  operator new calls, on any thread, counted
+ *                              by alloc_counter.cpp
+ *
+ * Usage: frame_bench [--iterations N] [--filter substring] [--json path]
+ * Meant to be run against a software driver so results are comparable
+ * between machines, e.g.
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json frame_bench
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "hellovk.h"
+
+namespace {
+
+const VkExtent2D SURFACE_EXTENT = {1080, 1920};
+
+struct Scenario {
+  std::string name;
+  // Called once before the warm-up iterations.
+  std::function<void(vkt::HelloVK &)> setup;
+  std::function<void(vkt::HelloVK &)> iteration;
+  // Whether iteration is a render() call, with per-stage timings.
+  bool frame;
+};
+
+std::vector<Scenario> makeScenarios() {
+  std::vector<Scenario> scenarios;
+  auto render = [](vkt::HelloVK &app) { app.render(); };
+  auto drawFrames = [&](const char *name, uint32_t draws, uint32_t instances,
+                        uint32_t sprites = 0) {
+    scenarios.push_back({name,
+                         [=](vkt::HelloVK &app) {
+                           app.setDrawWorkload(draws, instances);
+                           app.setSpriteWorkload(sprites);
+                         },
+                         render, true});
+  };
+  drawFrames("empty_frame", 0, 1);
+  drawFrames("draws_1", 1, 1);
+  drawFrames("draws_100", 100, 1);
+  drawFrames("draws_1000", 1000, 1);
+  drawFrames("instances_1000", 1, 1000);
+  drawFrames("instances_100000", 1, 100000);
+  drawFrames("sprites_1000", 1, 1, 1000);
+  drawFrames("sprites_100000", 1, 1, 100000);
+  for (uint32_t size : {256u, 1024u, 2048u}) {
+    scenarios.push_back(
+        {"texture_upload_" + std::to_string(size),
+         [](vkt::HelloVK &app) {
+           app.setDrawWorkload(1, 1);
+           app.setSpriteWorkload(0);
+         },
+         [=](vkt::HelloVK &app) { app.uploadTexture(size, size); }, false});
+  }
+  scenarios.push_back({"swapchain_recreate",
+                       [](vkt::HelloVK &app) {
+                         app.setDrawWorkload(1, 1);
+                         app.setSpriteWorkload(0);
+                       },
+                       [](vkt::HelloVK &app) { app.recreateSwapChain(); },
+                       false});
+  return scenarios;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint32_t iterations = 200;
+  const char *filter = "";
+  const char *jsonPath = nullptr;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--iterations") == 0) {
+      iterations = std::max(1ul, strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--filter") == 0) {
+      filter = argv[i + 1];
+    } else if (strcmp(argv[i], "--json") == 0) {
+      jsonPath = argv[i + 1];
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  FILE *json = jsonPath ? fopen(jsonPath, "w") : stdout;
+  if (json == nullptr) {
+    fprintf(stderr, "cannot write %s\n", jsonPath);
+    return 1;
+  }
+
+  std::unique_ptr<vkt::AssetSource> assets = vkt::createFileAssetSource(
+      {HELLOVK_HOST_ASSETS_DIR, HELLOVK_ASSETS_DIR});
+  vkt::HelloVK app;
+  app.reset(vkt::createHeadlessSurfaceProvider(SURFACE_EXTENT),
+            assets.get());
+  app.initVulkan();
+  // Every scenario measures frames with the texture, like captures do.
+  app.waitForTextureLoad();
+
+  fprintf(json, "{\n  \"surface\": [%u, %u],\n  \"scenarios\": [",
+          SURFACE_EXTENT.width, SURFACE_EXTENT.height);
+  const char *separator = "\n";
+  for (const Scenario &scenario : makeScenarios()) {
+    if (scenario.name.find(filter) == std::string::npos) {
+      continue;
+    }
+    scenario.setup(app);
+    // Warm up pipelines, allocations and the frames in flight.
+    for (uint32_t i = 0; i < std::max(2u, iterations / 10); i++) {
+      scenario.iteration(app);
+    }
+
+    vkt::FrameTimings total;
+    const uint64_t allocationsBefore =
+        vkt::processAllocationCounts().allocations;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+      scenario.iteration(app);
+      const vkt::FrameTimings &frame = app.frameTimings();
+      total.waitMs += frame.waitMs;
+      total.acquireMs += frame.acquireMs;
+      total.updateMs += frame.updateMs;
+      total.recordMs += frame.recordMs;
+      total.submitMs += frame.submitMs;
+      total.presentMs += frame.presentMs;
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    const double allocations =
+        double(vkt::processAllocationCounts().allocations -
+               allocationsBefore) /
+        iterations;
+
+    fprintf(json, "%s    {\"name\": \"%s\", \"iterations\": %u, ", separator,
+            scenario.name.c_str(), iterations);
+    fprintf(json, "\"frames_per_second\": %.2f, ", iterations / seconds);
+    if (scenario.frame) {
+      fprintf(json,
+              "\"cpu_ms\": {\"wait\": %.4f, \"acquire\": %.4f, "
+              "\"update\": %.4f, \"record\": %.4f, \"submit\": %.4f, "
+              "\"present\": %.4f}, ",
+              total.waitMs / iterations, total.acquireMs / iterations,
+              total.updateMs / iterations, total.recordMs / iterations,
+              total.submitMs / iterations, total.presentMs / iterations);
+    } else {
+      fprintf(json, "\"cpu_ms\": {\"total\": %.4f}, ",
+              seconds * 1e3 / iterations);
+    }
+    fprintf(json, "\"allocations_per_iteration\": %.2f}", allocations);
+    separator = ",\n";
+    fprintf(stderr, "%-20s %10.1f/s %8.2f allocations\n",
+            scenario.name.c_str(), iterations / seconds, allocations);
+  }
+  fprintf(json, "\n  ]\n}\n");
+  if (json != stdout) {
+    fclose(json);
+  }
+
+  app.cleanup();
+  return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures how inflating a zlib cooked texture scales with the number of
+ * threads, using the same code path as the app.
+ *
+ * Usage: inflate_bench <texture.vkt> [max threads]
+ * Cook the input with `asset_cooker --zlib`.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include "cooked_texture.h"
+#include "job_system.h"
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: inflate_bench <texture.vkt> [max threads]\n");
+    return 1;
+  }
+  const uint32_t maxThreads =
+      argc > 2 ? atoi(argv[2])
+               : std::max(1u, std::thread::hardware_concurrency());
+
+  std::ifstream file(argv[1], std::ios::binary);
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  const vkt::CookedTextureHeader *header =
+      vkt::getCookedTextureHeader(data.data(), data.size());
+  if (header == nullptr || !(header->flags & vkt::COOKED_TEXTURE_ZLIB)) {
+    fprintf(stderr, "%s is not a zlib cooked texture\n", argv[1]);
+    return 1;
+  }
+
+  const vkt::CookedTextureMip *mips = vkt::getCookedTextureMips(header);
+  std::vector<uint64_t> mipOffsets(header->mipLevels);
+  uint64_t size = 0;
+  uint32_t chunkCount = 0;
+  for (uint32_t i = 0; i < header->mipLevels; i++) {
+    mipOffsets[i] = size;
+    size += mips[i].uncompressedSize;
+    chunkCount += mips[i].chunkCount;
+  }
+  std::vector<uint8_t> target(size);
+  printf("%s: %ux%u, %u mips, %u chunks, %.1f MB inflated\n", argv[1],
+         header->width, header->height, header->mipLevels, chunkCount,
+         size / 1e6);
+
+  const int iterations = 10;
+  double singleThreadMs = 0.0;
+  for (uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+    vkt::JobSystem jobs(threads - 1);
+    double bestMs = 1e30;
+    for (int i = 0; i < iterations; i++) {
+      auto start = std::chrono::steady_clock::now();
+      if (!vkt::inflateCookedTexture(data.data(), header, target.data(),
+                                     mipOffsets.data(), true, &jobs)) {
+        fprintf(stderr, "corrupt data\n");
+        return 1;
+      }
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      bestMs = std::min(bestMs, elapsed.count());
+    }
+    if (threads == 1) {
+      singleThreadMs = bestMs;
+    }
+    printf("threads=%u time=%.2fms throughput=%.0f MB/s speedup=%.2fx\n",
+           threads, bestMs, size / 1e3 / bestMs, singleThreadMs / bestMs);
+  }
+  return 0;
+}
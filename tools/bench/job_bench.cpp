@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures how the job system scales with the number of threads, and stress
+ * tests it with nested jobs, dependencies and submissions from outside
+ * threads, checking that every job runs exactly once and in order, and
+ * that submitting from the owning thread does not allocate.
+ *
+ * Usage: job_bench [max threads]
+ *        job_bench --stress [rounds]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "job_system.h"
+
+namespace {
+
+double bestTimeMs(const std::function<void()> &kernel) {
+  const int iterations = 10;
+  double bestMs = 1e30;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    kernel();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    bestMs = std::min(bestMs, elapsed.count());
+  }
+  return bestMs;
+}
+
+// Spawns a binary tree of jobs, each waiting for its children.
+void forkJoin(vkt::JobSystem &jobs, int depth, std::atomic<uint32_t> &leaves) {
+  if (depth == 0) {
+    leaves++;
+    return;
+  }
+  vkt::JobCounter children;
+  jobs.run([&] { forkJoin(jobs, depth - 1, leaves); }, &children);
+  jobs.run([&] { forkJoin(jobs, depth - 1, leaves); }, &children);
+  jobs.wait(children);
+}
+
+void scaling(uint32_t maxThreads) {
+  std::vector<float> data(1 << 22);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<float>(i % 1000);
+  }
+  const uint32_t smallJobs = 100000;
+  printf("threads  parallelFor   %u jobs   fork-join 2^14\n", smallJobs);
+  for (uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+    vkt::JobSystem jobs(threads - 1);
+
+    double forMs = bestTimeMs([&] {
+      jobs.parallelFor(static_cast<uint32_t>(data.size()), 16384,
+                       [&](uint32_t first, uint32_t end) {
+                         for (uint32_t i = first; i < end; i++) {
+                           data[i] = std::sqrt(data[i] * data[i] + 1.0f);
+                         }
+                       });
+    });
+
+    std::atomic<uint32_t> ran{0};
+    double jobsMs = bestTimeMs([&] {
+      vkt::JobCounter counter;
+      for (uint32_t i = 0; i < smallJobs; i++) {
+        jobs.run([&] { ran++; }, &counter);
+      }
+      jobs.wait(counter);
+    });
+
+    std::atomic<uint32_t> leaves{0};
+    double treeMs = bestTimeMs([&] { forkJoin(jobs, 14, leaves); });
+
+    printf("%7u %9.2fms %9.2fms (%4.0f ns/job) %9.2fms\n", threads, forMs,
+           jobsMs, jobsMs * 1e6 / smallJobs, treeMs);
+  }
+}
+
+bool stress(int rounds) {
+  bool ok = true;
+  const uint32_t hardwareThreads =
+      std::max(1u, std::thread::hardware_concurrency());
+  for (int round = 0; round < rounds && ok; round++) {
+    // Oversubscribe to shake out races even on small machines.
+    vkt::JobSystem jobs(round % (hardwareThreads * 2 + 2));
+
+    // Nested fork-join.
+    std::atomic<uint32_t> leaves{0};
+    forkJoin(jobs, 10, leaves);
+    ok &= leaves == 1024;
+
+    // Continuations run after all jobs of the stage they depend on.
+    std::atomic<uint32_t> stageOne{0};
+    std::atomic<uint32_t> seenByStageTwo{0};
+    vkt::JobCounter first, second;
+    for (int i = 0; i < 100; i++) {
+      jobs.run([&] { stageOne++; }, &first);
+    }
+    for (int i = 0; i < 100; i++) {
+      jobs.run([&] { seenByStageTwo += stageOne == 100; }, &second, &first);
+    }
+    jobs.wait(second);
+    ok &= seenByStageTwo == 100;
+
+    // Submissions from threads the job system does not know, overflowing
+    // the deques, with every index visited exactly once.
+    std::vector<std::atomic<uint32_t>> visits(20000);
+    vkt::JobCounter outside;
+    std::vector<std::thread> producers;
+    for (uint32_t t = 0; t < 2; t++) {
+      producers.emplace_back([&, t] {
+        for (uint32_t i = t; i < visits.size(); i += 2) {
+          jobs.run([&, i] { visits[i]++; }, &outside);
+        }
+      });
+    }
+    for (std::thread &producer : producers) {
+      producer.join();
+    }
+    jobs.wait(outside);
+
+    jobs.parallelFor(static_cast<uint32_t>(visits.size()), 7,
+                     [&](uint32_t begin, uint32_t end) {
+                       for (uint32_t i = begin; i < end; i++) {
+                         visits[i]++;
+                       }
+                     });
+    for (auto &count : visits) {
+      ok &= count == 2;
+    }
+
+    // What the frame loop does: parallel loops and jobs waited for on the
+    // thread that owns the job system, which must not allocate.
+    vkt::AllocationScope allocations;
+    std::atomic<uint32_t> ranges{0};
+    for (int i = 0; i < 100; i++) {
+      jobs.parallelFor(1000, 10, [&](uint32_t, uint32_t) { ranges++; });
+      vkt::JobCounter frameJobs;
+      for (int j = 0; j < 8; j++) {
+        jobs.run([&] { ranges++; }, &frameJobs);
+      }
+      jobs.wait(frameJobs);
+    }
+    ok &= ranges == 100 * (100 + 8);
+    if (allocations.counts().allocations != 0) {
+      fprintf(stderr, "submitting jobs allocated %llu times\n",
+              (unsigned long long)allocations.counts().allocations);
+      ok = false;
+    }
+    if (!ok) {
+      fprintf(stderr, "round %d with %u threads failed\n", round,
+              jobs.threadCount());
+    }
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--stress") == 0) {
+    const int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    if (!stress(rounds)) {
+      return 1;
+    }
+    printf("%d stress rounds passed\n", rounds);
+    return 0;
+  }
+  const uint32_t maxThreads =
+      argc > 1 ? strtoul(argv[1], nullptr, 10)
+               : std::max(1u, std::thread::hardware_concurrency());
+  scaling(maxThreads);
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the pixel format kernels against a straightforward per-pixel
+ * reference and measures their throughput. Exits with an error if any kernel
+ * disagrees with the reference.
+ *
+ * Usage: pixel_format_bench [image]
+ * Defaults to the app's texture.png; also prints the format the policy picks.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "image_codec.h"
+#include "pixel_format.h"
+
+namespace {
+
+uint32_t reference(uint32_t value, uint32_t maxValue) {
+  return static_cast<uint32_t>(std::floor(value * maxValue / 255.0 + 0.5));
+}
+
+double bestTimeMs(const std::function<void()> &kernel) {
+  const int iterations = 20;
+  double bestMs = 1e30;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    kernel();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    bestMs = std::min(bestMs, elapsed.count());
+  }
+  return bestMs;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : HELLOVK_ASSETS_DIR "/texture.png";
+  int width, height, channels;
+  stbi_uc *image = stbi_load(path, &width, &height, &channels, 4);
+  if (image == nullptr) {
+    fprintf(stderr, "cannot load %s: %s\n", path, stbi_failure_reason());
+    return 1;
+  }
+  const size_t count = static_cast<size_t>(width) * height;
+  std::vector<uint8_t> source(image, image + count * 4);
+  stbi_image_free(image);
+
+  vkt::PixelFormat chosen =
+      vkt::choosePixelFormat(source.data(), count, vkt::FormatPolicy());
+  const char *formatNames[] = {"r8g8b8a8", "r5g6b5", "b4g4r4a4",
+                               "a2b10g10r10"};
+  printf("%s %dx%d policy=%s\n", path, width, height,
+         formatNames[static_cast<int>(chosen)]);
+
+  // Real images rarely hit every value, so append every channel value and
+  // some noise, with a length that exercises the scalar tail.
+  std::mt19937 random(7);
+  for (uint32_t i = 0; i < (256 + 13) * 4; i++) {
+    source.push_back(i < 1024 ? (i / 4 + (i % 4) * 64) & 255 : random());
+  }
+  const size_t pixelCount = source.size() / 4;
+
+  int mismatches = 0;
+  std::vector<uint16_t> output16(pixelCount);
+  std::vector<uint32_t> output32(pixelCount);
+  std::vector<uint8_t> output8(source.size());
+  std::vector<float> linear(source.size());
+  const uint8_t bgra[4] = {2, 1, 0, 3};
+
+  auto report = [&](const char *name, double ms) {
+    printf("%-14s %7.2fms %7.0f Mpixel/s\n", name, ms, pixelCount / ms / 1e3);
+  };
+
+  report("r5g6b5", bestTimeMs([&] {
+           vkt::convertToR5G6B5(source.data(), output16.data(), pixelCount);
+         }));
+  for (size_t i = 0; i < pixelCount; i++) {
+    const uint8_t *p = &source[i * 4];
+    mismatches += output16[i] != ((reference(p[0], 31) << 11) |
+                                  (reference(p[1], 63) << 5) |
+                                  reference(p[2], 31));
+  }
+
+  report("b4g4r4a4", bestTimeMs([&] {
+           vkt::convertToB4G4R4A4(source.data(), output16.data(), pixelCount);
+         }));
+  for (size_t i = 0; i < pixelCount; i++) {
+    const uint8_t *p = &source[i * 4];
+    mismatches += output16[i] !=
+                  ((reference(p[2], 15) << 12) | (reference(p[1], 15) << 8) |
+                   (reference(p[0], 15) << 4) | reference(p[3], 15));
+  }
+
+  report("a2b10g10r10", bestTimeMs([&] {
+           vkt::convertToA2B10G10R10(source.data(), output32.data(),
+                                     pixelCount);
+         }));
+  for (size_t i = 0; i < pixelCount; i++) {
+    const uint8_t *p = &source[i * 4];
+    mismatches += output32[i] != ((reference(p[3], 3) << 30) |
+                                  (reference(p[2], 1023) << 20) |
+                                  (reference(p[1], 1023) << 10) |
+                                  reference(p[0], 1023));
+  }
+
+  report("premultiply", bestTimeMs([&] {
+           memcpy(output8.data(), source.data(), source.size());
+           vkt::premultiplyAlpha(output8.data(), pixelCount);
+         }));
+  for (size_t i = 0; i < source.size(); i++) {
+    const uint32_t alpha = source[i | 3];
+    mismatches += output8[i] != ((i & 3) == 3 ? alpha
+                                              : reference(source[i], alpha));
+  }
+
+  report("swizzle", bestTimeMs([&] {
+           vkt::swizzleChannels(source.data(), output8.data(), pixelCount,
+                                bgra);
+         }));
+  for (size_t i = 0; i < source.size(); i++) {
+    mismatches += output8[i] != source[(i & ~3) + bgra[i & 3]];
+  }
+
+  report("srgb decode", bestTimeMs([&] {
+           vkt::decodeSrgb(source.data(), linear.data(), pixelCount);
+         }));
+  report("srgb encode", bestTimeMs([&] {
+           vkt::encodeSrgb(linear.data(), output8.data(), pixelCount);
+         }));
+  // Decoding then encoding must round-trip every 8-bit value.
+  mismatches += output8 != source;
+
+  if (mismatches != 0) {
+    fprintf(stderr, "%d results differ from the reference\n", mismatches);
+    return 1;
+  }
+  printf("all kernels match the reference\n");
+  return 0;
+}
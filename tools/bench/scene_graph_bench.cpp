@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures SceneGraph::update for a full rebuild and for frames in which only
+ * a fraction of the nodes move, and checks every world matrix against a
+ * direct parent-chain computation.
+ *
+ * Usage: scene_graph_bench [roots] [threads]
+ * Each root gets 10 children with 10 children each, i.e. 111 nodes.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "job_system.h"
+#include "scene_graph.h"
+
+namespace {
+
+double timeMs(const std::function<void()> &kernel) {
+  auto start = std::chrono::steady_clock::now();
+  kernel();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+glm::mat4 localMatrix(const vkt::TransformBatch &locals, uint32_t node) {
+  return glm::translate(glm::mat4(1.0f), locals.position(node)) *
+         glm::mat4_cast(locals.rotation(node)) *
+         glm::scale(glm::mat4(1.0f), locals.scale(node));
+}
+
+// Largest relative difference from multiplying out each node's parent chain.
+float maxError(const vkt::SceneGraph &scene) {
+  float error = 0.0f;
+  for (uint32_t node = 0; node < scene.size(); node++) {
+    glm::mat4 expected(1.0f);
+    for (uint32_t n = node; n != vkt::SceneGraph::kNoParent;
+         n = scene.parent(n)) {
+      expected = localMatrix(scene.localTransforms(), n) * expected;
+    }
+    for (int c = 0; c < 4; c++) {
+      for (int r = 0; r < 4; r++) {
+        error = std::max(error, std::abs(scene.world(node)[c][r] -
+                                         expected[c][r]) /
+                                    std::max(1.0f, std::abs(expected[c][r])));
+      }
+    }
+  }
+  return error;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t roots = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000;
+  const uint32_t threads =
+      argc > 2 ? strtoul(argv[2], nullptr, 10)
+               : std::max(1u, std::thread::hardware_concurrency());
+
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  auto randomRotation = [&]() {
+    return glm::angleAxis(unit(random) * 3.14159f,
+                          glm::normalize(glm::vec3(0.3f, 1.0f, unit(random))));
+  };
+
+  vkt::SceneGraph scene;
+  for (uint32_t r = 0; r < roots; r++) {
+    uint32_t root = scene.addNode(
+        vkt::SceneGraph::kNoParent,
+        glm::vec3(unit(random), 0.0f, unit(random)) * 100.0f,
+        randomRotation(), glm::vec3(1.0f));
+    for (int c = 0; c < 10; c++) {
+      uint32_t child =
+          scene.addNode(root, glm::vec3(unit(random), 1.0f, unit(random)),
+                        randomRotation(), glm::vec3(0.8f));
+      for (int g = 0; g < 10; g++) {
+        scene.addNode(child, glm::vec3(unit(random), 0.5f, unit(random)),
+                      randomRotation(), glm::vec3(0.9f));
+      }
+    }
+  }
+  vkt::JobSystem jobs(threads - 1);
+  printf("%u nodes, %u threads\n", scene.size(), jobs.threadCount());
+
+  uint32_t updated = 0;
+  double ms = timeMs([&] { updated = scene.update(&jobs); });
+  printf("- full:       %8.3fms %6u nodes %6.1f ns/node\n", ms, updated,
+         ms * 1e6 / updated);
+
+  // Move a percentage of the nodes, picked at random at every level.
+  for (int percent : {10, 1, 0}) {
+    const uint32_t moves = scene.size() * percent / 100;
+    std::vector<uint32_t> moved(moves);
+    for (uint32_t &node : moved) {
+      node = random() % scene.size();
+    }
+    double bestMs = 1e30;
+    for (int i = 0; i < 20; i++) {
+      for (uint32_t node : moved) {
+        scene.setRotation(node, randomRotation());
+      }
+      bestMs = std::min(bestMs,
+                        timeMs([&] { updated = scene.update(&jobs); }));
+    }
+    printf("- %2d%% moved:  %8.3fms %6u nodes\n", percent, bestMs, updated);
+  }
+
+  const float error = maxError(scene);
+  printf("max relative error %g\n", error);
+  if (!(error < 1e-4f)) {
+    fprintf(stderr, "world matrices differ from the parent chain\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures what TRACE_SCOPE and TRACE_COUNTER cost with no capture running
+ * and while one is, on one thread and on several at once, then checks that
+ * every recorded zone made it into the file.
+ *
+ * Usage: trace_bench [threads] [trace.json]
+ * Zones are recorded in batches smaller than a thread's ring, with pauses
+ * for the flush thread in between, so the timings are of the recording path
+ * alone. Exits with 1 when a zone costs more than kMaxZoneNs while a capture
+ * runs, or when any zone was dropped or lost.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+namespace {
+
+const int kBatches = 50;
+const int kZonesPerBatch = 4000;
+const double kMaxZoneNs = 50.0;
+
+volatile uint32_t sink = 0;
+
+// Best nanoseconds per zone over the batches.
+double zoneNs() {
+  double best = 1e30;
+  for (int b = 0; b < kBatches; b++) {
+    const uint64_t start = vkt::traceNowNs();
+    for (int i = 0; i < kZonesPerBatch; i++) {
+      TRACE_SCOPE("zone");
+      sink = sink + 1;
+    }
+    best = std::min(best,
+                    double(vkt::traceNowNs() - start) / kZonesPerBatch);
+    if (vkt::tracingActive()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  return best;
+}
+
+double counterNs() {
+  const uint64_t start = vkt::traceNowNs();
+  for (int i = 0; i < kZonesPerBatch; i++) {
+    TRACE_COUNTER("counter", i);
+  }
+  return double(vkt::traceNowNs() - start) / kZonesPerBatch;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t threads = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+  const char *path = argc > 2 ? argv[2] : "trace_bench.json";
+
+  printf("- no capture:        %6.1f ns/zone\n", zoneNs());
+
+  if (!vkt::startTracing(path)) {
+    fprintf(stderr, "cannot write %s\n", path);
+    return 1;
+  }
+  vkt::setTraceThreadName("main");
+  const double singleNs = zoneNs();
+  printf("- capture, 1 thread: %6.1f ns/zone\n", singleNs);
+  printf("- capture, counter:  %6.1f ns/counter\n", counterNs());
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  std::vector<double> results(threads);
+  std::vector<std::thread> workers;
+  for (uint32_t t = 0; t < threads; t++) {
+    workers.emplace_back([t, &results] {
+      vkt::setTraceThreadName(("worker " + std::to_string(t)).c_str());
+      results[t] = zoneNs();
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  const double slowestNs = *std::max_element(results.begin(), results.end());
+  printf("- capture, %u threads: %5.1f ns/zone (slowest thread)\n", threads,
+         slowestNs);
+  const uint32_t dropped = vkt::stopTracing();
+
+  // Every zone is one "ph":"X" event in the file.
+  FILE *file = fopen(path, "r");
+  std::string json;
+  char buffer[65536];
+  for (size_t n; file && (n = fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+    json.append(buffer, n);
+  }
+  if (file) {
+    fclose(file);
+  }
+  uint64_t zones = 0;
+  for (size_t at = json.find("\"ph\":\"X\""); at != std::string::npos;
+       at = json.find("\"ph\":\"X\"", at + 1)) {
+    zones++;
+  }
+  const uint64_t expected =
+      uint64_t(threads + 1) * kBatches * kZonesPerBatch;
+  printf("%llu of %llu zones written, %u dropped, to %s\n",
+         (unsigned long long)zones, (unsigned long long)expected, dropped,
+         path);
+  if (zones + dropped != expected) {
+    fprintf(stderr, "zones went missing\n");
+    return 1;
+  }
+  if (dropped != 0) {
+    fprintf(stderr, "zones were dropped\n");
+    return 1;
+  }
+  if (std::max(singleNs, slowestNs) > kMaxZoneNs) {
+    fprintf(stderr, "a zone costs more than %.0f ns\n", kMaxZoneNs);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares TransformBatch::computeMatrices with building the same model and
+ * MVP matrices object by object through glm, and checks that both agree.
+ *
+ * Usage: transform_bench [objects]
+ * Defaults to 10000 objects; an odd count exercises the scalar tail.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "transform_batch.h"
+
+namespace {
+
+double bestTimeMs(const std::function<void()> &kernel) {
+  const int iterations = 50;
+  double bestMs = 1e30;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    kernel();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    bestMs = std::min(bestMs, elapsed.count());
+  }
+  return bestMs;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10001;
+  if (count == 0) {
+    fprintf(stderr, "usage: transform_bench [objects]\n");
+    return 1;
+  }
+
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::vector<glm::vec3> positions(count), scales(count);
+  std::vector<glm::quat> rotations(count);
+  vkt::TransformBatch batch;
+  batch.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    positions[i] = glm::vec3(unit(random), unit(random), unit(random)) * 50.0f;
+    rotations[i] = glm::angleAxis(
+        unit(random) * 3.14159f,
+        glm::normalize(glm::vec3(unit(random), unit(random), 0.5f)));
+    scales[i] = glm::vec3(unit(random), unit(random), unit(random)) + 1.5f;
+    batch.set(i, positions[i], rotations[i], scales[i]);
+  }
+  const glm::mat4 viewProjection =
+      glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) *
+      glm::lookAt(glm::vec3(0, 40, 80), glm::vec3(0), glm::vec3(0, 1, 0));
+
+  std::vector<glm::mat4> glmModels(count), glmMvps(count);
+  std::vector<glm::mat4> models(count), mvps(count);
+
+  const double glmMs = bestTimeMs([&] {
+    for (size_t i = 0; i < count; i++) {
+      glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]) *
+                        glm::mat4_cast(rotations[i]) *
+                        glm::scale(glm::mat4(1.0f), scales[i]);
+      glmModels[i] = model;
+      glmMvps[i] = viewProjection * model;
+    }
+  });
+  const double batchMs = bestTimeMs([&] {
+    batch.computeMatrices(0, count, viewProjection, models.data(),
+                          mvps.data());
+  });
+
+  // Differences come only from the order of float operations.
+  float maxError = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    for (int c = 0; c < 4; c++) {
+      for (int r = 0; r < 4; r++) {
+        maxError = std::max(
+            maxError, std::abs(models[i][c][r] - glmModels[i][c][r]) /
+                          std::max(1.0f, std::abs(glmModels[i][c][r])));
+        maxError = std::max(maxError,
+                            std::abs(mvps[i][c][r] - glmMvps[i][c][r]) /
+                                std::max(1.0f, std::abs(glmMvps[i][c][r])));
+      }
+    }
+  }
+
+  printf("%zu objects, model + mvp\n", count);
+  printf("- glm:   %8.3fms %6.1f ns/object\n", glmMs, glmMs * 1e6 / count);
+  printf("- batch: %8.3fms %6.1f ns/object (%.2fx)\n", batchMs,
+         batchMs * 1e6 / count, glmMs / batchMs);
+  printf("max relative error %g\n", maxError);
+  if (!(maxError < 1e-5f)) {
+    fprintf(stderr, "batch matrices differ from glm\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+#!/bin/sh
+#
+# Copyright (C) 2022 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Renders each scene below with hellovk_host, reads the last frame back and
+# compares it with the golden image of the same name in this directory.
+#
+# Usage: tools/golden/check_goldens.sh <tools build dir> [--update]
+#
+# --update replaces the golden images with the current rendering, to be
+# committed with the change that caused it. Goldens are recorded with
+# lavapipe; other drivers may need a looser tolerance:
+#
+#   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+#       tools/golden/check_goldens.sh tools/build --update
+
+set -e
+
+BUILD_DIR=${1:?usage: check_goldens.sh <tools build dir> [--update]}
+UPDATE=$2
+GOLDEN_DIR=$(cd "$(dirname "$0")" && pwd)
+OUT_DIR=$BUILD_DIR/golden_output
+mkdir -p "$OUT_DIR"
+
+# hellovk_host is only built where the Vulkan SDK was found.
+for tool in hellovk_host image_compare; do
+  if [ ! -x "$BUILD_DIR/$tool" ]; then
+    echo "$BUILD_DIR/$tool not found, build the tools with the Vulkan SDK"
+    exit 1
+  fi
+done
+
+# Anti-aliasing and rounding differ slightly between driver versions.
+THRESHOLD=2
+MAX_DIFF_PIXELS=64
+
+failed=0
+# name, frames, width, height. The quad turns one degree per frame.
+while read -r name frames width height; do
+  actual=$OUT_DIR/$name.png
+  if ! "$BUILD_DIR/hellovk_host" "$frames" "$width" "$height" "$actual" \
+      > /dev/null; then
+    echo "$name: rendering failed"
+    failed=1
+  elif [ "$UPDATE" = "--update" ]; then
+    cp "$actual" "$GOLDEN_DIR/$name.png"
+    echo "$name: updated"
+  elif [ ! -f "$GOLDEN_DIR/$name.png" ]; then
+    echo "$name: no golden image, run with --update to record it"
+    failed=1
+  elif "$BUILD_DIR/image_compare" --threshold $THRESHOLD \
+      --max-diff-pixels $MAX_DIFF_PIXELS --diff "$OUT_DIR/$name.diff.png" \
+      "$GOLDEN_DIR/$name.png" "$actual" > /dev/null; then
+    echo "$name: ok"
+  else
+    echo "$name: differs, see $OUT_DIR/$name.diff.png"
+    failed=1
+  fi
+done <<SCENES
+quad_0 1 360 640
+quad_45 46 360 640
+SCENES
+
+exit $failed
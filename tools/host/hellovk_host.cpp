@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the renderer core on desktop Linux, against the system Vulkan loader
+ * and a headless surface, so it can be exercised on machines without a GPU
+ * through a software driver such as lavapipe or SwiftShader.
+ *
+ * Usage: hellovk_host [frames] [width] [height] [capture.png]
+ * Renders 100 frames at 1080x1920 (a portrait phone screen) by default.
+ * With a capture path the last frame is read back and written as a PNG,
+ * which tools/golden/check_goldens.sh compares against the golden images.
+ *
+ * With HELLOVK_TRACE=trace.json in the environment the run is traced, see
+ * trace.h; open the file in ui.perfetto.dev. HELLOVK_VALIDATION=sync (or
+ * standard, best-practices, gpu-assisted) runs it under the validation
+ * layer, see README.md. HELLOVK_STARTUP_REPORT=startup.jsonl appends the
+ * startup profile, see startup_profiler.h.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "hellovk.h"
+#include "png_writer.h"
+
+int main(int argc, char **argv) {
+  const uint32_t frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100;
+  const VkExtent2D extent = {
+      argc > 2 ? uint32_t(strtoul(argv[2], nullptr, 10)) : 1080u,
+      argc > 3 ? uint32_t(strtoul(argv[3], nullptr, 10)) : 1920u};
+  const char *capturePath = argc > 4 ? argv[4] : nullptr;
+  const char *tracePath = getenv("HELLOVK_TRACE");
+  if (tracePath != nullptr) {
+    if (!vkt::startTracing(tracePath)) {
+      fprintf(stderr, "cannot write a trace to %s\n", tracePath);
+      return 1;
+    }
+    vkt::setTraceThreadName("main");
+  }
+
+  // Compiled shaders come from the build tree, everything else from the
+  // app's asset directory.
+  std::unique_ptr<vkt::AssetSource> assets = vkt::createFileAssetSource(
+      {HELLOVK_HOST_ASSETS_DIR, HELLOVK_ASSETS_DIR});
+  vkt::HelloVK app;
+  app.reset(vkt::createHeadlessSurfaceProvider(extent), assets.get());
+  app.initVulkan();
+  for (uint32_t i = capturePath ? 1 : 0; i < frames; i++) {
+    app.render();
+  }
+  if (capturePath != nullptr) {
+    std::vector<uint8_t> pixels;
+    uint32_t width, height;
+    if (!app.captureFrame(pixels, width, height) ||
+        !vkt::writePng(capturePath, pixels.data(), width, height)) {
+      fprintf(stderr, "cannot capture the frame to %s\n", capturePath);
+      app.cleanup();
+      return 1;
+    }
+  }
+  app.cleanup();
+  if (tracePath != nullptr) {
+    const uint32_t dropped = vkt::stopTracing();
+    if (dropped > 0) {
+      fprintf(stderr, "the trace dropped %u events\n", dropped);
+    }
+  }
+  printf("rendered %u frames at %ux%u\n", frames, extent.width,
+         extent.height);
+  return 0;
+}
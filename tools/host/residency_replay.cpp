@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays texture access traces through TextureResidencyManager the way the
+ * renderer drives it, with uploads that take a few frames to complete, and
+ * checks which mips end up resident and which get evicted. A few scripted
+ * traces check the policy in texture_residency.h case by case, a long random
+ * one checks the bookkeeping every frame.
+ *
+ * Usage: residency_replay [random frames]
+ * Exits with 1 on the first failed check.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "texture_residency.h"
+
+namespace {
+
+using vkt::MipEviction;
+using vkt::MipLoad;
+using vkt::TextureId;
+using vkt::TextureResidencyManager;
+
+const uint64_t kMiB = 1 << 20;
+// Frames from update() reporting a load to the upload having completed.
+const uint64_t kUploadLatency = 2;
+
+struct Use {
+  TextureId texture;
+  float screenSize;
+};
+
+/*
+ * A manager plus the uploads in flight, and its own account of every mip
+ * the manager said to load or evict, to check the manager's against.
+ */
+class Replay {
+ public:
+  explicit Replay(uint64_t budgetBytes) : residency(budgetBytes) {}
+
+  TextureId add(uint32_t size, uint32_t mipLevels) {
+    TextureId id = residency.registerTexture({size, size, mipLevels, 4});
+    resident.push_back(mipLevels - 1);
+    levels.push_back(mipLevels);
+    usedThisFrame.push_back(false);
+    return id;
+  }
+
+  void setBudget(uint64_t budgetBytes) { residency.setBudget(budgetBytes); }
+
+  // Runs one frame drawing uses, and checks what the manager did with it.
+  bool frame(const std::vector<Use> &uses) {
+    std::fill(usedThisFrame.begin(), usedThisFrame.end(), false);
+    for (const Use &use : uses) {
+      residency.requestFromScreenSize(use.texture, use.screenSize,
+                                      use.screenSize);
+      usedThisFrame[use.texture] = true;
+    }
+    residency.update(frameNumber, loads, evictions);
+
+    for (const MipEviction &eviction : evictions) {
+      if (eviction.mip != resident[eviction.texture] ||
+          eviction.mip + 1 >= levels[eviction.texture]) {
+        return fail("evicted mip %u of texture %u, resident from %u",
+                    eviction.mip, eviction.texture,
+                    resident[eviction.texture]);
+      }
+      // A texture drawn this frame only loses detail it does not need.
+      if (usedThisFrame[eviction.texture] &&
+          eviction.mip >= residency.requestedMip(eviction.texture)) {
+        return fail("evicted requested mip %u of texture %u", eviction.mip,
+                    eviction.texture);
+      }
+      resident[eviction.texture]++;
+      evicted++;
+    }
+    for (const MipLoad &load : loads) {
+      if (load.mip + 1 != resident[load.texture] ||
+          load.mip < residency.requestedMip(load.texture)) {
+        return fail("loaded mip %u of texture %u, resident from %u",
+                    load.mip, load.texture, resident[load.texture]);
+      }
+      inFlight.push_back({load, frameNumber + kUploadLatency});
+      loaded++;
+    }
+    if (residency.committedBytes() != expectedCommittedBytes()) {
+      return fail("%llu bytes committed, expected %llu",
+                  (unsigned long long)residency.committedBytes(),
+                  (unsigned long long)expectedCommittedBytes());
+    }
+    if (residency.committedBytes() > residency.budgetBytes()) {
+      TextureId victim = evictable();
+      if (victim != UINT32_MAX) {
+        return fail("%llu bytes committed over a budget of %llu, with mip %u "
+                    "of texture %u left to evict",
+                    (unsigned long long)residency.committedBytes(),
+                    (unsigned long long)residency.budgetBytes(),
+                    resident[victim], victim);
+      }
+    }
+
+    // Uploads land between frames, the way the renderer reports them.
+    frameNumber++;
+    for (size_t i = 0; i < inFlight.size();) {
+      if (inFlight[i].doneFrame <= frameNumber) {
+        const MipLoad &load = inFlight[i].load;
+        residency.onMipLoaded(load.texture, load.mip);
+        resident[load.texture] = load.mip;
+        inFlight[i] = inFlight.back();
+        inFlight.pop_back();
+      } else {
+        i++;
+      }
+    }
+    for (TextureId id = 0; id < resident.size(); id++) {
+      if (residency.residentMip(id) != resident[id] ||
+          residency.minLod(id) != float(resident[id])) {
+        return fail("texture %u resident from %u, expected %u", id,
+                    residency.residentMip(id), resident[id]);
+      }
+    }
+    return true;
+  }
+
+  bool frames(uint32_t count, const std::vector<Use> &uses) {
+    for (uint32_t i = 0; i < count; i++) {
+      if (!frame(uses)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool expectResident(TextureId texture, uint32_t mip) {
+    if (resident[texture] != mip) {
+      return fail("texture %u resident from mip %u, expected %u", texture,
+                  resident[texture], mip);
+    }
+    return true;
+  }
+
+  uint32_t residentMip(TextureId texture) const { return resident[texture]; }
+
+  uint32_t loaded = 0;
+  uint32_t evicted = 0;
+
+ private:
+  struct Upload {
+    MipLoad load;
+    uint64_t doneFrame;
+  };
+
+  template <typename... Args>
+  bool fail(const char *format, Args... args) {
+    fprintf(stderr, "frame %llu: ", (unsigned long long)frameNumber);
+    fprintf(stderr, format, args...);
+    fprintf(stderr, "\n");
+    return false;
+  }
+
+  uint64_t bytes(TextureId texture, uint32_t mip) const {
+    return residency.mipBytes(texture, mip);
+  }
+
+  uint64_t expectedCommittedBytes() const {
+    uint64_t total = 0;
+    for (TextureId id = 0; id < resident.size(); id++) {
+      for (uint32_t mip = resident[id]; mip < levels[id]; mip++) {
+        total += bytes(id, mip);
+      }
+    }
+    for (const Upload &upload : inFlight) {
+      total += bytes(upload.load.texture, upload.load.mip);
+    }
+    return total;
+  }
+
+  /*
+   * A texture the manager could still evict from, if any. The smallest mips,
+   * mips being loaded and what textures drawn this frame request may exceed
+   * the budget.
+   */
+  TextureId evictable() const {
+    for (TextureId id = 0; id < resident.size(); id++) {
+      bool pending = false;
+      for (const Upload &upload : inFlight) {
+        pending |= upload.load.texture == id;
+      }
+      if (!pending && resident[id] + 1 < levels[id] &&
+          (!usedThisFrame[id] ||
+           resident[id] < residency.requestedMip(id))) {
+        return id;
+      }
+    }
+    return UINT32_MAX;
+  }
+
+  TextureResidencyManager residency;
+  std::vector<MipLoad> loads;
+  std::vector<MipEviction> evictions;
+  std::vector<Upload> inFlight;
+  std::vector<uint32_t> resident;
+  std::vector<uint32_t> levels;
+  std::vector<bool> usedThisFrame;
+  uint64_t frameNumber = 0;
+};
+
+// A texture drawn smaller than it is only streams in the mips it needs.
+bool streamsToScreenSize() {
+  Replay replay(64 * kMiB);
+  TextureId texture = replay.add(1024, 11);
+  return replay.frames(40, {{texture, 256.0f}}) &&
+         replay.expectResident(texture, 2) && replay.loaded == 8 &&
+         replay.evicted == 0;
+}
+
+// Over budget, the least recently used texture loses its finest mip.
+bool evictsLeastRecentlyUsed() {
+  Replay replay(3 * kMiB);
+  TextureId a = replay.add(512, 10);
+  TextureId b = replay.add(512, 10);
+  TextureId c = replay.add(512, 10);
+  return replay.frames(30, {{a, 512.0f}, {b, 512.0f}}) &&
+         replay.frames(10, {{b, 512.0f}}) && replay.expectResident(a, 0) &&
+         replay.expectResident(b, 0) && replay.evicted == 0 &&
+         replay.frames(40, {{c, 512.0f}}) && replay.expectResident(a, 1) &&
+         replay.expectResident(b, 0) && replay.expectResident(c, 0) &&
+         replay.evicted == 1;
+}
+
+// Detail nothing asks for any more goes first, even from textures in use.
+bool evictsUnrequestedFirst() {
+  Replay replay(3 * kMiB);
+  TextureId a = replay.add(512, 10);
+  TextureId b = replay.add(512, 10);
+  if (!replay.frames(30, {{a, 512.0f}, {b, 512.0f}})) {
+    return false;
+  }
+  replay.setBudget(2 * kMiB);
+  return replay.frames(30, {{a, 64.0f}, {b, 512.0f}}) &&
+         replay.expectResident(a, 1) && replay.expectResident(b, 0) &&
+         replay.evicted == 1;
+}
+
+// Textures on screen are never evicted below what they request, streaming
+// stops instead.
+bool keepsTexturesInUse() {
+  Replay replay(2 * kMiB);
+  TextureId a = replay.add(512, 10);
+  TextureId b = replay.add(512, 10);
+  if (!replay.frames(60, {{a, 512.0f}, {b, 512.0f}})) {
+    return false;
+  }
+  // Only one of the two fits in full.
+  const uint32_t mipA = replay.residentMip(a);
+  const uint32_t mipB = replay.residentMip(b);
+  return replay.evicted == 0 && std::min(mipA, mipB) == 0 &&
+         std::max(mipA, mipB) == 1;
+}
+
+// Many textures of mixed sizes drawn at random sizes under a budget that
+// changes now and then, checking the bookkeeping every frame.
+bool randomTrace(uint32_t frameCount) {
+  std::mt19937 random(2022);
+  Replay replay(16 * kMiB);
+  const uint32_t textureCount = 64;
+  for (uint32_t i = 0; i < textureCount; i++) {
+    uint32_t sizeLog2 = 6 + random() % 6;
+    replay.add(1u << sizeLog2, sizeLog2 + 1);
+  }
+  std::vector<Use> uses;
+  for (uint32_t frame = 0; frame < frameCount; frame++) {
+    if (random() % 200 == 0) {
+      replay.setBudget((1 + random() % 32) * kMiB);
+    }
+    uses.clear();
+    // A slowly moving window of textures on screen.
+    uint32_t first = (frame / 50) % textureCount;
+    for (uint32_t i = 0; i < 8; i++) {
+      TextureId texture = (first + i * 3) % textureCount;
+      uses.push_back({texture, float(16 << (random() % 7))});
+    }
+    if (!replay.frame(uses)) {
+      return false;
+    }
+  }
+  printf("random trace: %u frames, %u mips loaded, %u evicted\n", frameCount,
+         replay.loaded, replay.evicted);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t randomFrames =
+      argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+  struct {
+    const char *name;
+    bool (*run)();
+  } traces[] = {
+      {"streams to screen size", streamsToScreenSize},
+      {"evicts least recently used", evictsLeastRecentlyUsed},
+      {"evicts unrequested first", evictsUnrequestedFirst},
+      {"keeps textures in use", keepsTexturesInUse},
+  };
+  for (const auto &trace : traces) {
+    if (!trace.run()) {
+      fprintf(stderr, "%s: failed\n", trace.name);
+      return 1;
+    }
+    printf("%s: ok\n", trace.name);
+  }
+  if (!randomTrace(randomFrames)) {
+    fprintf(stderr, "random trace: failed\n");
+    return 1;
+  }
+  return 0;
+}
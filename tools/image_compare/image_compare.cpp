@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares a rendered image against a golden image with a tolerance for the
+ * small differences between drivers and compilers: a pixel differs when any
+ * channel is off by more than --threshold, and the images match while no
+ * more than --max-diff-pixels pixels differ.
+ *
+ * Usage: image_compare [--threshold N] [--max-diff-pixels N] [--diff out.png]
+ *                      <golden image> <actual image>
+ *
+ * The threshold defaults to 2 levels and the pixel budget to 0. --diff
+ * writes the golden image dimmed, with the differing pixels in red.
+ *
+ * Exits with 0 when the images match, 1 when they differ and 2 on errors.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "png_writer.h"
+
+namespace {
+
+const int kChannels = 4;
+
+void printUsage() {
+  fprintf(stderr,
+          "usage: image_compare [--threshold N] [--max-diff-pixels N] "
+          "[--diff out.png] <golden image> <actual image>\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int threshold = 2;
+  unsigned long maxDiffPixels = 0;
+  const char *diffPath = nullptr;
+  int arg = 1;
+  for (; arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+    if (strcmp(argv[arg], "--threshold") == 0) {
+      threshold = atoi(argv[arg + 1]);
+    } else if (strcmp(argv[arg], "--max-diff-pixels") == 0) {
+      maxDiffPixels = strtoul(argv[arg + 1], nullptr, 10);
+    } else if (strcmp(argv[arg], "--diff") == 0) {
+      diffPath = argv[arg + 1];
+    } else {
+      printUsage();
+      return 2;
+    }
+  }
+  if (argc - arg != 2) {
+    printUsage();
+    return 2;
+  }
+
+  int width[2], height[2], channels;
+  stbi_uc *pixels[2];
+  for (int i = 0; i < 2; i++) {
+    pixels[i] = stbi_load(argv[arg + i], &width[i], &height[i], &channels,
+                          kChannels);
+    if (pixels[i] == nullptr) {
+      fprintf(stderr, "cannot load %s: %s\n", argv[arg + i],
+              stbi_failure_reason());
+      return 2;
+    }
+  }
+  if (width[0] != width[1] || height[0] != height[1]) {
+    fprintf(stderr, "size differs: %dx%d golden, %dx%d actual\n", width[0],
+            height[0], width[1], height[1]);
+    return 1;
+  }
+
+  const size_t pixelCount = size_t(width[0]) * height[0];
+  size_t diffPixels = 0;
+  int maxDelta = 0;
+  for (size_t p = 0; p < pixelCount; p++) {
+    int pixelDelta = 0;
+    for (int c = 0; c < kChannels; c++) {
+      pixelDelta = std::max(pixelDelta, std::abs(pixels[0][p * 4 + c] -
+                                                 pixels[1][p * 4 + c]));
+    }
+    maxDelta = std::max(maxDelta, pixelDelta);
+    const bool differs = pixelDelta > threshold;
+    diffPixels += differs;
+    if (diffPath != nullptr) {
+      // Reuse the golden image's memory for the diff.
+      stbi_uc *out = &pixels[0][p * 4];
+      if (differs) {
+        out[0] = 255;
+        out[1] = out[2] = 0;
+      } else {
+        for (int c = 0; c < 3; c++) {
+          out[c] /= 4;
+        }
+      }
+      out[3] = 255;
+    }
+  }
+
+  printf("%zu of %zu pixels differ by more than %d (largest difference %d)\n",
+         diffPixels, pixelCount, threshold, maxDelta);
+  if (diffPath != nullptr &&
+      !vkt::writePng(diffPath, pixels[0], width[0], height[0])) {
+    fprintf(stderr, "cannot write %s\n", diffPath);
+  }
+  stbi_image_free(pixels[0]);
+  stbi_image_free(pixels[1]);
+  return diffPixels > maxDiffPixels ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "png_writer.h"
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace vkt {
+
+namespace {
+
+void appendU32(std::vector<uint8_t> &out, uint32_t value) {
+  const uint8_t bytes[4] = {uint8_t(value >> 24), uint8_t(value >> 16),
+                            uint8_t(value >> 8), uint8_t(value)};
+  out.insert(out.end(), bytes, bytes + 4);
+}
+
+// Length, type, data and a CRC over type and data.
+void appendChunk(std::vector<uint8_t> &out, const char type[4],
+                 const uint8_t *data, size_t size) {
+  appendU32(out, static_cast<uint32_t>(size));
+  const size_t typeOffset = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data, data + size);
+  appendU32(out, crc32(0, out.data() + typeOffset, size + 4));
+}
+
+}  // namespace
+
+bool writePng(const char *path, const uint8_t *rgba, uint32_t width,
+              uint32_t height) {
+  std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+  std::vector<uint8_t> header;
+  appendU32(header, width);
+  appendU32(header, height);
+  // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlace.
+  header.insert(header.end(), {8, 6, 0, 0, 0});
+  appendChunk(png, "IHDR", header.data(), header.size());
+
+  // Every row is stored unfiltered (filter type 0), which keeps this simple
+  // at some cost in file size.
+  const size_t rowSize = size_t(width) * 4;
+  std::vector<uint8_t> rows((rowSize + 1) * height);
+  for (uint32_t y = 0; y < height; y++) {
+    rows[y * (rowSize + 1)] = 0;
+    memcpy(&rows[y * (rowSize + 1) + 1], rgba + y * rowSize, rowSize);
+  }
+  uLongf compressedSize = compressBound(rows.size());
+  std::vector<uint8_t> compressed(compressedSize);
+  if (compress2(compressed.data(), &compressedSize, rows.data(), rows.size(),
+                Z_BEST_COMPRESSION) != Z_OK) {
+    return false;
+  }
+  appendChunk(png, "IDAT", compressed.data(), compressedSize);
+  appendChunk(png, "IEND", nullptr, 0);
+
+  FILE *file = fopen(path, "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  const bool written = fwrite(png.data(), 1, png.size(), file) == png.size();
+  return fclose(file) == 0 && written;
+}
+
+}  // namespace vkt
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HELLOVK_PNG_WRITER_H
+#define HELLOVK_PNG_WRITER_H
+
+#include <cstdint>
+
+namespace vkt {
+
+// Writes tightly packed 8-bit RGBA pixels as a PNG. Returns false if the
+// file cannot be written.
+bool writePng(const char *path, const uint8_t *rgba, uint32_t width,
+              uint32_t height);
+
+}  // namespace vkt
+
+#endif  // HELLOVK_PNG_WRITER_H